@@ -0,0 +1,409 @@
+//***************************************************************************************************
+//                              	B E N C H . C						    *
+//***************************************************************************************************
+// Host benchmark for the escom functions that run for every line or every symbol.		    *
+// escom.c, escomlib.c and escomsim.c are included, escom.c with ESCOM_NO_MAIN, and built on	    *
+// Linux with the replacement <windows.h> in bench/compat.  The serial port and the console are	    *
+// not used.											    *
+// Compile and run from the top directory of the repository:					    *
+//    gcc -O2 -Ibench/compat bench/bench.c -o escom-bench					    *
+//    ./escom-bench [-t msec] [name...]								    *
+// -t sets the minimum measuring time per benchmark (default 200 msec).  Names select benchmarks.  *
+// The inputs are the sources in examples/*.fs and a generated .efr file with MAXSYM symbols.	    *
+// Output is one line per benchmark, for example:						    *
+//    bench: name=search_dict_hit iters=2097152 ns/op=412.3 allocs/op=0.00 bytes/op=0		    *
+// allocs/op and bytes/op count the calls to malloc, calloc, realloc and strdup in escom.c and    *
+// escomlib.c.											    *
+// esc_include_sim uploads examples/primes_32.fs to the simulator of escomsim.c and exits with	    *
+// code 1 if the upload fails.									    *
+//***************************************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Count allocations in escom.c and escomlib.c.  The system headers are already included, so the macros only
+// affect the code below.
+static long long nallocs = 0 ;				// Number of allocations
+static long long nbytes = 0 ;				// Number of bytes allocated
+
+void* bench_malloc ( size_t n )
+{
+  nallocs++ ;
+  nbytes += n ;
+  return malloc ( n ) ;
+}
+
+void* bench_calloc ( size_t n, size_t s )
+{
+  nallocs++ ;
+  nbytes += n * s ;
+  return calloc ( n, s ) ;
+}
+
+void* bench_realloc ( void* p, size_t n )
+{
+  nallocs++ ;
+  nbytes += n ;
+  return realloc ( p, n ) ;
+}
+
+char* bench_strdup ( const char* s )
+{
+  nallocs++ ;
+  nbytes += strlen ( s ) + 1 ;
+  return strdup ( s ) ;
+}
+
+#define malloc  bench_malloc
+#define calloc  bench_calloc
+#define realloc bench_realloc
+#undef  strdup
+#define strdup  bench_strdup
+
+#define ESCOM_NO_MAIN
+#include "../src/escom.c"
+#include "../src/escomlib.c"
+#include "../src/escomsim.c"
+
+#undef malloc
+#undef calloc
+#undef realloc
+#undef strdup
+
+// Constants:
+#define MAXSYM     900					// Symbols in generated .efr, fits in dictionary
+#define MAXLINES   1000					// Max number of source lines
+
+struct bench_t						// Benchmark
+{
+  const char* name ;					// Name in output
+  void        ( *run ) ( long iters ) ;			// Run the function iters times
+} ;
+
+// Global variables
+char*         srclines[MAXLINES] ;			// Lines of examples/*.fs
+int           srclinec = 0 ;				// Number of lines in srclines
+char          efrfile[64] ;				// Generated .efr file
+volatile long sink ;					// Keeps results alive
+
+
+//***************************************************************************************************
+//					N S E C							    *
+//***************************************************************************************************
+// Monotonic time in nanoseconds.								    *
+//***************************************************************************************************
+long long nsec()
+{
+  struct timespec ts ;					// Current time
+
+  clock_gettime ( CLOCK_MONOTONIC, &ts ) ;
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec ;
+}
+
+
+//***************************************************************************************************
+//					L O A D _ S O U R C E S					    *
+//***************************************************************************************************
+// Read the lines of the example sources, converted the same way as esc_include() does.		    *
+//***************************************************************************************************
+BOOL load_sources()
+{
+  const char* files[] = { "examples/primes_8.fs", "examples/primes_32.fs",
+                          "examples/neotest_8.fs", "examples/test.fs", NULL } ;
+  char        line[256] ;				// Input line
+  FILE*       fp ;					// Source file
+  int         len_1 ;					// Length of line minus 1
+  int         i ;					// Index in files
+
+  for ( i = 0 ; files[i] ; i++ )
+  {
+    if ( ( fp = fopen ( files[i], "r" ) ) == NULL )
+    {
+      fprintf ( stderr, "bench: unable to open %s, run from the top directory\n", files[i] ) ;
+      return FALSE ;
+    }
+    while ( srclinec < MAXLINES && fgets ( line, sizeof(line), fp ) )
+    {
+      len_1 = strlen ( line ) - 1 ;
+      if ( len_1 <= 0 || line[0] == '\\' || line[0] == '#' )	// Not sent to the target
+      {
+        continue ;
+      }
+      if ( line[len_1] == '\n' )
+      {
+        line[len_1] = '\r' ;
+      }
+      srclines[srclinec++] = strdup ( line ) ;
+    }
+    fclose ( fp ) ;
+  }
+  return srclinec > 0 ;
+}
+
+
+//***************************************************************************************************
+//					M A K E _ E F R						    *
+//***************************************************************************************************
+// Generate a resource file with MAXSYM symbols, in the format of the real .efr files.		    *
+//***************************************************************************************************
+BOOL make_efr()
+{
+  FILE* fp ;						// Output file
+  int   i ;						// Symbol number
+
+  snprintf ( efrfile, sizeof(efrfile), "/tmp/escom-bench-%d.efr", (int)getpid() ) ;
+  if ( ( fp = fopen ( efrfile, "w" ) ) == NULL )
+  {
+    fprintf ( stderr, "bench: unable to create %s\n", efrfile ) ;
+    return FALSE ;
+  }
+  fprintf ( fp, "\\ Generated by escom-bench\n" ) ;
+  for ( i = 0 ; i < MAXSYM ; i++ )
+  {
+    fprintf ( fp, "%04X equ PER%d_REG%d    \\ Register %d of peripheral %d\n",
+              0x5000 + i, i / 16, i % 16, i % 16, i / 16 ) ;
+  }
+  fclose ( fp ) ;
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//					The benchmarks						    *
+//***************************************************************************************************
+void b_gettoken ( long iters )
+{
+  const char* line = "\\res export PD_ODR PD_DDR PD_CR1 PD_CR2\r" ;
+
+  while ( iters-- )
+  {
+    sink += (long)gettoken ( line, 4 ) ;
+  }
+}
+
+void b_esc_token ( long iters )
+{
+  const char*     line = "\\res export PD_ODR PD_DDR PD_CR1 PD_CR2\r" ;
+  struct esc_span tok ;					// Token found
+
+  while ( iters-- )
+  {
+    if ( esc_token ( line, 4, &tok ) )
+    {
+      sink += tok.len ;
+    }
+  }
+}
+
+void b_strip_comment ( long iters )
+{
+  char line[256] ;					// Copy, esc_strip_comment() modifies
+  long i ;
+
+  for ( i = 0 ; i < iters ; i++ )
+  {
+    strcpy ( line, srclines[i % srclinec] ) ;
+    esc_strip_comment ( line ) ;
+    sink += line[0] ;
+  }
+}
+
+void b_echoFilter ( long iters )
+{
+  char inbuf[] = "1 PD_DDR 4 B! 1 PD_CR1 4 B! 1 PD_CR2 4 B!\r" ;
+  char combuf[] = "1 PD_DDR 4 B! 1 PD_CR1 4 B! 1 PD_CR2 4 B! ok\n" ;
+
+  while ( iters-- )
+  {
+    sink += *echoFilter ( combuf, inbuf ) ;
+  }
+}
+
+void b_beautify ( long iters )
+{
+  char line[256] ;					// Copy, beautify() modifies
+
+  while ( iters-- )
+  {
+    strcpy ( line, ": sqrt 10 begin 1 + dup dup * 2 pick swap < until swap drop ; ok\n" ) ;
+    beautify ( line, 85 ) ;
+    sink += line[0] ;
+  }
+}
+
+void b_load_cpu_res ( long iters )
+{
+  while ( iters-- )
+  {
+    ses.dinx = 0 ;					// Start with an empty dictionary
+    esc_load_res ( &ses, efrfile ) ;
+    sink += ses.dinx ;
+  }
+}
+
+void b_search_dict_hit ( long iters )
+{
+  char sym[20] ;					// Symbol to search
+  long i ;
+
+  for ( i = 0 ; i < iters ; i++ )
+  {
+    snprintf ( sym, sizeof(sym), "PER%ld_REG%ld",
+               ( i % MAXSYM ) / 16, ( i % MAXSYM ) % 16 ) ;
+    sink += esc_search_dict ( &ses, sym ) ;
+  }
+}
+
+void b_search_dict_miss ( long iters )
+{
+  while ( iters-- )
+  {
+    sink += esc_search_dict ( &ses, "PD_ODR" ) ;
+  }
+}
+
+void b_search_file ( long iters )
+{
+  while ( iters-- )
+  {
+    sink += (long)search_file ( "primes_8.fs" ) ;
+  }
+}
+
+void b_check_line ( long iters )
+{
+  long i ;
+
+  check_start() ;
+  for ( i = 0 ; i < iters ; i++ )
+  {
+    check_line ( srclines[i % srclinec], "bench", i ) ;
+  }
+  chk_active = FALSE ;
+  sink += chk_errors ;
+}
+
+void b_esc_include_sim ( long iters )
+{
+  static struct esc_session s ;				// Session with the simulator, large
+  static struct esc_sim     m ;				// Simulated target, large
+
+  esc_init ( &s, "mecrisp", NULL, NULL ) ;
+  strcpy ( s.path, path ) ;
+  s.sim = &m ;
+  while ( iters-- )
+  {
+    esc_sim_init ( &m, "mecrisp" ) ;			// Empty dictionary for every upload
+    if ( ! esc_include ( &s, "primes_32.fs", FALSE ) || s.compiling )
+    {
+      fprintf ( stderr, "bench: esc_include failed in %s line %d\n", s.errfile, s.errline ) ;
+      exit ( 1 ) ;
+    }
+  }
+  sink += s.lines ;
+}
+
+struct bench_t benches[] =
+{
+  { "gettoken",        b_gettoken },
+  { "esc_token",       b_esc_token },
+  { "strip_comment",   b_strip_comment },
+  { "echoFilter",      b_echoFilter },
+  { "beautify",        b_beautify },
+  { "load_cpu_res",    b_load_cpu_res },
+  { "search_dict_hit", b_search_dict_hit },
+  { "search_dict_miss", b_search_dict_miss },
+  { "search_file",     b_search_file },
+  { "check_line",      b_check_line },
+  { "esc_include_sim", b_esc_include_sim },
+  { NULL,              NULL }
+} ;
+
+
+//***************************************************************************************************
+//					R U N _ B E N C H					    *
+//***************************************************************************************************
+// Run a benchmark with a doubling number of iterations until it takes at least minms msec.	    *
+//***************************************************************************************************
+void run_bench ( struct bench_t* b, int minms )
+{
+  long      iters = 1 ;					// Number of iterations
+  long long t ;						// Elapsed time in nsec
+  long long a0 ;					// Allocations before run
+  long long m0 ;					// Bytes allocated before run
+
+  while ( TRUE )
+  {
+    a0 = nallocs ;
+    m0 = nbytes ;
+    t = nsec() ;
+    b->run ( iters ) ;
+    t = nsec() - t ;
+    if ( t >= minms * 1000000LL || iters >= ( 1L << 30 ) )
+    {
+      break ;
+    }
+    iters *= 2 ;
+  }
+  printf ( "bench: name=%s iters=%ld ns/op=%.1f allocs/op=%.2f bytes/op=%.0f\n",
+           b->name, iters, (double)t / iters, (double)( nallocs - a0 ) / iters,
+           (double)( nbytes - m0 ) / iters ) ;
+  fflush ( stdout ) ;
+}
+
+
+//***************************************************************************************************
+//					M A I N							    *
+//***************************************************************************************************
+int main ( int argc, char* argv[] )
+{
+  int  minms = 200 ;					// Minimum time per benchmark
+  int  opt ;						// Option from getopt
+  int  i, j ;						// Index in benches, argv
+  BOOL selected ;					// Benchmark selected by name
+
+  while ( ( opt = getopt ( argc, argv, "t:" ) ) != -1 )
+  {
+    if ( opt == 't' )
+    {
+      minms = atoi ( optarg ) ;
+    }
+    else
+    {
+      fprintf ( stderr, "Usage: %s [-t msec] [name...]\n", argv[0] ) ;
+      return 1 ;
+    }
+  }
+  headless = TRUE ;					// No console
+  strcpy ( path, "bench;lib;examples" ) ;		// File found in last entry
+  set_target_specials() ;				// Session, for beautify()
+  if ( ! load_sources() || ! make_efr() )
+  {
+    return 1 ;
+  }
+  esc_load_res ( &ses, efrfile ) ;			// Dictionary for esc_search_dict
+  for ( i = 0 ; i < srclinec ; i++ )			// Target words for check_line
+  {
+    char* copy = strdup ( srclines[i] ) ;		// word_list() modifies
+    word_list ( &wbuiltin, copy ) ;
+    free ( copy ) ;
+  }
+  printf ( "bench: escom=%s symbols=%d lines=%d minms=%d\n",
+           VERSION, ses.dinx, srclinec, minms ) ;
+  for ( i = 0 ; benches[i].name ; i++ )
+  {
+    selected = ( optind == argc ) ;			// No names: run all
+    for ( j = optind ; j < argc ; j++ )
+    {
+      selected |= ( strcmp ( argv[j], benches[i].name ) == 0 ) ;
+    }
+    if ( selected )
+    {
+      run_bench ( &benches[i], minms ) ;
+    }
+  }
+  unlink ( efrfile ) ;
+  return 0 ;
+}
@@ -0,0 +1,16 @@
+//***************************************************************************************************
+//                              	I O . H							    *
+//***************************************************************************************************
+// Minimal replacement of the Windows <io.h> to build escom.c on Linux for the host benchmark.	    *
+//***************************************************************************************************
+#ifndef ESCOM_COMPAT_IO_H
+#define ESCOM_COMPAT_IO_H
+
+#include <stdint.h>
+#include <unistd.h>
+
+static inline int _open_osfhandle ( intptr_t h, int flags ) { return -1 ; }
+static inline intptr_t _get_osfhandle ( int fd )           { return -1 ; }
+static inline int _dup2 ( int fd1, int fd2 )                { return dup2 ( fd1, fd2 ) ; }
+
+#endif
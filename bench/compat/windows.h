@@ -0,0 +1,264 @@
+//***************************************************************************************************
+//                              	W I N D O W S . H					    *
+//***************************************************************************************************
+// Minimal replacement of <windows.h> to build escom.c on Linux for the host benchmark.		    *
+// Only the types and constants used by escom.c are defined.  File attributes, tick counts,	    *
+// performance counters and interlocked operations work.  Console, serial port, pipe and thread    *
+// functions are stubs that report failure, so they are never reached by the benchmark.	    *
+//***************************************************************************************************
+#ifndef ESCOM_COMPAT_WINDOWS_H
+#define ESCOM_COMPAT_WINDOWS_H
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+typedef int            BOOL ;
+typedef unsigned long  DWORD ;
+typedef unsigned short WORD ;
+typedef unsigned char  BYTE ;
+typedef short          SHORT ;
+typedef char           CHAR ;
+typedef long           LONG ;
+typedef long long      LONGLONG ;
+typedef unsigned long long ULONGLONG ;
+typedef unsigned int   UINT ;
+typedef uintptr_t      ULONG_PTR ;
+typedef void*          HANDLE ;
+typedef void*          LPVOID ;
+typedef DWORD*         LPDWORD ;
+typedef wchar_t        WCHAR ;
+
+#define TRUE                 1
+#define FALSE                0
+#define WINAPI
+#define TEXT(x)              x
+#define INFINITE             0xFFFFFFFF
+#define MAXDWORD             0xFFFFFFFF
+#define INVALID_HANDLE_VALUE ( (HANDLE)(intptr_t)-1 )
+
+// Console
+#define FOREGROUND_BLUE      1
+#define FOREGROUND_GREEN     2
+#define FOREGROUND_RED       4
+#define FOREGROUND_INTENSITY 8
+#define STD_INPUT_HANDLE     ( (DWORD)-10 )
+#define STD_OUTPUT_HANDLE    ( (DWORD)-11 )
+#define STD_ERROR_HANDLE     ( (DWORD)-12 )
+
+#define KEY_EVENT            1
+#define VK_RETURN            0x0D
+typedef struct { SHORT X, Y ; } COORD ;
+typedef struct { SHORT Left, Top, Right, Bottom ; } SMALL_RECT ;
+typedef struct { union { WCHAR UnicodeChar ; CHAR AsciiChar ; } Char ; WORD Attributes ; } CHAR_INFO ;
+typedef struct { COORD dwSize ; COORD dwCursorPosition ; WORD wAttributes ; SMALL_RECT srWindow ;
+                 COORD dwMaximumWindowSize ; } CONSOLE_SCREEN_BUFFER_INFO ;
+typedef struct { BOOL bKeyDown ; WORD wRepeatCount ; WORD wVirtualKeyCode ; WORD wVirtualScanCode ;
+                 union { WCHAR UnicodeChar ; CHAR AsciiChar ; } uChar ; DWORD dwControlKeyState ; } KEY_EVENT_RECORD ;
+typedef struct { WORD EventType ; union { KEY_EVENT_RECORD KeyEvent ; } Event ; } INPUT_RECORD ;
+
+// Serial port
+#define CBR_9600             9600
+#define CBR_14400            14400
+#define CBR_19200            19200
+#define CBR_38400            38400
+#define CBR_56000            56000
+#define CBR_57600            57600
+#define CBR_115200           115200
+#define CBR_128000           128000
+#define CBR_256000           256000
+#define ONESTOPBIT           0
+#define NOPARITY             0
+#define RTS_CONTROL_DISABLE  0
+#define RTS_CONTROL_ENABLE   1
+#define RTS_CONTROL_HANDSHAKE 2
+#define DTR_CONTROL_ENABLE   1
+#define PURGE_TXCLEAR        4
+#define PURGE_RXCLEAR        8
+#define SETXOFF              1
+#define SETXON               2
+
+typedef struct { DWORD ReadIntervalTimeout, ReadTotalTimeoutMultiplier, ReadTotalTimeoutConstant,
+                 WriteTotalTimeoutMultiplier, WriteTotalTimeoutConstant ; } COMMTIMEOUTS ;
+typedef struct { DWORD DCBlength, BaudRate ;
+                 DWORD fBinary:1, fParity:1, fOutxCtsFlow:1, fOutxDsrFlow:1, fDtrControl:2,
+                       fDsrSensitivity:1, fTXContinueOnXoff:1, fOutX:1, fInX:1, fErrorChar:1,
+                       fNull:1, fRtsControl:2, fAbortOnError:1, fDummy2:17 ;
+                 WORD wReserved, XonLim, XoffLim ; BYTE ByteSize, Parity, StopBits ;
+                 char XonChar, XoffChar, ErrorChar, EofChar, EvtChar ; WORD wReserved1 ; } DCB ;
+typedef struct { DWORD fCtsHold:1, fDsrHold:1, fRlsdHold:1, fXoffHold:1, fXoffSent:1, fEof:1,
+                       fTxim:1, fReserved:25 ;
+                 DWORD cbInQue, cbOutQue ; } COMSTAT ;
+
+// Files, pipes and synchronization
+#define GENERIC_READ         0x80000000
+#define GENERIC_WRITE        0x40000000
+#define OPEN_EXISTING        3
+#define FILE_SHARE_READ      1
+#define FILE_SHARE_WRITE     2
+#define FILE_SHARE_DELETE    4
+#define FILE_LIST_DIRECTORY  1
+#define FILE_FLAG_OVERLAPPED 0x40000000
+#define FILE_FLAG_BACKUP_SEMANTICS 0x02000000
+#define FILE_ATTRIBUTE_DIRECTORY 0x10
+#define INVALID_FILE_ATTRIBUTES ( (DWORD)-1 )
+#define FILE_NOTIFY_CHANGE_FILE_NAME 0x1
+#define FILE_NOTIFY_CHANGE_SIZE 0x8
+#define FILE_NOTIFY_CHANGE_LAST_WRITE 0x10
+#define MOVEFILE_REPLACE_EXISTING 1
+#define WAIT_OBJECT_0        0
+#define WAIT_TIMEOUT         258
+#define WAIT_FAILED          0xFFFFFFFF
+#define MAXIMUM_WAIT_OBJECTS 64
+#define ERROR_BROKEN_PIPE    109
+#define ERROR_PIPE_BUSY      231
+#define ERROR_NO_DATA        232
+#define ERROR_PIPE_CONNECTED 535
+#define ERROR_IO_PENDING     997
+#define PIPE_ACCESS_DUPLEX   3
+#define PIPE_TYPE_BYTE       0
+#define PIPE_READMODE_BYTE   0
+#define PIPE_WAIT            0
+#define PIPE_UNLIMITED_INSTANCES 255
+#define NMPWAIT_USE_DEFAULT_WAIT 0
+
+typedef struct { DWORD dwLowDateTime, dwHighDateTime ; } FILETIME ;
+typedef struct { WORD wYear, wMonth, wDayOfWeek, wDay, wHour, wMinute, wSecond,
+                 wMilliseconds ; } SYSTEMTIME ;
+typedef struct { ULONG_PTR Internal, InternalHigh ; DWORD Offset, OffsetHigh ;
+                 HANDLE hEvent ; } OVERLAPPED ;
+typedef struct { DWORD nLength ; void* lpSecurityDescriptor ; BOOL bInheritHandle ; } SECURITY_ATTRIBUTES ;
+typedef struct { DWORD dwFileAttributes ; FILETIME ftCreationTime, ftLastAccessTime, ftLastWriteTime ;
+                 DWORD nFileSizeHigh, nFileSizeLow, dwReserved0, dwReserved1 ;
+                 char cFileName[260] ; char cAlternateFileName[14] ; } WIN32_FIND_DATA ;
+typedef enum { GetFileExInfoStandard } GET_FILEEX_INFO_LEVELS ;
+typedef struct { DWORD dwFileAttributes ; FILETIME ftCreationTime, ftLastAccessTime, ftLastWriteTime ;
+                 DWORD nFileSizeHigh, nFileSizeLow ; } WIN32_FILE_ATTRIBUTE_DATA ;
+typedef union { struct { DWORD LowPart ; LONG HighPart ; } ; LONGLONG QuadPart ; } LARGE_INTEGER ;
+typedef DWORD ( WINAPI *LPTHREAD_START_ROUTINE ) ( LPVOID ) ;
+typedef struct { void* p ; } CRITICAL_SECTION ;
+
+// Functions that work
+static inline DWORD GetFileAttributes ( const char* f )
+{
+  struct stat st ;
+
+  if ( stat ( f, &st ) )
+  {
+    return INVALID_FILE_ATTRIBUTES ;
+  }
+  return S_ISDIR ( st.st_mode ) ? FILE_ATTRIBUTE_DIRECTORY : 0 ;
+}
+
+static inline LONGLONG compat_nsec()
+{
+  struct timespec ts ;
+
+  clock_gettime ( CLOCK_MONOTONIC, &ts ) ;
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec ;
+}
+
+static inline DWORD GetTickCount()
+{
+  return (DWORD)( compat_nsec() / 1000000 ) ;
+}
+
+static inline BOOL QueryPerformanceCounter ( LARGE_INTEGER* c )
+{
+  c->QuadPart = compat_nsec() ;
+  return TRUE ;
+}
+
+static inline BOOL QueryPerformanceFrequency ( LARGE_INTEGER* f )
+{
+  f->QuadPart = 1000000000LL ;
+  return TRUE ;
+}
+
+static inline void Sleep ( DWORD ms )
+{
+  usleep ( ms * 1000 ) ;
+}
+
+static inline void MemoryBarrier()                { __sync_synchronize() ; }
+static inline LONG InterlockedIncrement ( volatile LONG* v ) { return __sync_add_and_fetch ( v, 1 ) ; }
+static inline LONG InterlockedDecrement ( volatile LONG* v ) { return __sync_sub_and_fetch ( v, 1 ) ; }
+static inline LONG InterlockedExchangeAdd ( volatile LONG* v, LONG a ) { return __sync_fetch_and_add ( v, a ) ; }
+static inline LONG InterlockedExchange ( volatile LONG* v, LONG x ) { return __sync_lock_test_and_set ( v, x ) ; }
+static inline LONG InterlockedCompareExchange ( volatile LONG* v, LONG x, LONG c )
+{
+  return __sync_val_compare_and_swap ( v, c, x ) ;
+}
+static inline void InitializeCriticalSection ( CRITICAL_SECTION* c ) { }
+static inline void DeleteCriticalSection ( CRITICAL_SECTION* c )     { }
+static inline void EnterCriticalSection ( CRITICAL_SECTION* c )      { }
+static inline void LeaveCriticalSection ( CRITICAL_SECTION* c )      { }
+
+// Stubs, not used by the benchmark
+static inline HANDLE GetStdHandle ( DWORD h )                                  { return NULL ; }
+static inline BOOL SetStdHandle ( DWORD h, HANDLE x )                          { return FALSE ; }
+static inline BOOL GetConsoleScreenBufferInfo ( HANDLE h, CONSOLE_SCREEN_BUFFER_INFO* i ) { return FALSE ; }
+static inline BOOL ScrollConsoleScreenBuffer ( HANDLE h, const SMALL_RECT* r, const SMALL_RECT* c,
+                                               COORD d, const CHAR_INFO* f ) { return FALSE ; }
+static inline BOOL SetConsoleCursorPosition ( HANDLE h, COORD c )              { return FALSE ; }
+static inline BOOL SetConsoleTextAttribute ( HANDLE h, WORD a )                { return FALSE ; }
+static inline BOOL GetNumberOfConsoleInputEvents ( HANDLE h, DWORD* n )        { *n = 0 ; return FALSE ; }
+static inline BOOL FlushConsoleInputBuffer ( HANDLE h )                        { return FALSE ; }
+static inline BOOL PeekConsoleInput ( HANDLE h, INPUT_RECORD* r, DWORD l, DWORD* n ) { *n = 0 ; return FALSE ; }
+static inline BOOL GetConsoleMode ( HANDLE h, DWORD* m )                       { return FALSE ; }
+static inline BOOL SetConsoleMode ( HANDLE h, DWORD m )                        { return FALSE ; }
+static inline DWORD GetModuleFileName ( void* m, char* f, DWORD n )            { *f = '\0' ; return 0 ; }
+static inline HANDLE CreateFile ( const char* f, DWORD a, DWORD s, void* sa, DWORD c, DWORD fl,
+                                  HANDLE t )                                   { return INVALID_HANDLE_VALUE ; }
+static inline BOOL ReadFile ( HANDLE h, void* b, DWORD n, DWORD* r, OVERLAPPED* o ) { if ( r ) *r = 0 ; return FALSE ; }
+static inline BOOL WriteFile ( HANDLE h, const void* b, DWORD n, DWORD* w, OVERLAPPED* o ) { if ( w ) *w = 0 ; return FALSE ; }
+static inline BOOL CloseHandle ( HANDLE h )                                    { return FALSE ; }
+static inline BOOL FlushFileBuffers ( HANDLE h )                               { return FALSE ; }
+static inline BOOL GetCommTimeouts ( HANDLE h, COMMTIMEOUTS* t )               { return FALSE ; }
+static inline BOOL SetCommTimeouts ( HANDLE h, COMMTIMEOUTS* t )               { return FALSE ; }
+static inline BOOL GetCommState ( HANDLE h, DCB* d )                           { return FALSE ; }
+static inline BOOL SetCommState ( HANDLE h, DCB* d )                           { return FALSE ; }
+static inline BOOL SetupComm ( HANDLE h, DWORD i, DWORD o )                    { return FALSE ; }
+static inline BOOL ClearCommError ( HANDLE h, DWORD* e, COMSTAT* s )           { return FALSE ; }
+static inline BOOL PurgeComm ( HANDLE h, DWORD f )                             { return FALSE ; }
+static inline BOOL EscapeCommFunction ( HANDLE h, DWORD f )                    { return FALSE ; }
+static inline DWORD QueryDosDevice ( const char* d, char* t, DWORD n )         { return 0 ; }
+static inline HANDLE FindFirstFile ( const char* f, WIN32_FIND_DATA* d )       { return INVALID_HANDLE_VALUE ; }
+static inline BOOL FindNextFile ( HANDLE h, WIN32_FIND_DATA* d )               { return FALSE ; }
+static inline BOOL FindClose ( HANDLE h )                                      { return FALSE ; }
+static inline BOOL GetFileAttributesEx ( const char* f, GET_FILEEX_INFO_LEVELS l, void* d ) { return FALSE ; }
+static inline BOOL SetCurrentDirectory ( const char* d )                       { return chdir ( d ) == 0 ; }
+static inline DWORD GetFullPathName ( const char* f, DWORD n, char* b, char** p ) { return 0 ; }
+static inline BOOL MoveFileEx ( const char* f, const char* t, DWORD fl )       { return FALSE ; }
+static inline BOOL DeleteFile ( const char* f )                                { return unlink ( f ) == 0 ; }
+static inline DWORD GetLastError()                                             { return 0 ; }
+static inline void GetSystemTimeAsFileTime ( FILETIME* t )                     { t->dwLowDateTime = t->dwHighDateTime = 0 ; }
+static inline void GetLocalTime ( SYSTEMTIME* t )                              { *t = (SYSTEMTIME){ 0 } ; }
+static inline BOOL FileTimeToSystemTime ( const FILETIME* f, SYSTEMTIME* t )   { *t = (SYSTEMTIME){ 0 } ; return FALSE ; }
+static inline BOOL SystemTimeToTzSpecificLocalTime ( void* z, const SYSTEMTIME* u, SYSTEMTIME* l ) { *l = *u ; return FALSE ; }
+static inline HANDLE CreateThread ( void* a, size_t s, LPTHREAD_START_ROUTINE f, LPVOID p, DWORD fl,
+                                    DWORD* id )                                { return NULL ; }
+static inline HANDLE CreateEvent ( void* a, BOOL m, BOOL i, const char* n )    { return NULL ; }
+static inline BOOL SetEvent ( HANDLE h )                                       { return FALSE ; }
+static inline BOOL ResetEvent ( HANDLE h )                                     { return FALSE ; }
+static inline DWORD WaitForSingleObject ( HANDLE h, DWORD t )                  { return WAIT_FAILED ; }
+static inline DWORD WaitForMultipleObjects ( DWORD n, const HANDLE* h, BOOL a, DWORD t ) { return WAIT_FAILED ; }
+static inline HANDLE CreateNamedPipe ( const char* n, DWORD o, DWORD p, DWORD m, DWORD ob, DWORD ib,
+                                       DWORD t, void* sa )                     { return INVALID_HANDLE_VALUE ; }
+static inline BOOL ConnectNamedPipe ( HANDLE h, OVERLAPPED* o )                { return FALSE ; }
+static inline BOOL DisconnectNamedPipe ( HANDLE h )                            { return FALSE ; }
+static inline BOOL CancelIoEx ( HANDLE h, OVERLAPPED* o )                      { return FALSE ; }
+static inline BOOL GetOverlappedResult ( HANDLE h, OVERLAPPED* o, DWORD* n, BOOL w ) { if ( n ) *n = 0 ; return FALSE ; }
+static inline BOOL WaitNamedPipe ( const char* n, DWORD t )                    { return FALSE ; }
+static inline BOOL CreatePipe ( HANDLE* r, HANDLE* w, SECURITY_ATTRIBUTES* sa, DWORD s ) { return FALSE ; }
+static inline BOOL PeekNamedPipe ( HANDLE h, void* b, DWORD s, DWORD* r, DWORD* a, DWORD* l ) { return FALSE ; }
+static inline HANDLE FindFirstChangeNotification ( const char* d, BOOL s, DWORD f ) { return INVALID_HANDLE_VALUE ; }
+static inline BOOL FindNextChangeNotification ( HANDLE h )                     { return FALSE ; }
+static inline BOOL FindCloseChangeNotification ( HANDLE h )                    { return FALSE ; }
+
+#endif
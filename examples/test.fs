@@ -1,10 +1,10 @@
-\ Testing.....
-1 2 3 + + .
-1 3 4 + + .
-1 5 7 + + .
-1 12 13 + + .
-1 21 31 + + .
-1 22 32 + + .
-1 42 43 + + .
-1 52 53 + + .
+\ Testing.....  Run with "#test test.fs", the expected output follows "\>".
+1 2 3 + + .  \> 6
+1 3 4 + + .  \> 8
+1 5 7 + + .  \> 13
+1 12 13 + + . \> 26
+1 21 31 + + . \> 53
+1 22 32 + + . \> 55
+1 42 43 + + . \> 86
+1 52 53 + + . \> 106
 
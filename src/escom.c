@@ -9,8 +9,13 @@
 // Can be compiled by the gcc compiler that is part of the Strawberry Perl for Windows package.     *
 // See https://strawberryperl.com.								    *
 // Compile command:                                                                                 *
-//    gcc escom.c -o escom.exe									    *
+//    gcc escom.c escomlib.c escomsim.c -o escom.exe						    *
+// The core (serial transport, reply detection, resource dictionary, #include/#require engine) is   *
+// in the reentrant library escomlib.c, see escomlib.h.  This file is the interactive program on    *
+// top of it, it adds its extras to the engine with hooks.					    *
+// escomsim.c is a host-side Forth interpreter that can take the place of the target (#simulate).   *
 // Save the resulting executive in a directory that is in your %PATH% for easy access.		    *
+// The host benchmark in bench/bench.c includes this file with ESCOM_NO_MAIN defined.		    *
 // Written by Ed Smallenburg.                                                                       *
 // Todo:											    *
 //   - Now, targets "stm8ef" and "mecrisp" are supported.  Add other platforms.			    *
@@ -18,9 +23,30 @@
 //***************************************************************************************************
 // Command line options:									    *
 //  -t xxxx	-- Target system, "stm8ef", "mecrisp", and "zepto" are currently supported.	    *
-//  -d xxxx	-- Communication device, for example "COM5".					    *
+//  -d xxxx	-- Communication device, for example "COM5".  "auto" probes all COM ports at the    *
+//		   same time and selects the port and the target system that answer.		    *
 //  -b xxxx	-- Baudrate for communication, for example 115200.				    *
 //  -p xxxx	-- Search path for #include, #require and \res files.				    *
+//  -l xxxx	-- Log file for a timestamped log of the session.				    *
+//  -x xxxx	-- Batch mode: upload file xxxx and exit.  May be repeated.  "-x -" reads commands  *
+//		   from stdin.  The exit status is nonzero on the first error.			    *
+//  -f xxxx	-- Flow control: "none" (default), "xon" for XON/XOFF or "rts" for RTS/CTS.	    *
+//  -S		-- Server mode: keep the port and session open and serve requests from clients on   *
+//		   the named pipe \\.\pipe\escom-<port>.						    *
+//  -c xxxx	-- Client mode: send request xxxx to the server for the port and show the result.   *
+//  -T xxxx	-- Trace file: uploads are written as a timeline in Chrome trace-event format, with  *
+//		   spans for files, lines, probes and \res lines.  Open it in chrome://tracing or   *
+//		   https://ui.perfetto.dev.							    *
+//  -F xxxx	-- Footprint: report the bytes added to HERE per word and per file after each	    *
+//		   upload, and append them to history file xxxx (CSV).				    *
+//  -K xxxx	-- Keep word xxxx: leave out the colon definitions that cannot be reached from	    *
+//		   xxxx, from the words named in "#keep" lines and from the code outside	    *
+//		   definitions.  May be repeated.						    *
+//  -E		-- Echo check: every line is sent without its CR and the echo is compared byte for  *
+//		   byte.  A line with a bad echo is erased on the target and sent again.	    *
+//  -D xxxx	-- Define NAME or NAME=VALUE for conditional compilation, for example -D BOARD=neo60. *
+//		   Conditions before [IF] that use defines or dictionary symbols are evaluated by   *
+//		   escom, only the live branch is sent.  May be repeated.			    *
 // The option can also be defined in the escom.conf file in the user's home directory.		    *
 //***************************************************************************************************
 // escom reads lines from the terminal (with line editing).  Completed lines are forwarded to the   *
@@ -38,6 +64,29 @@
 // 27-12-2020  ES     Version 0.1.2,	Added mecrisp support.					    *
 // 21-12-2021  ES     Version 0.1.3,	Accept all baudrates.					    *
 // 15-05-2022  ES     Version 0.1.4,	zepto support.						    *
+// 18-10-2026  ES     Version 0.1.5,	Asynchronous session logging (-l option, #log command).	    *
+// 18-10-2026  ES     Version 0.1.6,	Headless batch mode (-x option).			    *
+// 18-10-2026  ES     Version 0.1.7,	Flow control (-f option) and streaming upload (#stream).    *
+// 18-10-2026  ES     Version 0.1.8,	Upload planner, #plan command.				    *
+// 18-10-2026  ES     Version 0.1.9,	Live variable watch, #watch command.			    *
+// 18-10-2026  ES     Version 0.1.10,	Execution time profiler, #time command.			    *
+// 18-10-2026  ES     Version 0.1.11,	Resident server mode (-S option) and client (-c option).    *
+// 18-10-2026  ES     Version 0.1.12,	Re-upload on save, #watch-files command.		    *
+// 18-10-2026  ES     Version 0.1.13,	Binary capture of target output, #capture command.	    *
+// 18-10-2026  ES     Version 0.1.14,	Memory backup and restore, #backup and #restore commands.   *
+// 18-10-2026  ES     Version 0.1.15,	Check for undefined words before upload, #check command.    *
+// 18-10-2026  ES     Version 0.1.16,	Host benchmark in bench/bench.c, ESCOM_NO_MAIN.		    *
+// 18-10-2026  ES     Version 0.1.17,	Host evaluation of [IF] [ELSE] [THEN], -D option.	    *
+// 18-10-2026  ES     Version 0.1.18,	Discovery of port and target with "-d auto".		    *
+// 18-10-2026  ES     Version 0.1.19,	Adaptive reply time-out per mode, #rtt command.		    *
+// 18-10-2026  ES     Version 0.1.20,	Core moved to the reentrant library escomlib.c.		    *
+// 18-10-2026  ES     Version 0.1.21,	Timeline trace of uploads (-T option, #trace command).	    *
+// 18-10-2026  ES     Version 0.1.22,	Footprint per word (-F option, #footprint command).	    *
+// 18-10-2026  ES     Version 0.1.23,	Leave out unused definitions (-K option, #shake command).   *
+// 18-10-2026  ES     Version 0.1.24,	Regression tests with expected output, #test command.	    *
+// 18-10-2026  ES     Version 0.1.25,	Echo check with retransmit (-E option, #verify command).    *
+// 18-10-2026  ES     Version 0.1.26,	Console during uploads, #pause, #resume and #abort.	    *
+// 18-10-2026  ES     Version 0.1.27,	Host-side simulation of uploads, #simulate command.	    *
 //***************************************************************************************************
 #include <stdio.h>	// Console I/O
 #include <stdlib.h>	// Standard library definitions
@@ -45,19 +94,212 @@
 #include <unistd.h>	// UNIX standard function definitions
 #include <fcntl.h>	// File control definitions
 #include <errno.h>	// Error number definitions
+#include <io.h>		// Low level file handles
 #include <windows.h>	// Windows specifics
+#include "escomlib.h"	// Core of escom
 
 // Constants:
-#define VERSION "0.1.4"					// The version number
+#define VERSION "0.1.27"				// The version number
+#define TIBLEN  80					// Max length of a line for the target (stm8ef TIB)
+#define OPTIONS "d:b:t:p:l:x:f:Sc:D:T:F:K:E"		// Options allowed, for getopt
 // Some textcolors
 #define GREEN   ( FOREGROUND_GREEN | FOREGROUND_INTENSITY )
 #define YELLOW  ( FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY )
 #define RED     ( FOREGROUND_RED | FOREGROUND_INTENSITY )
+// Session logging
+#define LOGQSIZE   2048					// Entries in log queue, must be a power of 2
+#define LOGTXTLEN  256					// Max length of text in log entry
+#define LOGBUFSIZE 65536				// Size of output buffer of log writer
+#define LOGMAXSIZE ( 4 * 1024 * 1024 )			// Rotate log file at this size
+#define LOGMAXSRC  64					// Max number of source names in log
+#define MAXBATCH   32					// Max number of -x options
+// Streaming upload
+#define STREAMWIN  64					// Max number of unacknowledged lines
+#define STREAMIDLE 40					// Give up after 40 * 50 msec without reply
+// Upload planner
+#define MAXPLAN    256					// Max number of files in upload plan
+#define MAXDEPTH   32					// Max nesting of #include/#require
+#define LINEMSEC   10					// Estimated processing time per line in msec
+// Live watch
+#define MAXWATCH   16					// Max number of watched symbols
+// Profiler
+#define TIMERUNS   5					// Number of measurements for #time
+#define TIMEMAXMS  60000				// Max time for one measurement in msec
+// Regression tests
+#define TESTMARK   "\\>"				// Expected output follows in a test line
+#define TESTLINE   80					// Max length of a batch of tests sent as one line
+#define TESTBATCH  16					// Max number of tests in a batch
+#define TESTMAXMS  5000					// Time-out for the reply to a line of tests
+// Server mode
+#define MAXCLIENTS 16					// Max number of attached stream clients
+#define PIPEWAIT   1000					// Max time in msec for a write to a client
+#define MAXKNOWN   256					// Max number of words in known-word cache
+// Watch files
+#define WFDEBOUNCE 20					// Quiet time after a change in msec
+// Capture
+#define CAPBUFSIZE 65536				// Size of receive buffer for capture
+#define CAPIDLE    3000					// Stop capture after 3 sec without data
+// Backup and restore
+#define BCHUNK     64					// Bytes per chunk read from the target
+#define RCHUNK     8					// Bytes per chunk written, line fits in TIBLEN
+#define BRETRY     3					// Max number of retransmits per chunk
+// Check for undefined words
+#define WORDHASH   8192					// Size of hash table of word set, power of 2
+#define WORDSBUF   65536				// Size of buffer for reply to WORDS
+#define CHKMAXERR  20					// Max number of undefined words reported
+// Conditional compilation
+#define MAXDEFINE  32					// Max number of -D options
+#define MAXCOND    16					// Max nesting of [IF] in a file
+#define COND_TARGET 0					// [IF] evaluated by the target
+#define COND_LIVE   1					// [IF] evaluated here, branch is sent
+#define COND_DEAD   2					// [IF] evaluated here, branch is skipped
+#define COND_SEND   0					// Result of cond_line: send the line
+#define COND_DIRECTIVE 1				// Directive handled here, do not send
+#define COND_SKIP   2					// Line in dead branch, do not send
+// Discovery
+#define MAXPROBE   MAXIMUM_WAIT_OBJECTS			// Max number of ports probed
+#define PROBEMS    500					// Time-out for the reply to a probe
+// Adaptive reply time-out
+#define RTTLEARN   3					// Samples before the estimate is used
+#define RTTDEFRAM  600					// Time-out in msec while learning, RAM mode
+#define RTTDEFNVM  2000					// Time-out in msec while learning, flash mode
+#define RTTMARGIN  20					// Extra msec for USB latency and timer resolution
+#define RTTMAX     10000				// Max time-out in msec
+// Echo check
+#define VERIFYTRY  4					// Max number of transmissions of a line
+#define VERIFYMS   50					// Extra msec to wait for the echo
+#define VERIFYQUIET 20					// Msec without input after erasing a line
+// Trace
+#define TRACENAME  80					// Max length of the name of a trace event
+// Footprint
+#define MAXFOOT    1024					// Max number of words in footprint
+#define FOOTTOP    20					// Number of words shown in report
+#define FOOTPEND   8					// Max number of names between two samples
+#define FOOTPRE    "HERE U. "				// Sample in front of a line
+#define FOOTPOST   " HERE U."				// Sample at the end of a line
+// Tree shaking
+#define MAXSHAKE   2048					// Max number of colon definitions in a plan
+#define SHAKEPOOL  65536				// Size of pool for words referenced by definitions
 
-struct dict_t						// Dictionary entry
+struct define_t						// Define from -D option
 {
-  char symbol[20] ;					// Symbolic name
-  WORD value ;						// Value
+  char name[32] ;					// Name of define
+  char value[64] ;					// Value, "-1" if none given
+} ;
+
+struct cond_t						// State of conditional compilation in a file
+{
+  int  depth ;						// Nesting of [IF]
+  BYTE state[MAXCOND] ;					// COND_TARGET, COND_LIVE or COND_DEAD per level
+  int  skip ;						// Nesting of [IF] inside a dead branch
+} ;
+
+struct upl_file_t					// File being uploaded, state of the include hooks
+{
+  const char*   savefile ;				// Source of the includer, for log
+  int           saveline ;				// Line number in the includer
+  struct cond_t cond ;					// Conditional compilation state
+  int           margin ;				// Margin for modified line
+  LONGLONG      t0 ;					// Start of file, for trace
+  int           lines0 ;				// Statistics at start, for trace
+  int           bytes0 ;
+} ;
+
+struct probe_t						// Probe of a port for discovery
+{
+  char   port[16] ;					// Port name like "COM5"
+  char   target[16] ;					// Target found, empty if none
+  HANDLE thread ;					// Thread that probes the port
+} ;
+
+struct rtt_t						// Reply time estimate for a mode
+{
+  int srtt ;						// Smoothed reply time in usec, without transmission
+  int rttvar ;						// Smoothed mean deviation in usec
+  int samples ;						// Number of measurements
+  int timeouts ;					// Number of lines without complete reply
+} ;
+
+struct foot_t						// Footprint of a word
+{
+  char word[32] ;					// Name of the word
+  char file[32] ;					// File without directory
+  BOOL flash ;						// Compiled to flash
+  int  bytes ;						// Growth of HERE
+} ;
+
+struct stream_t						// Line in flight in streaming upload
+{
+  char file[128] ;					// Source file of the line
+  int  line ;						// Line number in source file
+  BOOL compiling ;					// Target compiling after the line, no "ok"
+} ;
+
+struct plan_t						// File in upload plan
+{
+  char file[128] ;					// Full filespec
+  char word[32] ;					// Filename as word, for #require
+  int  depth ;						// Nesting level
+  BOOL conditional ;					// Included by #require
+  int  lines ;						// Number of lines to send
+  int  bytes ;						// Number of bytes to send
+  int  skipped ;					// Number of lines left out by [IF]
+} ;
+
+struct shake_t						// Colon definition, for tree shaking
+{
+  char name[64] ;					// Name of the word, like a token
+  int  file ;						// Index of the file in plan
+  int  first ;						// Line with ":"
+  int  last ;						// Line with ";", 0 if not found
+  int  ref ;						// Start of referenced words in shk_pool
+  BOOL alone ;						// Lines contain nothing else, may be left out
+  BOOL lookup ;						// Looks up words by name at run time
+  BOOL keep ;						// Reachable, must be sent
+} ;
+
+struct test_t						// Test line from a test file
+{
+  int  line ;						// Line number in test file
+  char code[TESTLINE] ;					// Forth code of the test
+  char expect[128] ;					// Expected output, whitespace normalized
+} ;
+
+struct teststat_t					// Results of a test run
+{
+  const char* file ;					// Test file
+  FILE*       csv ;					// CSV file for results, NULL if none
+  int         tests ;					// Number of tests run
+  int         passed ;					// Number of tests passed
+  int         sent ;					// Number of lines sent
+  int         slowline ;				// Line of the slowest test
+  LONGLONG    slowusec ;				// Time of the slowest test
+} ;
+
+struct watch_t						// Watched symbol
+{
+  char name[20] ;					// Symbol as given by the user
+  int  bits ;						// Width: 8, 16 or 32
+  unsigned long value ;					// Last value, U. output is unsigned
+  unsigned long min ;					// Lowest value seen
+  unsigned long max ;					// Highest value seen
+  double rate ;						// Smoothed rate of change per second
+} ;
+
+struct wordset_t					// Set of words, case as the target, see chk_case
+{
+  char* w[WORDHASH] ;					// Hash table, open addressing
+  int   n ;						// Number of words in set
+} ;
+
+struct logent_t						// Entry in log queue
+{
+  LONGLONG usec ;					// Timestamp in microseconds
+  char     kind ;					// '>' sent, '<' received, '#' directive, '!' error
+  BYTE     src ;					// Index of source name in logsrc[]
+  int      line ;					// Line number in source file
+  int      len ;					// Number of bytes in text
+  char     text[LOGTXTLEN] ;				// Logged data
 } ;
 
 // Global variables
@@ -67,12 +309,127 @@ int           baudrate = 9600 ;				// Default baudrate for communication
 char          path[128] = ".;./mcu;./lib" ;		// Default search path for #i and #r	
 HANDLE        hConsoleOut ;				// Handle for console output
 HANDLE        hConsoleIn ;				// Handle for console input
-HANDLE        hcom ;					// Handle for serial I/O
-char*         ( *ok_chk ) ( char* buf ) ;		// Check reply string from target
+struct esc_session ses ;				// Session with the target: port, dictionary
 int           tokc ;					// Number of tokens in tokv
 char*         tokv[32] ;				// Tokens in config file
-struct dict_t dictionary[1000] ;			// Escom dictionary
-int           dinx = 0 ;				// Number of entries in dictionary
+char          logfile[128] = "" ;			// Log file for session, empty if none
+struct logent_t logq[LOGQSIZE] ;			// Log queue, single producer, single consumer
+volatile LONG logq_head = 0 ;				// Next entry to fill by producer
+volatile LONG logq_tail = 0 ;				// Next entry to drain by writer thread
+volatile LONG log_active = FALSE ;			// Logging is active
+LONG          log_lost = 0 ;				// Number of entries lost (queue full)
+HANDLE        hLogThread = NULL ;			// Handle of log writer thread
+HANDLE        hLogStop = NULL ;				// Event to stop log writer thread
+LONGLONG      log_t0 ;					// Time in microseconds at start of logging
+FILETIME      log_ft0 ;					// Wall clock time at start of logging
+char*         logsrc[LOGMAXSRC] ;			// Source names for log, [0] is console
+int           logsrcc = 0 ;				// Number of names in logsrc
+const char*   srcfile = NULL ;				// Source file being uploaded, NULL for console
+int           srcline = 0 ;				// Line number in srcfile
+const char*   batchv[MAXBATCH] ;			// Files (or "-" for stdin) for batch mode
+int           batchc = 0 ;				// Number of entries in batchv, 0 is interactive
+BOOL          headless = FALSE ;			// No console: batch, server or client mode
+struct upl_file_t upl_file[MAXDEPTH] ;			// Files being uploaded, innermost last
+int           upl_depth = 0 ;				// Number of entries in upl_file
+char          flowctl[8] = "none" ;			// Flow control: "none", "xon" or "rts"
+BOOL          streaming = FALSE ;			// Upload without waiting for replies
+struct stream_t strwin[STREAMWIN] ;			// Lines in flight during streaming upload
+int           str_sent = 0 ;				// Number of lines sent in streaming upload
+int           str_done = 0 ;				// Number of lines acknowledged by the target
+char          str_part[256] ;				// Partial reply line during streaming upload
+int           str_plen = 0 ;				// Length of str_part
+struct plan_t plan[MAXPLAN] ;				// Upload plan, in upload order
+int           planc = 0 ;				// Number of files in plan
+int           planstack[MAXDEPTH] ;			// Files being planned, for cycle detection
+int           plandepth = 0 ;				// Number of entries in planstack
+const char*   tick_word = NULL ;			// Target word for tick counter, NULL if none
+int           tick_us = 0 ;				// Microseconds per tick of tick_word
+const char*   store_word = "C!" ;			// Target word to store a byte in flash
+const char*   store_pre = NULL ;			// Line to unlock flash before restore
+const char*   store_post = NULL ;			// Line to lock flash after restore
+BOOL          store_erased = FALSE ;			// Store only works on erased flash
+BOOL          server = FALSE ;				// Server mode
+const char*   client_req = NULL ;			// Request for client mode
+char          pipename[64] ;				// Name of pipe of server
+CRITICAL_SECTION com_lock ;				// Serializes use of the serial port in server
+CRITICAL_SECTION srv_lock ;				// Protects the client lists
+HANDLE        srv_clients[MAXCLIENTS] ;			// Clients attached to the console stream
+int           srv_clientc = 0 ;				// Number of attached clients
+HANDLE        srv_owner = NULL ;			// Client that issued the running request
+HANDLE        tee_rd ;					// Read side of captured stdout
+CRITICAL_SECTION tee_lock ;				// Held by the tee thread while forwarding
+int           srv_requests = 0 ;			// Number of requests served
+char          known[MAXKNOWN][32] ;			// Words known to exist on the target
+int           knownc = 0 ;				// Number of words in known
+char          lastupl[128] = "" ;			// File of the last upload
+BOOL          wf_active = FALSE ;			// Watching files of last upload
+char          wf_file[MAXPLAN][128] ;			// Watched files
+FILETIME      wf_time[MAXPLAN] ;			// Last write time of watched files
+int           wf_filec = 0 ;				// Number of watched files
+HANDLE        wf_dir[MAXIMUM_WAIT_OBJECTS] ;		// Change notifications for directories
+int           wf_dirc = 0 ;				// Number of directories watched
+DWORD         wf_changed = 0 ;				// Time of last change, 0 if none pending
+BOOL          chk_on = TRUE ;				// Check for undefined words before upload
+BOOL          chk_active = FALSE ;			// Check is running in plan_file()
+BOOL          chk_loaded = FALSE ;			// Target words are in wbuiltin
+BOOL          chk_case = FALSE ;			// Words of the target are case sensitive
+struct wordset_t wbuiltin ;				// Words on the target, for the session
+struct wordset_t wdefined ;				// Words defined by the files being checked
+struct wordset_t wdefiner ;				// Defining words, the next token is a new name
+int           chk_errors = 0 ;				// Number of undefined words found
+BOOL          chk_paren = FALSE ;			// Inside a ( comment
+char          chk_next[16] = "" ;			// Word that takes the next token as name
+BOOL          chk_creates = FALSE ;			// Colon definition contains a defining word
+char          chk_colon[32] = "" ;			// Name of the colon definition being checked
+int           chk_base = 10 ;				// Number base in checked source
+struct define_t defines[MAXDEFINE] ;			// Defines from -D options
+struct rtt_t  rtt[2] ;					// Reply time estimates, [0] RAM, [1] flash
+char          tracefile[128] = "" ;			// Trace file, empty if none
+FILE*         trace_fp = NULL ;				// Open trace file
+LONGLONG      trace_t0 ;				// Time in microseconds at start of trace
+int           trace_events = 0 ;			// Number of events in trace file
+BOOL          fp_on = FALSE ;				// Footprint accounting during upload
+char          fpfile[128] = "" ;			// History file for footprint, empty if none
+struct foot_t foot[MAXFOOT] ;				// Footprint per word of the last upload
+int           footc = 0 ;				// Number of entries in foot
+long          fp_here = -1 ;				// Last sample of HERE, -1 if not known
+BOOL          fp_here_nvm ;				// Mode of the last sample
+BOOL          fp_colon = FALSE ;			// Inside a colon definition
+BOOL          fp_paren = FALSE ;			// Inside a ( comment
+int           fp_base = 10 ;				// Number base after the line
+int           fp_base0 ;				// Number base before the line
+BOOL          fp_nvm ;					// Mode before the line
+BOOL          fp_prefix ;				// Line has a sample in front
+BOOL          fp_suffix ;				// Line has a sample at the end
+char          fp_pend[FOOTPEND][64] ;			// Words defined since the last sample
+int           fp_pendc = 0 ;				// Number of entries in fp_pend
+const char*   fp_src = "" ;				// File of the line
+char          job_pend[256] = "" ;			// Line typed during upload, not sent yet
+BOOL          job_paused = FALSE ;			// Upload paused by #pause
+BOOL          job_abort = FALSE ;			// Upload to be stopped by #abort
+BOOL          ver_on = FALSE ;				// Check the echo of each line before its CR
+const char*   erase_char = "\b" ;			// Erases one character of the input of the target
+int           ver_lines = 0 ;				// Number of lines checked
+int           ver_retries = 0 ;				// Number of lines sent again
+int           ver_failed = 0 ;				// Number of lines given up
+struct esc_sim* sim = NULL ;				// Simulated target, allocated by #simulate
+BOOL          other_nvm = FALSE ;			// Flash mode of target or simulator not connected
+BOOL          other_compiling = FALSE ;			// Compile state of target or simulator not connected
+BOOL          shk_on = FALSE ;				// Leave out unused colon definitions
+char          shk_entry[256] = "" ;			// Entry words for tree shaking
+struct shake_t shk[MAXSHAKE] ;				// Colon definitions in the upload plan
+int           shkc = 0 ;				// Number of entries in shk
+char          shk_pool[SHAKEPOOL] ;			// Words referenced by the definitions
+int           shk_poolc = 0 ;				// Bytes used in shk_pool
+struct wordset_t wreach ;				// Words reachable from the entry words
+int           shk_def = -1 ;				// Definition being scanned, -1 if none
+BOOL          shk_name = FALSE ;			// Next token is the name of a definition
+BOOL          shk_alone = FALSE ;			// ":" was the first token of its line
+BOOL          shk_paren = FALSE ;			// Inside a ( comment
+char          shk_unsafe[128] = "" ;			// Reason to send everything, empty if none
+int           shk_dropped = 0 ;				// Number of definitions left out
+int           shk_lines = 0 ;				// Number of lines left out
+int           definec = 0 ;				// Number of defines
 
 //***************************************************************************************************
 //					C L E A R _ S C R E E N					    *
@@ -118,6 +475,10 @@ void clear_screen()
 //***************************************************************************************************
 void text_attr ( WORD attr )
 {
+  if ( headless )					// Batch or server mode?
+  {
+    return ;						// Yes, output is not a console
+  }
   if ( attr == 0 )					// 0 is normal text
   {
     attr = FOREGROUND_BLUE | FOREGROUND_RED |		// For white text
@@ -127,6 +488,354 @@ void text_attr ( WORD attr )
 }
 
 
+//***************************************************************************************************
+//					U S E C _ N O W						    *
+//***************************************************************************************************
+// Return a timestamp in microseconds from the performance counter.				    *
+//***************************************************************************************************
+LONGLONG usec_now()
+{
+  static LARGE_INTEGER freq = { 0 } ;			// Frequency of performance counter
+  LARGE_INTEGER        now ;				// Current performance counter
+
+  if ( freq.QuadPart == 0 )				// First call?
+  {
+    QueryPerformanceFrequency ( &freq ) ;		// Yes, get frequency
+  }
+  QueryPerformanceCounter ( &now ) ;
+  return ( now.QuadPart / freq.QuadPart ) * 1000000 +	// Convert to microseconds
+         ( now.QuadPart % freq.QuadPart ) * 1000000 / freq.QuadPart ;
+}
+
+
+//***************************************************************************************************
+//					L O G _ P U T						    *
+//***************************************************************************************************
+// Put an entry in the log queue.  Called from the I/O path, so it only copies the data and never   *
+// blocks.  If the queue is full, the entry is dropped and counted.				    *
+// The source file and line (srcfile/srcline) of the data are added to the entry.		    *
+//***************************************************************************************************
+void log_put ( char kind, const char* buf, int len )
+{
+  struct logent_t* e ;					// Entry to fill
+  LONG             head ;				// Copy of head index
+  LONG             next ;				// Next head index
+  int              i ;					// Index in logsrc
+
+  if ( ! log_active )					// Logging active?
+  {
+    return ;						// No, quick return
+  }
+  head = logq_head ;					// Only this thread writes head
+  next = ( head + 1 ) & ( LOGQSIZE - 1 ) ;		// Next entry
+  if ( next == logq_tail )				// Queue full?
+  {
+    log_lost++ ;					// Yes, count lost entries
+    return ;
+  }
+  e = &logq[head] ;					// Entry to fill
+  e->usec = usec_now() - log_t0 ;			// Get timestamp
+  e->kind = kind ;
+  e->src = 0 ;						// Assume console
+  if ( srcfile )					// Data from a source file?
+  {
+    for ( i = 1 ; i < logsrcc ; i++ )			// Yes, search name of source
+    {
+      if ( strcmp ( logsrc[i], srcfile ) == 0 )
+      {
+        break ;
+      }
+    }
+    if ( i == logsrcc && i < LOGMAXSRC )		// New source name?
+    {
+      logsrc[i] = strdup ( srcfile ) ;			// Yes, add to list
+      logsrcc++ ;
+    }
+    if ( i < logsrcc )					// Name in list?
+    {
+      e->src = i ;					// Yes, set index
+    }
+  }
+  e->line = srcline ;					// Line number in source file
+  if ( len > LOGTXTLEN )				// Limit length
+  {
+    len = LOGTXTLEN ;
+  }
+  memcpy ( e->text, buf, len ) ;			// Copy data
+  e->len = len ;
+  MemoryBarrier() ;					// Entry must be complete before publishing
+  logq_head = next ;					// Publish entry
+}
+
+
+//***************************************************************************************************
+//				L O G _ F O R M A T						    *
+//***************************************************************************************************
+// Format a log entry to a line of text in buf.  Control characters are shown as escapes.	    *
+// Returns the length of the formatted line.							    *
+//***************************************************************************************************
+int log_format ( struct logent_t* e, char* buf )
+{
+  ULONGLONG  t ;					// Time in 100 nsec units since 1601
+  FILETIME   ft ;					// Timestamp as FILETIME
+  SYSTEMTIME st ;					// Timestamp in parts
+  char*      p = buf ;					// Fill pointer
+  int        i ;					// Index in text
+  BYTE       c ;					// Character from text
+
+  t = ( (ULONGLONG)log_ft0.dwHighDateTime << 32 ) |	// Start time
+      log_ft0.dwLowDateTime ;
+  t += e->usec * 10 ;					// Add elapsed time
+  ft.dwLowDateTime = (DWORD)t ;
+  ft.dwHighDateTime = (DWORD)( t >> 32 ) ;
+  FileTimeToSystemTime ( &ft, &st ) ;			// Split in parts (UTC)
+  p += sprintf ( p, "%04d-%02d-%02d %02d:%02d:%02d.%06d %c ",
+                 st.wYear, st.wMonth, st.wDay,
+                 st.wHour, st.wMinute, st.wSecond,
+                 (int)( ( t / 10 ) % 1000000 ), e->kind ) ;	// Fraction of the same time
+  if ( e->src )						// Data from source file?
+  {
+    p += sprintf ( p, "%s:%d ", logsrc[e->src],		// Yes, show file and line
+                   e->line ) ;
+  }
+  for ( i = 0 ; i < e->len ; i++ )			// Copy text, escape control chars
+  {
+    c = e->text[i] ;
+    if ( c == '\r' )
+    {
+      p += sprintf ( p, "\\r" ) ;
+    }
+    else if ( c == '\n' )
+    {
+      p += sprintf ( p, "\\n" ) ;
+    }
+    else if ( c < ' ' || c >= 0x7F )
+    {
+      p += sprintf ( p, "\\x%02X", c ) ;
+    }
+    else
+    {
+      *p++ = c ;
+    }
+  }
+  *p++ = '\n' ;
+  return p - buf ;
+}
+
+
+//***************************************************************************************************
+//				L O G _ W R I T E R						    *
+//***************************************************************************************************
+// Thread that drains the log queue into the log file.  Output is collected in a large buffer and   *
+// written in one action.  The file is rotated (renamed to <logfile>.1) if it grows too large.	    *
+//***************************************************************************************************
+DWORD WINAPI log_writer ( LPVOID param )
+{
+  static char outbuf[LOGBUFSIZE] ;			// Output buffer
+  int         outlen = 0 ;				// Bytes in output buffer
+  FILE*       fp ;					// Log file
+  long        fsize ;					// Size of log file
+  char        oldname[sizeof(logfile) + 2] ;		// Name of rotated log file
+  BOOL        stop = FALSE ;				// Stop request seen
+  LONG        tail ;					// Copy of tail index
+
+  fp = fopen ( logfile, "ab" ) ;			// Open for append
+  if ( fp == NULL )
+  {
+    return 1 ;
+  }
+  fseek ( fp, 0, SEEK_END ) ;
+  fsize = ftell ( fp ) ;				// Current size of file
+  while ( TRUE )
+  {
+    stop = ( WaitForSingleObject ( hLogStop, 20 )	// Wait for stop or time-out
+             == WAIT_OBJECT_0 ) ;
+    tail = logq_tail ;					// Only this thread writes tail
+    while ( tail != logq_head )				// Drain queue
+    {
+      MemoryBarrier() ;					// Read entry after seeing head
+      if ( outlen > LOGBUFSIZE - 6 * LOGTXTLEN )	// Room for the worst case?
+      {
+        fsize += fwrite ( outbuf, 1, outlen, fp ) ;	// No, flush buffer
+        outlen = 0 ;
+      }
+      outlen += log_format ( &logq[tail], outbuf + outlen ) ;
+      tail = ( tail + 1 ) & ( LOGQSIZE - 1 ) ;
+      logq_tail = tail ;				// Entry free for producer
+    }
+    if ( outlen )					// Anything to write?
+    {
+      fsize += fwrite ( outbuf, 1, outlen, fp ) ;	// Yes, write the buffer
+      outlen = 0 ;
+      fflush ( fp ) ;
+    }
+    if ( fsize > LOGMAXSIZE )				// Time to rotate?
+    {
+      fclose ( fp ) ;					// Yes, close current file
+      sprintf ( oldname, "%s.1", logfile ) ;		// Name of old file
+      MoveFileEx ( logfile, oldname,			// Rename, replace old one
+                   MOVEFILE_REPLACE_EXISTING ) ;
+      fp = fopen ( logfile, "ab" ) ;			// Start new file
+      if ( fp == NULL )
+      {
+        return 1 ;
+      }
+      fsize = 0 ;
+    }
+    if ( stop )						// Stop requested?
+    {
+      break ;						// Yes, queue is empty now
+    }
+  }
+  if ( log_lost )					// Entries lost?
+  {
+    fprintf ( fp, "%ld log entries lost\n", log_lost ) ;
+  }
+  fclose ( fp ) ;
+  return 0 ;
+}
+
+
+//***************************************************************************************************
+//				L O G _ S T O P							    *
+//***************************************************************************************************
+// Stop logging.  The writer thread will drain the queue before it terminates.			    *
+//***************************************************************************************************
+void log_stop()
+{
+  if ( ! log_active )					// Logging active?
+  {
+    return ;						// No, nothing to stop
+  }
+  log_active = FALSE ;					// No more new entries
+  SetEvent ( hLogStop ) ;				// Signal writer thread
+  WaitForSingleObject ( hLogThread, INFINITE ) ;	// Wait until queue is drained
+  CloseHandle ( hLogThread ) ;
+  CloseHandle ( hLogStop ) ;
+  hLogThread = NULL ;
+}
+
+
+//***************************************************************************************************
+//				L O G _ S T A R T						    *
+//***************************************************************************************************
+// Start logging to the file in logfile.  Creates the writer thread.				    *
+//***************************************************************************************************
+BOOL log_start()
+{
+  FILE* fp ;						// To test the log file
+
+  log_stop() ;						// Stop current log, if any
+  fp = fopen ( logfile, "ab" ) ;			// Check if file can be written
+  if ( fp == NULL )
+  {
+    return FALSE ;
+  }
+  fclose ( fp ) ;
+  if ( logsrcc == 0 )					// First time?
+  {
+    logsrc[logsrcc++] = "console" ;			// Yes, entry 0 is for console input
+  }
+  logq_head = logq_tail = 0 ;				// Queue is empty
+  log_lost = 0 ;
+  log_t0 = usec_now() ;					// Set timebase
+  GetSystemTimeAsFileTime ( &log_ft0 ) ;
+  hLogStop = CreateEvent ( NULL, TRUE, FALSE, NULL ) ;	// Manual reset event
+  hLogThread = CreateThread ( NULL, 0, log_writer,	// Start writer thread
+                              NULL, 0, NULL ) ;
+  if ( hLogThread == NULL )
+  {
+    CloseHandle ( hLogStop ) ;
+    return FALSE ;
+  }
+  log_active = TRUE ;
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//				T R A C E _ S T O P						    *
+//***************************************************************************************************
+// Close the trace file.									    *
+//***************************************************************************************************
+void trace_stop()
+{
+  if ( trace_fp )
+  {
+    fputs ( "\n]\n", trace_fp ) ;			// End of event array
+    fclose ( trace_fp ) ;
+    trace_fp = NULL ;
+  }
+}
+
+
+//***************************************************************************************************
+//				T R A C E _ S T A R T						    *
+//***************************************************************************************************
+// Start a trace in tracefile.  The file is a JSON array of trace events.  The closing "]" is	    *
+// optional for the viewers, so the file can be used even if escom is killed.			    *
+//***************************************************************************************************
+BOOL trace_start()
+{
+  static BOOL registered = FALSE ;			// trace_stop() registered for exit
+
+  trace_stop() ;					// Stop current trace, if any
+  if ( ( trace_fp = fopen ( tracefile, "w" ) ) == NULL )
+  {
+    return FALSE ;
+  }
+  if ( ! registered )					// Close the file at exit
+  {
+    atexit ( trace_stop ) ;
+    registered = TRUE ;
+  }
+  trace_t0 = usec_now() ;				// Set timebase
+  fprintf ( trace_fp, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+                      "\"args\":{\"name\":\"escom %s %s\"}}", device, target ) ;
+  trace_events = 1 ;
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//				T R A C E _ E V E N T						    *
+//***************************************************************************************************
+// Write a complete event to the trace: category, name, start time and the time up to now.	    *
+// The format and the rest of the parameters give the arguments as JSON members, for example	    *
+// "\"bytes\":%d".  The name is escaped for JSON, control characters are left out.		    *
+//***************************************************************************************************
+void trace_event ( const char* cat, const char* name, LONGLONG t0, const char* format, ... )
+{
+  va_list varArgs ;					// For variable number of params
+  int     i ;						// Index in name
+
+  if ( trace_fp == NULL )				// Tracing?
+  {
+    return ;						// No, skip
+  }
+  fputs ( ",\n{\"name\":\"", trace_fp ) ;
+  for ( i = 0 ; name[i] && i < TRACENAME ; i++ )
+  {
+    if ( name[i] == '"' || name[i] == '\\' )		// Escape quotes and backslashes
+    {
+      fputc ( '\\', trace_fp ) ;
+    }
+    if ( (BYTE)name[i] >= ' ' )				// Leave out CR and other control chars
+    {
+      fputc ( name[i], trace_fp ) ;
+    }
+  }
+  fprintf ( trace_fp, "\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.0f,\"dur\":%.0f,"
+                      "\"pid\":1,\"tid\":1,\"args\":{",
+            cat, (double)( t0 - trace_t0 ), (double)( usec_now() - t0 ) ) ;
+  va_start ( varArgs, format ) ;
+  vfprintf ( trace_fp, format, varArgs ) ;
+  va_end ( varArgs ) ;
+  fputs ( "}}", trace_fp ) ;
+  trace_events++ ;
+}
+
+
 //***************************************************************************************************
 //				U S E R _ E R R O R						    *
 //***************************************************************************************************
@@ -134,18 +843,55 @@ void text_attr ( WORD attr )
 //***************************************************************************************************
 void user_error ( const char* format, ... )
 {
-  static char sbuf[64] ;				// For text with error
+  char        sbuf[256] ;				// For text with error
   va_list     varArgs ; 				// For variable number of params
 
   va_start ( varArgs, format ) ;			// Prepare parameters
   vsnprintf ( sbuf, sizeof(sbuf), format, varArgs ) ;	// Format the message
   va_end ( varArgs ) ;					// End of using parameters
+  log_put ( '!', sbuf, strlen ( sbuf ) ) ;		// Errors go to the log too
   text_attr ( RED ) ;					// Print error in red
   printf ( "%s!\n", sbuf ) ;				// Show error
   text_attr ( 0 ) ;					// Back to normal colors
 }
 
 
+//***************************************************************************************************
+//				S E S _ O U T P U T						    *
+//***************************************************************************************************
+// Output callback of the session.  Traffic goes to the log, errors to user_error().		    *
+//***************************************************************************************************
+void ses_output ( void* ctx, int kind, const char* p, int len )
+{
+  switch ( kind )
+  {
+    case ESC_SENT :
+      log_put ( '>', p, len ) ;				// Log sent data
+      break ;
+    case ESC_RECEIVED :
+      log_put ( '<', p, len ) ;				// Log received data
+      break ;
+    case ESC_ERROR :
+      user_error ( "%.*s", len, p ) ;			// Show and log error
+      break ;
+    case ESC_SOURCE :
+      log_put ( '#', p, len ) ;				// Local directive or comment
+      text_attr ( YELLOW ) ;
+      printf ( "%.*s\n", len, p ) ;
+      text_attr ( 0 ) ;
+      break ;
+    case ESC_INFO :
+      text_attr ( YELLOW ) ;
+      printf ( "%.*s\n", len, p ) ;
+      text_attr ( 0 ) ;
+      break ;
+    default :						// Reply of the target
+      fwrite ( p, 1, len, stdout ) ;
+      break ;
+  }
+}
+
+
 //***************************************************************************************************
 //			T O K E N I Z E _ C O N F _ F I L E					    *
 //***************************************************************************************************
@@ -194,7 +940,43 @@ void tokenize_conf_file()
     }
   }
   fclose ( fp ) ;					// Close input file
-  printf ( "\n" ) ;					// Extra newline
+}
+
+
+//***************************************************************************************************
+//					A D D _ D E F I N E					    *
+//***************************************************************************************************
+// Add a define from a -D option: "NAME" or "NAME=VALUE".  A define without value is true (-1).    *
+// An existing define with the same name gets the new value.					    *
+//***************************************************************************************************
+void add_define ( const char* def )
+{
+  char        name[32] ;				// Name part of def
+  const char* value ;					// Value part of def
+  int         i ;					// Index in defines
+
+  value = strchr ( def, '=' ) ;				// Find value
+  snprintf ( name, sizeof(name), "%.*s",
+             value ? (int)( value - def ) : (int)strlen ( def ), def ) ;
+  value = value ? value + 1 : "-1" ;
+  for ( i = 0 ; i < definec ; i++ )			// Existing define?
+  {
+    if ( strcasecmp ( defines[i].name, name ) == 0 )
+    {
+      break ;
+    }
+  }
+  if ( i == MAXDEFINE )					// Room for new one?
+  {
+    user_error ( "Too many defines" ) ;
+    return ;
+  }
+  if ( i == definec )					// New define?
+  {
+    definec++ ;
+  }
+  strcpy ( defines[i].name, name ) ;
+  strncpy ( defines[i].value, value, sizeof(defines[i].value) - 1 ) ;
 }
 
 
@@ -206,7 +988,6 @@ void tokenize_conf_file()
 //***************************************************************************************************
 void parse_options ( int argc, char* argv[] )
 {
-  const char* opts = "d:b:t:p:" ;				// Options allowed
   int         optchar ;						// Option found
   int         baudrates[] = { CBR_9600,   CBR_14400,		// Allowed baudrates
                               CBR_19200,  CBR_38400,
@@ -215,7 +996,7 @@ void parse_options ( int argc, char* argv[] )
                               CBR_256000 } ;
 
   optind = 1 ;							// Start with first option
-  while ( ( optchar = getopt ( argc, argv, opts ) ) != -1 )	// Get next option
+  while ( ( optchar = getopt ( argc, argv, OPTIONS ) ) != -1 )	// Get next option
   {
     switch ( optchar )
     {
@@ -246,103 +1027,83 @@ void parse_options ( int argc, char* argv[] )
       case 'p' :						// Search pathg?
         strncpy ( path, optarg, sizeof(path) - 1 ) ;		// Yes, set search path
         break ;
+      case 'l' :						// Log file?
+        strncpy ( logfile, optarg, sizeof(logfile) - 1 ) ;	// Yes, set log file
+        break ;
+      case 'F' :						// Footprint?
+        strncpy ( fpfile, optarg, sizeof(fpfile) - 1 ) ;	// Yes, set history file
+        fp_on = TRUE ;
+        break ;
+      case 'K' :					// Keep word?
+        if ( *shk_entry )				// Yes, add to entry words
+        {
+          strncat ( shk_entry, " ", sizeof(shk_entry) - strlen ( shk_entry ) - 1 ) ;
+        }
+        strncat ( shk_entry, optarg, sizeof(shk_entry) - strlen ( shk_entry ) - 1 ) ;
+        shk_on = TRUE ;
+        break ;
+      case 'E' :					// Echo check?
+        ver_on = TRUE ;					// Yes, set it
+        break ;
+      case 'T' :						// Trace file?
+        strncpy ( tracefile, optarg, sizeof(tracefile) - 1 ) ;	// Yes, set trace file
+        break ;
+      case 'f' :						// Flow control?
+        if ( strcasecmp ( optarg, "none" ) &&			// Yes, check value
+             strcasecmp ( optarg, "xon" ) &&
+             strcasecmp ( optarg, "rts" ) )
+        {
+          user_error ( "Unknown flow control %s", optarg ) ;
+          break ;
+        }
+        strncpy ( flowctl, optarg, sizeof(flowctl) - 1 ) ;	// Set flow control
+        break ;
+      case 'x' :						// Batch upload?
+        if ( batchc < MAXBATCH )				// Yes, room for another?
+        {
+          batchv[batchc++] = optarg ;				// Yes, add to list
+        }
+        headless = TRUE ;
+        break ;
+      case 'S' :						// Server mode?
+        server = TRUE ;						// Yes, set flag
+        headless = TRUE ;
+        break ;
+      case 'c' :						// Client mode?
+        client_req = optarg ;					// Yes, remember request
+        headless = TRUE ;
+        break ;
+      case 'D' :						// Define?
+        add_define ( optarg ) ;					// Yes, add to list
+        break ;
     }
   }
 }
 
 
 //***************************************************************************************************
-//				C O M _ T I M E O U T						    *
+//				W R I T E C O M							    *
 //***************************************************************************************************
-// Set the time-out for the com port.								    *
+// Write a buffer to the serial port.  The library follows the compile state and the flash mode.    *
 //***************************************************************************************************
-void com_timeout ( int t )
+BOOL writecom ( const char* buf )
 {
-  COMMTIMEOUTS timeouts = { 0 } ;			// Struct for setting constants
-
-  GetCommTimeouts ( hcom, &timeouts ) ;			// Read current time-out settings
-  // For input:
-  timeouts.ReadIntervalTimeout         = 0 ;		// in milliseconds
-  timeouts.ReadTotalTimeoutConstant    = t ;		// in milliseconds
-  timeouts.ReadTotalTimeoutMultiplier  = 0 ;		// in milliseconds
-  // For output:
-  timeouts.WriteTotalTimeoutConstant   = 0 ;		// in milliseconds
-  timeouts.WriteTotalTimeoutMultiplier = 0 ;		// in milliseconds
-  SetCommTimeouts ( hcom, &timeouts ) ;			// Set time-outs
+  return esc_send ( &ses, buf ) ;			// Send, logged by ses_output()
 }
 
 
 //***************************************************************************************************
-//					O P E N _ P O R T					    * 
+//					A V A I L A B L E					    * 
 //***************************************************************************************************
-// Open serial port to target device.								    *
-// Returns -1 on error.										    *
+// Check if there is input from the console.							    *
+// Returns nonzero if input is available.							    *
 //***************************************************************************************************
-BOOL open_port ( const char* port )
+int available()
 {
-  char wport[32] ;					// Port name in windows form
-  BOOL res ;						// Result of opening
-  DCB dcbParams = { 0 } ;				// Initializing DCB structure
-
-  sprintf ( wport, "\\\\.\\%s", port ) ;		// Format for Windows
-  hcom = CreateFile ( wport,		                // port name
-                      GENERIC_READ | GENERIC_WRITE,	// Read/Write
-                      0,				// No Sharing
-                      NULL,				// No Security
-                      OPEN_EXISTING,			// Open existing port only
-                      0,				// Non Overlapped I/O
-                      NULL ) ;				// Null for Comm Devices
+  DWORD dwNumEvents;
 
-  if ( hcom == INVALID_HANDLE_VALUE )			// Check result
-  {
-    user_error ( "Error in opening %s", port ) ;	// No success
-    return FALSE ;
-  }
-  dcbParams.DCBlength = sizeof(dcbParams) ;		// Set size
-  GetCommState ( hcom, &dcbParams ) ;			// Get current state
-  dcbParams.BaudRate = baudrate ;			// Setting BaudRate = 9600
-  dcbParams.ByteSize = 8 ;				// Setting ByteSize = 8
-  dcbParams.StopBits = ONESTOPBIT ;			// Setting StopBits = 1
-  dcbParams.Parity   = NOPARITY ;			// Setting Parity = None
-  SetCommState ( hcom, &dcbParams ) ;			// Set new status
-  com_timeout ( 50 ) ;					// Set default time-out
-  return TRUE ;						// Return positive result
-}
-
-
-//***************************************************************************************************
-//				W R I T E C O M							    *
-//***************************************************************************************************
-// Write a buffer to the serial port.								    *
-//***************************************************************************************************
-BOOL writecom ( const char* buf )
-{
-  BOOL  stat ;						// Result of write action
-  DWORD nbToWrite ;					// Number of bytes to write
-  DWORD nbWritten ;					// Bytes written
-
-  nbToWrite = strlen ( buf ) ;				// Get number of bytes to write
-  stat = WriteFile ( hcom,				// Handle to the Serial port
-                     buf,				// Data to be written to the port
-                     nbToWrite,				// No of bytes to write
-                     &nbWritten,			// Bytes written
-                     NULL ) ;
-  return ( stat && ( nbToWrite == nbWritten ) ) ;
-}
-
-
-//***************************************************************************************************
-//					A V A I L A B L E					    * 
-//***************************************************************************************************
-// Check if there is input from the console.							    *
-// Returns nonzero if input is available.							    *
-//***************************************************************************************************
-int available()
-{
-  DWORD dwNumEvents;
-
-  GetNumberOfConsoleInputEvents ( hConsoleIn, &dwNumEvents ) ;
-  return dwNumEvents ;
+  GetNumberOfConsoleInputEvents ( hConsoleIn, &dwNumEvents ) ;
+  return dwNumEvents ;
 }
 
 
@@ -376,49 +1137,6 @@ DWORD readcons ( char* buf, DWORD maxlen )
 }
 
 
-//***************************************************************************************************
-//					R E A D C O M						    *
-//***************************************************************************************************
-// Read a buffer from the serial port.								    *
-//***************************************************************************************************
-int readcom ( char* buf, DWORD maxlen, int maxtry )
-{
-  BOOL  stat ;						// Result of read action
-  DWORD nbRead ;					// Number of bytes read
-  int   totread = 0 ;					// Total bytes read
-  char* p = buf ;					// Fill pointer
-  BOOL  eol ;						// End of line seen
-
-  while ( TRUE )
-  {
-    stat = ReadFile ( hcom,				// Handle to the Serial port
-                      p,				// Data to be read from the port
-                      maxlen,				// Max number of bytes to read
-                      &nbRead,				// Bytes actually read
-                      NULL ) ;
-    if ( ! stat )
-    {
-      return -1 ;
-    }
-    p += nbRead ;
-    totread += nbRead ;
-    maxlen -= nbRead ;
-    *p = '\0' ;						// Force end of buffer
-    eol = ( buf[totread - 1] == '\n' ) |		// End of input?
-          ( buf[totread - 1] == '\r' ) ;
-    if ( eol )
-    {
-      break ;						// End of input: exit loop
-    }
-    if ( --maxtry == 0 )
-    {
-      break ;
-    }
-  }
-  return totread ;					// Return number of bytes read
-}
-
-
 //***************************************************************************************************
 //					E C H O F I L T E R					    *
 //***************************************************************************************************
@@ -504,271 +1222,435 @@ BOOL ListDirectoryContents ( const char* sDir )
 
 
 //***************************************************************************************************
-//				C H E C K _ O K _ S T M 8 E					    *
+//					B E A U T I F Y						    *
 //***************************************************************************************************
-// Check for "ok\n" at the end of the line.							    *
-// Version for stm8e.										    *
+// Shift the "ok[.]\n" at the end of the line to the right margin.				    *
 //***************************************************************************************************
-char* check_ok_stm8e ( char* buf )
+void beautify ( char* buf, int margin )
 {
-  char* res ;						// Function result
+  char   okbuf[8] ;					// Last part of string
+  int    lenok  ;					// Length of last part
+  int    len ;						// Length of string
+  char*  p ;						// Will point to "ok" in string
+  int    n ;						// Number of bytes to move
 
-  res = buf += strlen ( buf ) - 3 ;			// Points to end of string - 3
-  if ( ( tolower ( *buf++ ) != 'o' ) ||		        // Ends with "ok" or "OK"?
-       ( tolower ( *buf++ ) != 'k' ) ||
-       ( *buf != '\n' ) )
+  if ( ( p = ses.ok_chk ( buf ) ) )			// Ends with "ok" phrase?
   {
-    res = NULL ;					// Not expected end
+    strcpy ( okbuf, p ) ;				// Yes, save last part
+    lenok = strlen ( okbuf ) ;				// Get length of last part
+    *p = '\0' ;						// Shorten first part			
+    while ( ( strlen ( buf ) + lenok ) < margin )	// Shift "ok" phrase to the right
+    {
+      strcat ( buf, " " ) ;				// Extend first part by one space
+    }
+    strcat ( buf, okbuf ) ;				// Add last part
   }
-  return res ;
 }
 
 
 //***************************************************************************************************
-//				C H E C K _ O K _ M E C R I S P					    *
+//					R T T _ T I M E O U T					    *
 //***************************************************************************************************
-// Check for "ok\n" at the end of the line.							    *
-// Version for mecrisp.										    *
+// Time-out in msec for the reply to a line.  The transmission time of the line and its echo is	    *
+// added to the estimate for the current mode: smoothed reply time plus 4 times the mean deviation. *
+// While there are too few samples a fixed default is used.					    *
 //***************************************************************************************************
-char* check_ok_mecrisp ( char* buf )
+int rtt_timeout ( const char* line )
 {
-  char* res ;						// Function result
+  struct rtt_t* r = &rtt[ses.nvm] ;			// Estimate for current mode
+  int           ms ;					// Time-out
 
-  res = ( buf += strlen ( buf ) - 4 ) ;			// Points to end of string - 4
-  if ( ( tolower ( *buf++ ) != 'o' ) ||		        // Ends with "ok" or "OK"?
-       ( tolower ( *buf++ ) != 'k' ) ||
-       ( *buf++ != '.' ) ||
-       ( *buf != '\n' ) )
+  ms = (int)( 2LL * strlen ( line ) * 10 * 1000 / baudrate ) ;	// Sending and echo
+  if ( r->samples < RTTLEARN )				// Still learning?
   {
-    res = NULL ;					// Not expected end
+    return ms + ( ses.nvm ? RTTDEFNVM : RTTDEFRAM ) ;
   }
-  return res ;
+  ms += ( r->srtt + 4 * r->rttvar ) / 1000 + RTTMARGIN ;
+  return ( ms < RTTMAX ) ? ms : RTTMAX ;
 }
 
+
 //***************************************************************************************************
-//				C H E C K _ O K _ Z E P T O					    *
+//					R T T _ S A M P L E					    *
 //***************************************************************************************************
-// Check for "ok\r\n" at the end of the line.							    *
-// Version for zepto.										    *
+// Update the estimate for the current mode with a measured reply time (Jacobson/Karels).	    *
+// A line without a complete reply doubles the deviation, so the next time-out is longer.	    *
+// Replies of the simulator are not used.							    *
 //***************************************************************************************************
-char* check_ok_zepto ( char* buf )
+void rtt_sample ( const char* line, LONGLONG usec, BOOL complete )
 {
-  char* res ;						// Function result
+  struct rtt_t* r = &rtt[ses.nvm] ;			// Estimate for current mode
+  int           m ;					// Reply time without transmission
+  int           err ;					// Difference with estimate
 
-  res = buf += strlen ( buf ) - 4 ;			// Points to end of string - 4
-  if ( ( *buf++ != 'o' )  ||         		        // Ends with "ok\r\n"?
-       ( *buf++ != 'k' )  ||
-       ( *buf++ != '\r' ) ||
-       ( *buf   != '\n' ) )
+  if ( ses.sim )					// Simulator tells nothing about the target
+  {
+    return ;
+  }
+  if ( ! complete )					// Time-out?
+  {
+    r->timeouts++ ;
+    if ( r->samples >= RTTLEARN && r->rttvar < RTTMAX * 1000 / 4 )
+    {
+      r->rttvar = r->rttvar * 2 + 1000 ;		// Back off
+    }
+    return ;
+  }
+  m = (int)( usec - 2LL * strlen ( line ) * 10 * 1000000 / baudrate ) ;
+  if ( m < 0 )
+  {
+    m = 0 ;
+  }
+  if ( r->samples++ == 0 )				// First sample?
   {
-    res = NULL ;					// Not expected end
+    r->srtt = m ;
+    r->rttvar = m / 2 ;
+    return ;
   }
-  return res ;
+  err = m - r->srtt ;
+  r->srtt += err / 8 ;					// Gain 1/8
+  r->rttvar += ( abs ( err ) - r->rttvar ) / 4 ;		// Gain 1/4
 }
 
 
 //***************************************************************************************************
-//					B E A U T I F Y						    *
+//					V E R I F Y _ S E N D					    *
 //***************************************************************************************************
-// Shift the "ok[.]\n" at the end of the line to the right margin.				    *
+// Send a line without its CR and check the echo byte for byte.  On a difference, the characters   *
+// are erased on the target with the erase character of the dialect, and the line is sent again.   *
+// The CR is only sent after a correct echo, so a corrupted line is never executed.  The echo is    *
+// returned in buf, so the caller sees the same reply as without the check.  Returns the length of  *
+// the echo, or -1 if the line was not echoed correctly in VERIFYTRY tries.			    *
 //***************************************************************************************************
-void beautify ( char* buf, int margin )
+int verify_send ( const char* line, char* buf, DWORD maxlen )
 {
-  char   okbuf[8] ;					// Last part of string
-  int    lenok  ;					// Length of last part
-  int    len ;						// Length of string
-  char*  p ;						// Will point to "ok" in string
-  int    n ;						// Number of bytes to move
+  int      n = strcspn ( line, "\r" ) ;			// Length without CR
+  int      got ;					// Bytes of echo received
+  int      k ;						// Bytes in one poll, erase count
+  int      try ;					// Transmission number
+  DWORD    t0 ;						// Start of wait
+  DWORD    timeout ;					// Time-out for the echo
+  LONGLONG t1 ;						// Start of transmission, for trace
 
-  if ( ( p = ok_chk ( buf ) ) )				// Ends with "ok" phrase?
+  if ( n == 0 || n >= (int)maxlen )			// Anything to check?
   {
-    strcpy ( okbuf, p ) ;				// Yes, save last part
-    lenok = strlen ( okbuf ) ;				// Get length of last part
-    *p = '\0' ;						// Shorten first part			
-    while ( ( strlen ( buf ) + lenok ) < margin )	// Shift "ok" phrase to the right
+    writecom ( line ) ;					// No, just send
+    return 0 ;
+  }
+  ver_lines++ ;
+  timeout = (DWORD)( 2LL * n * 10 * 1000 / baudrate ) + VERIFYMS ;
+  for ( try = 1 ; try <= VERIFYTRY ; try++ )
+  {
+    t1 = usec_now() ;
+    esc_write ( &ses, line, n ) ;			// Send without CR
+    got = 0 ;
+    t0 = GetTickCount() ;
+    while ( got < n && GetTickCount() - t0 <= timeout )	// Wait for the echo
     {
-      strcat ( buf, " " ) ;				// Extend first part by one space
+      if ( ( k = esc_poll ( &ses, buf + got, maxlen - 1 - got ) ) == 0 )
+      {
+        Sleep ( 1 ) ;
+      }
+      got += k ;
+    }
+    if ( got == n && memcmp ( buf, line, n ) == 0 )	// Echo correct?
+    {
+      esc_track ( &ses, line ) ;			// Yes, execute the line
+      esc_write ( &ses, "\r", 1 ) ;
+      return n ;
+    }
+    trace_event ( "retry", line, t1, "\"try\":%d,\"echo\":%d", try, got ) ;
+    for ( k = 0 ; k < n || k < got ; k++ )		// Erase what the target has
+    {
+      esc_write ( &ses, erase_char, strlen ( erase_char ) ) ;
+    }
+    t0 = GetTickCount() ;
+    while ( GetTickCount() - t0 < VERIFYQUIET )		// Discard echo of erase
+    {
+      if ( esc_poll ( &ses, buf, maxlen ) )
+      {
+        t0 = GetTickCount() ;				// Not quiet yet
+      }
+      Sleep ( 1 ) ;
+    }
+    if ( try < VERIFYTRY )
+    {
+      ver_retries++ ;
     }
-    strcat ( buf, okbuf ) ;				// Add last part
   }
-}
-
-
-BOOL fileExists ( const char* fspec )
-{
-  DWORD dwAttrib ;
-
-  dwAttrib = GetFileAttributes ( fspec ) ;
-  return ( dwAttrib != INVALID_FILE_ATTRIBUTES && 
-         !( dwAttrib & FILE_ATTRIBUTE_DIRECTORY ) ) ;
+  ver_failed++ ;
+  return -1 ;
 }
 
 
 //***************************************************************************************************
-//					S E A R C H _ F I L E					    *
+//					E X C H A N G E						    *
 //***************************************************************************************************
-// Search for a file in de configured path.  If the filename contains a "/", the path is not used.  *
-// If the file is not found, a NULL is returned.						    *
+// Send a line to the target and read the reply.  Reading stops at the "ok" phrase or a BELL, or   *
+// at the adaptive time-out.  A line that leaves the target compiling gets no "ok", its reply ends  *
+// with the line and is complete as well.  The reply time is used to update the estimate.  The	    *
+// reply buffer may be the same as the line.  With the echo check, tabs are sent as spaces and the  *
+// reply starts with the checked echo.  Returns the number of bytes in the reply.		    *
 //***************************************************************************************************
-const char* search_file ( const char* fnam )
+int exchange ( const char* line, char* reply, DWORD maxlen )
 {
-  char        mypath[sizeof(path)] ;			// Copy of search path
-  char*       token ;					// Pointer to token (= entry in path)
-  static char sfile[128] ;				// Full spec of file to search
+  char     sent[256] ;					// Copy of line
+  LONGLONG t0 ;						// Time of sending
+  int      timeout ;					// Time-out for this line
+  int      n = 0 ;					// Bytes in reply
+  BOOL     complete ;					// Reply has "ok", a BELL or ends the line
+  char*    p ;						// Pointer in sent
 
-  if ( fileExists ( fnam ) )				// Try the simple one
-  {
-    return fnam ;
-  }
-  if ( strchr ( fnam, '/' ) )				// Slash in filename?
+  strncpy ( sent, line, sizeof(sent) - 1 ) ;		// Reply may overwrite line
+  sent[sizeof(sent) - 1] = '\0' ;
+  timeout = rtt_timeout ( sent ) ;
+  if ( ver_on )						// Echo check?
   {
-    return NULL ;					// Yes, do not search
+    for ( p = sent ; ( p = strchr ( p, '\t' ) ) ; )	// Yes, echo of tab may differ
+    {
+      *p = ' ' ;
+    }
+    if ( ( n = verify_send ( sent, reply, maxlen ) ) < 0 )
+    {
+      snprintf ( reply, maxlen, "%.*s  escom: echo check failed %d times\x07\n",
+                 (int)strcspn ( sent, "\r" ), sent, VERIFYTRY ) ;
+      return strlen ( reply ) ;
+    }
   }
-  if ( strchr ( fnam, '\\' ) )				// Backslash in filename?
+  else
   {
-    return NULL ;					// Yes, do not search
+    writecom ( sent ) ;					// Send to com port
   }
-  // Now try all entries in the search path
-  strcpy ( mypath, path ) ;				// Make copy of path
-  token = strtok ( mypath, ";" ) ;			// Get first token (=directory)
-  while ( token )					// Search for requested token
+  t0 = usec_now() ;
+  n += esc_read_reply ( &ses, reply + n, maxlen - n, timeout ) ;	// Read reply from com port
+  complete = ses.ok_chk ( reply ) || strchr ( reply, 0x07 ) ||
+             ( ses.compiling && strchr ( reply, '\n' ) ) ;
+  if ( strchr ( reply, 0x07 ) )				// Error?
   {
-    strcpy ( sfile, token ) ;				// First part of ful file spec
-    strcat ( sfile, "/" ) ;				// Add slash
-    strcat ( sfile, fnam ) ;				// Add filename
-    if ( fileExists ( sfile ) )				// See if it exists
-    {
-      return sfile ;					// Yes, return full spec
-    }
-    token = strtok ( NULL, ";" ) ;			// No, get next token
+    ses.compiling = FALSE ;				// Target has left the definition
   }
-  return NULL ;						// File not found
+  rtt_sample ( sent, usec_now() - t0, complete ) ;
+  return n ;
 }
 
 
-
 //***************************************************************************************************
-//					G E T T O K E N						    *
+//					S E S _ E X C H A N G E					    *
 //***************************************************************************************************
-// Get a token from the input string.  Parameter i is the index 0...n.				    *
+// Exchange hook of the session, so the library uses the adaptive time-out too.  All its	    *
+// exchanges are probes like "' word DROP", they are traced as such.				    *
 //***************************************************************************************************
-const char* gettoken ( const char* str, int i )
+int ses_exchange ( struct esc_session* s, const char* line, char* reply, DWORD maxlen )
 {
-  static char cstr[128] ;				// Copy of input string
-  char        delim[] = " \r\n" ;			// List of delimeters
-  char*       token ;					// Pointer to token
+  LONGLONG t0 = usec_now() ;				// Start of probe, for trace
+  char     sent[TRACENAME + 1] ;			// Line sent, reply may overwrite it
+  int      nsent = strlen ( line ) ;			// Bytes sent
+  int      n ;						// Length of reply
 
-  strcpy ( cstr, str ) ;				// Make a copy of input string
-  token = strtok ( cstr, delim ) ;			// Get first token, index=0
-  while ( i-- > 0 && token )				// Search for requested token
-  {
-    token = strtok ( NULL, delim ) ;			// Get next token
-  }
-  return token ;					// Return requested token
+  snprintf ( sent, sizeof(sent), "%.*s", TRACENAME, line ) ;
+  n = exchange ( line, reply, maxlen ) ;
+  trace_event ( "probe", sent, t0, "\"bytes\":%d,\"reply\":%d,\"error\":%s",
+                nsent, n, strchr ( reply, 0x07 ) ? "true" : "false" ) ;
+  return n ;
 }
 
 
 //***************************************************************************************************
-//					S T R I P _ C O M M E N T				    *
+//					S T R E A M _ S C A N					    *
 //***************************************************************************************************
-// Strip comment at end of line.								    *
+// Scan replies received during a streaming upload.  The replies are shown and split into lines.    *
+// Every line with an "ok" reply or a BELL acknowledges the oldest line in flight.  If that line    *
+// left the target compiling, there is no "ok" and the end of the reply line acknowledges it.	    *
+// Returns FALSE if the target reported an error.  The location is stored in ses.errfile/line.	    *
 //***************************************************************************************************
-void strip_comment ( char *line )
+BOOL stream_scan ( const char* data, int n )
 {
-  char* p ;						// Result of strrchr()
+  struct stream_t* sl ;					// Line that caused the reply
+  int              i ;					// Index in data
+  BOOL             result = TRUE ;			// Function result
 
-  while ( ( p = strrchr ( line, '\\' ) ) > line )	// Comment at the end of the line?
+  fwrite ( data, 1, n, stdout ) ;			// Show replies as they come
+  for ( i = 0 ; i < n ; i++ )
   {
-    *p++ = '\r' ;					// Yes, force end of line
-    *p = '\0' ;
+    if ( str_plen < sizeof(str_part) - 1 )		// Collect reply line
+    {
+      str_part[str_plen++] = data[i] ;
+    }
+    if ( data[i] != '\n' )				// End of reply line?
+    {
+      continue ;					// No, get next character
+    }
+    str_part[str_plen] = '\0' ;				// Yes, check the line
+    str_plen = 0 ;
+    sl = &strwin[str_done % STREAMWIN] ;		// Oldest line in flight
+    if ( strchr ( str_part, 0x07 ) )			// BELL in the line means error
+    {
+      strcpy ( ses.errfile, sl->file ) ;		// Remember location of error
+      ses.errline = sl->line ;
+      ses.compiling = FALSE ;				// Target has left the definition
+      result = FALSE ;
+    }
+    else if ( ( str_done == str_sent || ! sl->compiling ) &&	// Acknowledge?
+              ( strlen ( str_part ) < 4 || ! ses.ok_chk ( str_part ) ) )
+    {
+      continue ;					// No, just output
+    }
+    if ( str_done < str_sent )				// Line acknowledged
+    {
+      str_done++ ;
+    }
   }
+  return result ;
 }
 
 
 //***************************************************************************************************
-//					S E A R C H _ D I C T					    *
+//					S T R E A M _ S Y N C					    *
 //***************************************************************************************************
-// Search for a symbol in the dictionary.							    *
-// Index will be returned, or -1 if not found.							    *
+// Wait until at most "pending" lines are in flight during a streaming upload.			    *
+// Returns FALSE if the target reported an error, or stayed silent for too long.  In that case the  *
+// oldest line in flight is taken as the location of the error.					    *
 //***************************************************************************************************
-int search_dict ( const char* symbol )
+BOOL stream_sync ( int pending )
 {
-  int i ;						// Index in dictionary
+  char             buf[256] ;				// Received data
+  int              n ;					// Number of bytes received
+  int              idle = 0 ;				// Number of time-outs
+  struct stream_t* sl ;					// Oldest line in flight
 
-  for ( i = 0 ; i < dinx ; i++ )			// Search in dictionary
+  while ( str_sent - str_done > pending )		// Wait for enough replies
   {
-    if ( strcmp ( dictionary[i].symbol, symbol ) == 0 )	// Match?
+    n = esc_read ( &ses, buf, sizeof(buf) - 1, 1 ) ;	// Read with time-out
+    if ( n <= 0 )					// Something received?
+    {
+      if ( ++idle == STREAMIDLE )			// No, waited too long?
+      {
+        sl = &strwin[str_done % STREAMWIN] ;		// Yes, give up
+        strcpy ( ses.errfile, sl->file ) ;
+        ses.errline = sl->line ;
+        user_error ( "No reply from the target for %d lines",
+                     str_sent - str_done ) ;
+        return FALSE ;
+      }
+      continue ;
+    }
+    idle = 0 ;
+    if ( ! stream_scan ( buf, n ) )			// Check replies
     {
-      return i ;					// Yes, return index
+      return FALSE ;
     }
   }
-  return -1 ;						// Symbol not found
+  return TRUE ;
 }
 
 
 //***************************************************************************************************
-//				L O A D _ C P U _ R E S O U R C E S				    *
+//					S T R E A M _ L I N E					    *
 //***************************************************************************************************
-// Load the CPU symbols in the dictionary.							    *
+// Send a line in a streaming upload.  The reply is not awaited, but received data is scanned for   *
+// errors.  The sender is throttled by the flow control of the serial port and by the maximum	    *
+// number of lines in flight.									    *
+// Returns FALSE if the target reported an error.						    *
 //***************************************************************************************************
-BOOL load_cpu_res ( const char* filespec )
+BOOL stream_line ( const char* line, const char* file )
 {
-  FILE*       fp = NULL ;				// File handle
-  char        line[128] ;				// Input buffer for 1 line
-  int         v ;					// Value of symbol
-  const char* symbol ;					// Points to symbol name
-  int         i ;					// Index of found symbol
+  char buf[256] ;					// Received data
+  int  n ;						// Number of bytes received
+  struct stream_t* sl ;					// Slot for this line
 
-  fp = fopen ( filespec, "r" ) ;			// Open the file
-  if ( fp == NULL)					// Success?
+  if ( ! stream_sync ( STREAMWIN - 1 ) )		// Wait for a free slot
   {
-    user_error ( "Unable to open %s", filespec ) ;	// No, show error
     return FALSE ;
   }
-  while ( fgets ( line, sizeof(line), fp ) != NULL )	// Read next line from file
+  sl = &strwin[str_sent % STREAMWIN] ;			// Remember source of the line
+  strcpy ( sl->file, file ) ;
+  sl->line = srcline ;
+  writecom ( line ) ;					// Send, may block on flow control
+  sl->compiling = ses.compiling ;			// Reply without "ok"?
+  str_sent++ ;
+  while ( ( n = esc_poll ( &ses, buf, sizeof(buf) - 1 ) ) )	// Check replies received so far
   {
-    if ( line[0] == '\\' )				// Skip comment lines
-    {
-      continue ;
-    }
-    if ( gettoken ( line, 2 ) == NULL )			// At least 3 token in the line?
+    if ( ! stream_scan ( buf, n ) )
     {
-      continue ;					// No, skip line
+      return FALSE ;
     }
-    if ( strcmp ( gettoken ( line, 1 ), "equ" ) == 0 )	// Is this an "equ" line?
+  }
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//					S E A R C H _ F I L E					    *
+//***************************************************************************************************
+// Search for a file in de configured path.  If the filename contains a "/", the path is not used.  *
+// If the file is not found, a NULL is returned.  The result is valid until the next call.	    *
+//***************************************************************************************************
+const char* search_file ( const char* fnam )
+{
+  static char sfile[128] ;				// Full spec of file found
+
+  return esc_search_file ( path, fnam, sfile, sizeof(sfile) ) ;
+}
+
+
+
+//***************************************************************************************************
+//					G E T T O K E N						    *
+//***************************************************************************************************
+// Get a token from the input string.  Parameter i is the index 0...n.				    *
+// Use esc_token() where the token is only inspected, it does not copy.				    *
+//***************************************************************************************************
+const char* gettoken ( const char* str, int i )
+{
+  static char     cstr[128] ;				// Copy of token
+  struct esc_span tok ;					// Token in str
+
+  if ( ! esc_token ( str, i, &tok ) )			// Find requested token
+  {
+    return NULL ;
+  }
+  snprintf ( cstr, sizeof(cstr), "%.*s", tok.len, tok.p ) ;
+  return cstr ;						// Return copy, valid until next call
+}
+
+
+//***************************************************************************************************
+//					I S _ K N O W N						    *
+//***************************************************************************************************
+// Check the known-word cache.  Only used in server mode, where the session outlives the uploads.   *
+//***************************************************************************************************
+BOOL is_known ( const char* word )
+{
+  int i ;						// Index in cache
+
+  if ( server )						// Cache only used in server mode
+  {
+    for ( i = 0 ; i < knownc ; i++ )			// Search the cache
     {
-      v = strtol ( gettoken ( line, 0 ), NULL, 16 ) ;	// Convert hexadecimal value
-      symbol = gettoken ( line, 2 ) ;			// Get pointer to symbol name
-      i = search_dict ( symbol ) ;			// Search in dictionary
-      if ( i < 0 )					// Already in dictionary?
-      {
-        strcpy ( dictionary[dinx].symbol, symbol ) ;	// No, symbol name to dictionary entry
-        dictionary[dinx].value = v ;			// Store in new dictionary entry
-        dinx++ ;					// Update index (next to fill)
-      }
-      else
+      if ( strcmp ( known[i], word ) == 0 )
       {
-        dictionary[i].value = v ;			// Overwrite value in dictionary entry
+        return TRUE ;					// Found
       }
     }
   }
-  fclose ( fp ) ;					// Close input file
-  return TRUE ;						// Positive result
+  return FALSE ;
 }
 
 
 //***************************************************************************************************
-//					F O R T H _ C H E C K					    *
+//					A D D _ K N O W N					    *
 //***************************************************************************************************
-// Send line to target and check the result.							    *
+// Add a word to the known-word cache.								    *
 //***************************************************************************************************
-BOOL forth_check ( const char* teststr )
+void add_known ( const char* word )
 {
-  char line[128] ;
-
-  writecom ( teststr ) ;				// Send to target
-  readcom ( line, sizeof(line), 12 ) ;			// Read reply from com port
-  return ( strchr ( line, 0x07 ) == NULL ) ;		// BELL in the string means error
+  if ( server && knownc < MAXKNOWN &&			// Room in cache?
+       ! is_known ( word ) )
+  {
+    strncpy ( known[knownc], word,			// Yes, add word
+              sizeof(known[0]) - 1 ) ;
+    known[knownc++][sizeof(known[0]) - 1] = '\0' ;
+  }
 }
 
 
@@ -790,350 +1672,4721 @@ BOOL forth_check ( const char* teststr )
 //***************************************************************************************************
 BOOL handle_res ( const char* line )
 {
-  char        cpu[32] ;					// CPU name token in copy of line
-  char        expstr[64] ;				// String to target for export constant
-  const char* p ;					// Points full path of cpu .efr file
-  FILE*       fp = NULL ;				// File handle
-  int         tinx ;					// Token index in line
-  const char* symbol ;					// Point to next symbol in export line
-  int         v ;					// Value of symbol
-  int         inx ;					// Index in dictionary found symbol
-  BOOL        result = TRUE ;				// Function result
-
   text_attr ( GREEN ) ;					// Info in green
   printf ( "\\res" ) ;					// Show first part of command in green
   text_attr ( 0 ) ;					// Rest in normal color
   printf ( "%s\n", line + 4 ) ;				// Show rest of line
-  if ( strcasecmp ( gettoken ( line, 1 ),		// MCU spec?
-                    "MCU:" ) == 0 )
+  return esc_handle_res ( &ses, line ) ;		// Errors shown by ses_output()
+}
+
+
+//***************************************************************************************************
+//					C O N D _ E V A L					    *
+//***************************************************************************************************
+// Evaluate the condition in front of [IF].  The condition is in RPN like Forth.  Allowed are	    *
+// defines from -D options, symbols in the escom dictionary, numbers with a "$", "#" or "%" prefix, *
+// single decimal digits and the operators = <> < > 0= 0<> NOT INVERT AND OR XOR + -.		    *
+// A define with a value that is not a number is a string, it can be compared with = or <> to a    *
+// plain word: "BOARD neo60 =".  The condition must use at least one define or symbol.		    *
+// Returns FALSE if the condition can not be evaluated here.  Then the target must do it.	    *
+//***************************************************************************************************
+BOOL cond_eval ( char* tokv[], int tokc, long* result )
+{
+  long        v[MAXCOND] ;				// Stack with values
+  const char* str[MAXCOND] ;				// String on stack, NULL for a number
+  BOOL        def[MAXCOND] ;				// Value comes from a define or symbol
+  int         sp = 0 ;					// Stack pointer
+  BOOL        known = FALSE ;				// Define or symbol used
+  const char* t ;					// Token
+  char*       end ;					// End of number conversion
+  long        a, b ;					// Operands
+  int         i, j ;					// Index in tokv, defines
+
+  for ( i = 0 ; i < tokc ; i++ )
   {
-    strcpy ( cpu, gettoken ( line, 2 ) ) ;		// Yes, get CPU name like "STM8S103"
-    strcat ( cpu, ".efr" ) ;				// Fixed extension
-    p = search_file ( cpu ) ;				// Search file in path
-    if ( p == NULL )					// Check if file exists
+    t = tokv[i] ;
+    if ( strcmp ( t, "=" ) == 0 || strcmp ( t, "<>" ) == 0 )	// Compare, also strings?
     {
-      user_error ( "%s not found", cpu ) ;		// Not existing, show error
-      result = FALSE ;					// Return bad result
+      if ( sp < 2 || ( ( str[sp - 1] == NULL ) != ( str[sp - 2] == NULL ) ) ||
+           ( str[sp - 1] && ! def[sp - 1] && ! def[sp - 2] ) )
+      {
+        return FALSE ;					// Not comparable here
+      }
+      sp-- ;
+      a = str[sp] ? ( strcasecmp ( str[sp - 1], str[sp] ) == 0 ) : ( v[sp - 1] == v[sp] ) ;
+      v[sp - 1] = ( a == ( t[0] == '=' ) ) ? -1 : 0 ;
+      str[sp - 1] = NULL ;
+      def[sp - 1] = TRUE ;
+      continue ;
     }
-    else
+    if ( strcasecmp ( t, "0=" ) == 0 || strcasecmp ( t, "0<>" ) == 0 ||	// Unary operator?
+         strcasecmp ( t, "NOT" ) == 0 || strcasecmp ( t, "INVERT" ) == 0 )
     {
-      load_cpu_res ( p ) ;				// Store symbols in dictionary 
+      if ( sp < 1 || str[sp - 1] )
+      {
+        return FALSE ;
+      }
+      a = v[sp - 1] ;
+      if ( strcasecmp ( t, "INVERT" ) == 0 )
+      {
+        v[sp - 1] = ~a ;
+      }
+      else
+      {
+        v[sp - 1] = ( ( a == 0 ) == ( strcasecmp ( t, "0<>" ) != 0 ) ) ? -1 : 0 ;
+      }
+      continue ;
     }
-  }
-  else if ( strcasecmp ( gettoken ( line, 1 ),		// Export symbol(s)?
-                         "export" ) == 0 )
-  {
-    tinx = 2 ;						// Start at first symbol
-    while ( ( symbol = gettoken ( line, tinx++ ) ) )	// Get next symbol
+    if ( strcmp ( t, "<" ) == 0 || strcmp ( t, ">" ) == 0 ||	// Binary operator?
+         strcasecmp ( t, "AND" ) == 0 || strcasecmp ( t, "OR" ) == 0 ||
+         strcasecmp ( t, "XOR" ) == 0 || strcmp ( t, "+" ) == 0 || strcmp ( t, "-" ) == 0 )
     {
-      inx = search_dict ( symbol ) ;			// Search in dictionary
-      if ( inx < 0 )					// Symbol found?
+      if ( sp < 2 || str[sp - 1] || str[sp - 2] )
       {
-        result = FALSE ;				// No, error
-        break ;
+        return FALSE ;
       }
-      sprintf ( expstr, "' %s DROP\r", symbol ) ;	// Try to get symbol as a word
-      if ( ! forth_check ( expstr ) )			// If this fails..
+      b = v[--sp] ;
+      a = v[sp - 1] ;
+      switch ( toupper ( t[0] ) )
       {
-        v = dictionary[inx].value ;			// Get value
-        sprintf ( expstr, "$%X CONSTANT %s\r",		// Add the constant
-                  v, symbol ) ;
-	if ( ! forth_check ( expstr ) )			// Success?
-	{
-          result = FALSE ;
-          break ;
-        }
+        case '<' : a = ( a < b ) ? -1 : 0 ; break ;
+        case '>' : a = ( a > b ) ? -1 : 0 ; break ;
+        case 'A' : a &= b ; break ;
+        case 'O' : a |= b ; break ;
+        case 'X' : a ^= b ; break ;
+        case '+' : a += b ; break ;
+        case '-' : a -= b ; break ;
       }
+      v[sp - 1] = a ;
+      def[sp - 1] |= def[sp] ;
+      continue ;
     }
-  }
-  else if ( strcasecmp ( gettoken ( line, 2 ),		// Single symbol?
-                         "equ" ) == 0 )
-  {
-    symbol = gettoken ( line, 3 ) ;			// Yes, get symbol
-    v = strtol ( gettoken ( line, 1 ), NULL, 16 ) ;	// Convert hexadecimal value
-    if ( symbol )					// Make sure symbol found
+    if ( sp == MAXCOND )				// Room on stack?
     {
-      tinx = search_dict ( symbol ) ;			// Symbol already defined?
-      if ( tinx < 0 )
+      return FALSE ;
+    }
+    str[sp] = NULL ;					// Assume a number
+    def[sp] = FALSE ;
+    for ( j = 0 ; j < definec ; j++ )			// Is it a define?
+    {
+      if ( strcasecmp ( defines[j].name, t ) == 0 )
       {
-        strcpy ( dictionary[dinx].symbol, symbol ) ;	// No, symbol name to dictionary entry
-        dictionary[dinx].value = v ;			// Store in new dictionary entry
-        dinx++ ;					// Update index (next to fill)
+        break ;
       }
-      else
+    }
+    if ( j < definec )					// Define?
+    {
+      v[sp] = strtol ( defines[j].value, &end, 0 ) ;
+      if ( *end || end == defines[j].value )		// Number?
+      {
+        str[sp] = defines[j].value ;			// No, string
+      }
+      def[sp] = known = TRUE ;
+    }
+    else if ( ( j = esc_search_dict ( &ses, t ) ) >= 0 )	// Symbol in dictionary?
+    {
+      v[sp] = ses.dict[j].value ;
+      def[sp] = known = TRUE ;
+    }
+    else if ( strchr ( "$#%", t[0] ) && t[1] )		// Number with prefix?
+    {
+      v[sp] = strtol ( t + 1, &end, t[0] == '$' ? 16 : t[0] == '%' ? 2 : 10 ) ;
+      if ( *end )
       {
-        dictionary[tinx].value = v ;			// Overwrite value in dictionary entry
+        return FALSE ;
       }
-    }      
+    }
+    else if ( isdigit ( t[0] ) && t[1] == '\0' )	// Single digit, same in every base
+    {
+      v[sp] = t[0] - '0' ;
+    }
+    else
+    {
+      str[sp] = t ;					// Plain word, maybe compared to a define
+    }
+    sp++ ;
   }
-  return result ;
+  if ( sp != 1 || str[0] || ! known )			// One number left, depends on escom?
+  {
+    return FALSE ;
+  }
+  *result = v[0] ;
+  return TRUE ;
 }
 
 
 //***************************************************************************************************
-//					I N C L U D E _ F I L E					    *
+//					C O N D _ L I N E					    *
 //***************************************************************************************************
-// Include a source file and send it to the serial port.					    *
-// Works also for conditonal include ( #require ).						    *
-// May be called recursively.									    *
+// Handle conditional compilation for a source line.  A line that ends with [IF] and has a	    *
+// condition that escom can evaluate is not sent.  The [ELSE] and [THEN] of such an [IF] must be    *
+// alone on a line.  They are not sent either, nor are the lines of the dead branch.  An [IF]	    *
+// that escom can not evaluate is left to the target, it is only tracked for nesting.		    *
+// Returns COND_SEND, COND_DIRECTIVE or COND_SKIP.						    *
 //***************************************************************************************************
-BOOL include_file ( const char* filename, BOOL conditional )
+int cond_line ( struct cond_t* c, const char* line )
 {
-  char        line[256] ;				// Input buffer for 1 line
-  FILE*       fp = NULL ;				// File handle
-  int         len_1 ;					// Length of input string minus 1
-  int         margin = 85 ;				// Margin for modified line
-  char        myfile[sizeof(path)] ;			// Full filespec
-  const char* p ;					// For recursive include file
-  const char* word ;					// Points to filename as word
-  char        wordtest[32] ;				// Test for existing word
-  BOOL        rcond ;					// Recursive conditional
-  BOOL        result = TRUE ;				// Function result
- 
-  p = search_file ( filename ) ;			// Search file in path
-  if ( p  )						// Found?
-  {
-    strcpy ( myfile, p ) ;				// Filename now with full path
-    fp = fopen ( myfile, "r" ) ;			// Open the file
-  }
-  if ( fp == NULL)					// Success?
-  {
-    user_error ( "Unable to open %s", filename ) ;	// No, show error
-    return FALSE ;
-  }
-  if ( conditional )					// Was it an "require"
+  char  copy[256] ;					// Copy of line, for tokens
+  char* tokv[32] ;					// Tokens in line
+  int   tokc = 0 ;					// Number of tokens
+  char* t ;						// Token
+  int   top ;						// State of innermost [IF]
+  long  v ;						// Value of condition
+  int   i ;						// Index in tokv
+
+  strncpy ( copy, line, sizeof(copy) - 1 ) ;
+  copy[sizeof(copy) - 1] = '\0' ;
+  for ( t = strtok ( copy, " \t\r\n" ) ; t && tokc < 32 ; t = strtok ( NULL, " \t\r\n" ) )
   {
-    word = strrchr ( filename, '\\' ) ;		  	// Yes, isolate filename
-    if ( word == NULL )					// Backslash in filename?
+    if ( strcmp ( t, "\\" ) == 0 )			// Comment till end of line
     {
-      word = strrchr ( filename, '/' ) ;		// No, try forward slash
+      break ;
     }
-    if ( word == NULL )					// Was there a (back)slash?
+    tokv[tokc++] = t ;
+  }
+  top = c->depth ? c->state[c->depth - 1] : COND_TARGET ;
+  if ( top == COND_DEAD )				// In dead branch?
+  {
+    for ( i = 0 ; i < tokc ; i++ )			// Yes, look for the end
     {
-      word = filename ;					// No, use plain filename
-    }
-    else
+      if ( strcasecmp ( tokv[i], "[IF]" ) == 0 )	// Nested [IF]
+      {
+        c->skip++ ;
+      }
+      else if ( strcasecmp ( tokv[i], "[THEN]" ) == 0 && c->skip )
+      {
+        c->skip-- ;
+      }
+      else if ( tokc == 1 && c->skip == 0 )		// Directive of our [IF]?
+      {
+        if ( strcasecmp ( tokv[0], "[ELSE]" ) == 0 )	// Start of live branch?
+        {
+          c->state[c->depth - 1] = COND_LIVE ;
+          return COND_DIRECTIVE ;
+        }
+        if ( strcasecmp ( tokv[0], "[THEN]" ) == 0 )	// End of [IF]?
+        {
+          c->depth-- ;
+          return COND_DIRECTIVE ;
+        }
+      }
+    }
+    return COND_SKIP ;
+  }
+  if ( tokc == 1 && top == COND_LIVE )			// Directive of our [IF]?
+  {
+    if ( strcasecmp ( tokv[0], "[ELSE]" ) == 0 )	// End of live branch?
+    {
+      c->state[c->depth - 1] = COND_DEAD ;
+      return COND_DIRECTIVE ;
+    }
+    if ( strcasecmp ( tokv[0], "[THEN]" ) == 0 )	// End of [IF]?
+    {
+      c->depth-- ;
+      return COND_DIRECTIVE ;
+    }
+  }
+  if ( tokc > 1 && c->depth < MAXCOND &&		// Ends with [IF]?
+       strcasecmp ( tokv[tokc - 1], "[IF]" ) == 0 &&
+       cond_eval ( tokv, tokc - 1, &v ) )		// Can we evaluate it?
+  {
+    c->state[c->depth++] = v ? COND_LIVE : COND_DEAD ;	// Yes, decide here
+    c->skip = 0 ;
+    return COND_DIRECTIVE ;
+  }
+  for ( i = 0 ; i < tokc ; i++ )			// Track [IF]s for the target
+  {
+    if ( strcasecmp ( tokv[i], "[IF]" ) == 0 && c->depth < MAXCOND )
+    {
+      c->state[c->depth++] = COND_TARGET ;
+    }
+    else if ( strcasecmp ( tokv[i], "[THEN]" ) == 0 && c->depth &&
+              c->state[c->depth - 1] == COND_TARGET )
+    {
+      c->depth-- ;
+    }
+  }
+  return COND_SEND ;
+}
+
+
+//***************************************************************************************************
+//					W O R D _ H A S H					    *
+//***************************************************************************************************
+// Hash (FNV-1a) of a word, case insensitive unless chk_case is set.				    *
+//***************************************************************************************************
+DWORD word_hash ( const char* w )
+{
+  DWORD h = 2166136261u ;				// Hash value
+
+  for ( ; *w ; w++ )
+  {
+    h = ( h ^ ( chk_case ? (BYTE)*w : tolower ( (BYTE)*w ) ) ) * 16777619u ;
+  }
+  return h ;
+}
+
+
+//***************************************************************************************************
+//					W O R D _ F I N D					    *
+//***************************************************************************************************
+// Search a word in a word set.  Returns the slot of the word, or the empty slot for it.	    *
+//***************************************************************************************************
+int word_find ( struct wordset_t* ws, const char* w )
+{
+  int i ;						// Slot in hash table
+
+  i = word_hash ( w ) & ( WORDHASH - 1 ) ;
+  while ( ws->w[i] &&					// Probe until found or empty
+          ( chk_case ? strcmp ( ws->w[i], w ) : strcasecmp ( ws->w[i], w ) ) )
+  {
+    i = ( i + 1 ) & ( WORDHASH - 1 ) ;
+  }
+  return i ;
+}
+
+
+//***************************************************************************************************
+//					W O R D _ I N						    *
+//***************************************************************************************************
+// Check if a word is in a word set.								    *
+//***************************************************************************************************
+BOOL word_in ( struct wordset_t* ws, const char* w )
+{
+  return ws->w[word_find ( ws, w )] != NULL ;
+}
+
+
+//***************************************************************************************************
+//					W O R D _ A D D						    *
+//***************************************************************************************************
+// Add a word to a word set.  The table is kept at most 3/4 full, further words are ignored.	    *
+//***************************************************************************************************
+void word_add ( struct wordset_t* ws, const char* w )
+{
+  int i ;						// Slot in hash table
+
+  i = word_find ( ws, w ) ;
+  if ( ws->w[i] == NULL && ws->n < WORDHASH / 4 * 3 )	// New and room?
+  {
+    ws->w[i] = strdup ( w ) ;
+    ws->n++ ;
+  }
+}
+
+
+//***************************************************************************************************
+//					W O R D _ C L E A R					    *
+//***************************************************************************************************
+// Remove all words from a word set.								    *
+//***************************************************************************************************
+void word_clear ( struct wordset_t* ws )
+{
+  int i ;						// Slot in hash table
+
+  for ( i = 0 ; i < WORDHASH ; i++ )
+  {
+    free ( ws->w[i] ) ;
+    ws->w[i] = NULL ;
+  }
+  ws->n = 0 ;
+}
+
+
+//***************************************************************************************************
+//					W O R D _ L I S T					    *
+//***************************************************************************************************
+// Add all whitespace separated words in a buffer to a word set.				    *
+//***************************************************************************************************
+void word_list ( struct wordset_t* ws, char* buf )
+{
+  char* w ;						// Word in buf
+
+  for ( w = strtok ( buf, " \t\r\n" ) ; w ; w = strtok ( NULL, " \t\r\n" ) )
+  {
+    word_add ( ws, w ) ;
+  }
+}
+
+
+//***************************************************************************************************
+//					I N I T _ D E F I N E R S				    *
+//***************************************************************************************************
+// Fill the set of defining words with the standard ones, the first time.			    *
+//***************************************************************************************************
+void init_definers()
+{
+  const char* definers[] = { ":", "CONSTANT", "VARIABLE", "CREATE", "VALUE", "2CONSTANT",
+                             "2VARIABLE", "DEFER", "BUFFER:", "CVARIABLE", NULL } ;
+  int i ;						// Index in definers
+
+  if ( wdefiner.n == 0 )				// First time?
+  {
+    for ( i = 0 ; definers[i] ; i++ )			// Yes, fill standard defining words
+    {
+      word_add ( &wdefiner, definers[i] ) ;
+    }
+  }
+}
+
+
+//***************************************************************************************************
+//					F P _ S T A R T						    *
+//***************************************************************************************************
+// Start footprint accounting for an upload.							    *
+//***************************************************************************************************
+void fp_start()
+{
+  init_definers() ;					// Names follow these words
+  footc = 0 ;						// Nothing counted yet
+  fp_here = -1 ;					// HERE not known
+  fp_colon = FALSE ;
+  fp_paren = FALSE ;
+  fp_base = 10 ;
+  fp_pendc = 0 ;
+}
+
+
+//***************************************************************************************************
+//					F P _ A D D						    *
+//***************************************************************************************************
+// Add bytes to the footprint of a word.							    *
+//***************************************************************************************************
+void fp_add ( const char* word, const char* file, BOOL flash, int bytes )
+{
+  int i ;						// Index in foot
+
+  for ( i = 0 ; i < footc ; i++ )			// Word seen before in this file?
+  {
+    if ( foot[i].flash == flash && strcmp ( foot[i].word, word ) == 0 &&
+         strcmp ( foot[i].file, file ) == 0 )
+    {
+      break ;
+    }
+  }
+  if ( i == footc )					// New word?
+  {
+    if ( footc == MAXFOOT )				// Yes, room for it?
+    {
+      return ;
+    }
+    snprintf ( foot[i].word, sizeof(foot[i].word), "%s", word ) ;
+    snprintf ( foot[i].file, sizeof(foot[i].file), "%s", file ) ;
+    foot[i].flash = flash ;
+    foot[i].bytes = 0 ;
+    footc++ ;
+  }
+  foot[i].bytes += bytes ;
+}
+
+
+//***************************************************************************************************
+//					F P _ L I N E						    *
+//***************************************************************************************************
+// Prepare a line for footprint sampling.  The names defined in the line are collected.  If the    *
+// line ends outside a colon definition, " HERE U." is appended, so the reply of the line carries   *
+// the new value of HERE.  If HERE is not known yet, "HERE U. " is put in front as well.  No extra *
+// lines are sent.  Lines inside a colon definition are left alone, and so are lines that would	    *
+// not fit in the TIB of the target with the additions.						    *
+//***************************************************************************************************
+void fp_line ( char* line, int size, const char* file )
+{
+  char        tok[64] ;					// Token from line
+  char        buf[256] ;				// Line with sampling added
+  const char* p = line ;				// Pointer in line
+  const char* end ;					// End of comment or string
+  BOOL        name = FALSE ;				// Next token is a new name
+  int         n ;					// Length of token
+  int         len ;					// Length of line with sampling
+
+  fp_src = esc_file_word ( file ) ;
+  fp_nvm = ses.nvm ;					// Mode before the line
+  fp_base0 = fp_base ;					// Base for "HERE U." in front
+  fp_prefix = ( fp_here < 0 && ! fp_colon ) ;
+  while ( *p )
+  {
+    if ( fp_paren )					// Inside ( comment?
+    {
+      if ( ( end = strchr ( p, ')' ) ) == NULL )	// Yes, look for the end
+      {
+        break ;						// Continues on next line
+      }
+      p = end + 1 ;
+      fp_paren = FALSE ;
+    }
+    while ( *p && isspace ( (BYTE)*p ) )		// Skip white space
+    {
+      p++ ;
+    }
+    for ( n = 0 ; p[n] && ! isspace ( (BYTE)p[n] ) ; n++ ) ;	// Find end of token
+    if ( n == 0 )
+    {
+      break ;						// End of line
+    }
+    snprintf ( tok, sizeof(tok), "%.*s", n, p ) ;	// Isolate token
+    p += n ;
+    if ( name )						// Name of a new word?
+    {
+      if ( fp_pendc < FOOTPEND )
+      {
+        snprintf ( fp_pend[fp_pendc++], sizeof(fp_pend[0]), "%s", tok ) ;
+      }
+      name = FALSE ;
+      continue ;
+    }
+    if ( strcmp ( tok, "(" ) == 0 )			// Comment?
+    {
+      fp_paren = TRUE ;
+    }
+    else if ( strcmp ( tok, ".(" ) == 0 )		// Print till ")"
+    {
+      p = ( end = strchr ( p, ')' ) ) ? end + 1 : p + strlen ( p ) ;
+    }
+    else if ( n <= 6 && tok[n - 1] == '"' )		// String word like ." S" ABORT"
+    {
+      p = ( end = strchr ( p, '"' ) ) ? end + 1 : p + strlen ( p ) ;
+    }
+    else if ( strcasecmp ( tok, "HEX" ) == 0 )		// Track number base
+    {
+      fp_base = 16 ;
+    }
+    else if ( strcasecmp ( tok, "DECIMAL" ) == 0 )
+    {
+      fp_base = 10 ;
+    }
+    else if ( strcasecmp ( tok, "BINARY" ) == 0 )
+    {
+      fp_base = 2 ;
+    }
+    else if ( strcmp ( tok, ";" ) == 0 )		// End of colon definition
+    {
+      fp_colon = FALSE ;
+    }
+    else if ( strcasecmp ( tok, ":NONAME" ) == 0 )	// Colon definition without name
+    {
+      fp_colon = TRUE ;
+    }
+    else if ( ! fp_colon && word_in ( &wdefiner, tok ) )	// Defining word?
+    {
+      fp_colon = ( strcmp ( tok, ":" ) == 0 ) ;
+      name = TRUE ;
+    }
+  }
+  fp_suffix = ! fp_colon ;				// Sample after the line?
+  n = strcspn ( line, "\r" ) ;				// Length without CR
+  len = snprintf ( buf, sizeof(buf), "%s%.*s%s\r", fp_prefix ? FOOTPRE : "", n, line,
+                   fp_suffix ? FOOTPOST : "" ) ;
+  if ( len >= size || len - 1 > TIBLEN )		// Room in buffer and TIB?
+  {
+    fp_prefix = fp_suffix = FALSE ;			// No room, do not sample this time
+    fp_here = -1 ;					// and start again after this line
+    return ;
+  }
+  strcpy ( line, buf ) ;
+}
+
+
+//***************************************************************************************************
+//					F P _ C U T						    *
+//***************************************************************************************************
+// Remove the last (or the first) occurrence of a string from a buffer.				    *
+//***************************************************************************************************
+void fp_cut ( char* buf, const char* str, BOOL last )
+{
+  char* p = NULL ;					// Occurrence to remove
+  char* q ;						// Search position
+  int   n = strlen ( str ) ;
+
+  for ( q = buf ; ( q = strstr ( q, str ) ) ; q++ )
+  {
+    p = q ;
+    if ( ! last )
+    {
+      break ;
+    }
+  }
+  if ( p )
+  {
+    memmove ( p, p + n, strlen ( p + n ) + 1 ) ;
+  }
+}
+
+
+//***************************************************************************************************
+//					F P _ R E P L Y						    *
+//***************************************************************************************************
+// Take the samples of HERE from the reply to a line prepared by fp_line().  The growth of HERE    *
+// is added to the words defined since the last sample.  The samples and the sampling words are    *
+// removed from the reply, so the user sees the normal reply.  Returns the new length.		    *
+//***************************************************************************************************
+int fp_reply ( char* reply )
+{
+  char* e ;						// End of number
+  char* q ;						// Start of number
+  char* end ;						// End of conversion
+  char* numend = NULL ;					// End of the last number
+  long  v[2] ;						// Samples: [0] before, [1] after the line
+  int   i ;						// Index in v or fp_pend
+  int   bytes ;						// Growth of HERE
+
+  if ( ! fp_prefix && ! fp_suffix )			// Sampled?
+  {
+    return strlen ( reply ) ;				// No, nothing to do
+  }
+  if ( ( e = ses.ok_chk ( reply ) ) == NULL )		// Output ends before "ok" phrase
+  {
+    e = reply + strlen ( reply ) ;
+  }
+  for ( i = 1 ; i >= 0 ; i-- )				// Sample after the line is printed last
+  {
+    if ( ( i == 1 && ! fp_suffix ) || ( i == 0 && ! fp_prefix ) )
+    {
+      continue ;
+    }
+    while ( e > reply && isspace ( (BYTE)e[-1] ) )	// Skip white space
+    {
+      e-- ;
+    }
+    for ( q = e ; q > reply && ! isspace ( (BYTE)q[-1] ) ; q-- ) ;	// Find start of number
+    v[i] = strtol ( q, &end, i ? fp_base : fp_base0 ) ;
+    if ( q == e || end != e )				// Not a number?
+    {
+      fp_here = -1 ;					// Sample lost, start again
+      fp_pendc = 0 ;
+      return strlen ( reply ) ;
+    }
+    if ( numend == NULL )
+    {
+      numend = e ;
+    }
+    e = q ;
+  }
+  while ( e > reply && e[-1] == ' ' )			// Remove the numbers
+  {
+    e-- ;
+  }
+  memmove ( e, numend, strlen ( numend ) + 1 ) ;
+  if ( fp_suffix )					// and the sampling words
+  {
+    fp_cut ( reply, FOOTPOST, TRUE ) ;
+  }
+  if ( fp_prefix )
+  {
+    fp_cut ( reply, FOOTPRE, FALSE ) ;
+    fp_here = v[0] ;					// Start value
+    fp_here_nvm = fp_nvm ;
+  }
+  if ( fp_suffix )
+  {
+    bytes = v[1] - fp_here ;				// Growth since last sample
+    if ( fp_here_nvm == ses.nvm && bytes > 0 && bytes < 65536 )	// Same memory, plausible?
+    {
+      if ( fp_pendc == 0 )				// Nothing defined, like ALLOT
+      {
+        fp_add ( "(other)", fp_src, ses.nvm, bytes ) ;
+      }
+      for ( i = 0 ; i < fp_pendc ; i++ )		// Share between the new words
+      {
+        fp_add ( fp_pend[i], fp_src, ses.nvm,
+                 bytes / fp_pendc + ( i ? 0 : bytes % fp_pendc ) ) ;
+      }
+    }
+    fp_here = v[1] ;					// New reference
+    fp_here_nvm = ses.nvm ;
+    fp_pendc = 0 ;
+  }
+  return strlen ( reply ) ;
+}
+
+
+//***************************************************************************************************
+//					F P _ C O M P A R E					    *
+//***************************************************************************************************
+// Compare two footprint entries for qsort, largest first.					    *
+//***************************************************************************************************
+int fp_compare ( const void* a, const void* b )
+{
+  return ( (const struct foot_t*)b )->bytes - ( (const struct foot_t*)a )->bytes ;
+}
+
+
+//***************************************************************************************************
+//					F P _ R E P O R T					    *
+//***************************************************************************************************
+// Show the footprint of the upload per file and the largest words.  With a history file, one line  *
+// per word is appended, so the growth can be followed over time.				    *
+//***************************************************************************************************
+void fp_report ( const char* upl )
+{
+  char        files[MAXPLAN][32] ;			// Files in report
+  int         fsize[MAXPLAN][2] ;			// Bytes per file, [0] RAM, [1] flash
+  int         filec = 0 ;				// Number of files
+  int         total[2] = { 0, 0 } ;			// Total bytes, [0] RAM, [1] flash
+  FILE*       fp ;					// History file
+  SYSTEMTIME  st ;					// Time of upload
+  int         i, j ;					// Index in foot, files
+
+  qsort ( foot, footc, sizeof(foot[0]), fp_compare ) ;	// Largest first
+  for ( i = 0 ; i < footc ; i++ )			// Sum per file
+  {
+    for ( j = 0 ; j < filec && strcmp ( files[j], foot[i].file ) ; j++ ) ;
+    if ( j == filec && filec < MAXPLAN )		// New file?
+    {
+      strcpy ( files[filec], foot[i].file ) ;
+      fsize[filec][0] = fsize[filec][1] = 0 ;
+      filec++ ;
+    }
+    if ( j < filec )
+    {
+      fsize[j][foot[i].flash] += foot[i].bytes ;
+    }
+    total[foot[i].flash] += foot[i].bytes ;
+  }
+  text_attr ( YELLOW ) ;
+  printf ( "Footprint of %s: %d bytes flash, %d bytes RAM, %d words\n",
+           upl, total[1], total[0], footc ) ;
+  text_attr ( 0 ) ;
+  for ( j = 0 ; j < filec ; j++ )
+  {
+    printf ( "  %-32s %6d flash %6d RAM\n", files[j], fsize[j][1], fsize[j][0] ) ;
+  }
+  for ( i = 0 ; i < footc && i < FOOTTOP ; i++ )
+  {
+    printf ( "  %-20s %-20s %6d %s\n", foot[i].word, foot[i].file, foot[i].bytes,
+             foot[i].flash ? "flash" : "RAM" ) ;
+  }
+  if ( *fpfile == '\0' )				// History file?
+  {
+    return ;						// No, done
+  }
+  if ( ( fp = fopen ( fpfile, "a" ) ) == NULL )
+  {
+    user_error ( "Unable to open %s", fpfile ) ;
+    return ;
+  }
+  fseek ( fp, 0, SEEK_END ) ;
+  if ( ftell ( fp ) == 0 )				// New file?
+  {
+    fprintf ( fp, "date,target,upload,file,word,memory,bytes\n" ) ;	// Yes, write header
+  }
+  GetLocalTime ( &st ) ;
+  for ( i = 0 ; i < footc ; i++ )
+  {
+    fprintf ( fp, "%04d-%02d-%02d %02d:%02d:%02d,%s,%s,%s,%s,%s,%d\n",
+              st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond,
+              target, esc_file_word ( upl ), foot[i].file, foot[i].word,
+              foot[i].flash ? "flash" : "ram", foot[i].bytes ) ;
+  }
+  fclose ( fp ) ;
+}
+
+
+//***************************************************************************************************
+//					S H A K E _ S T A R T					    *
+//***************************************************************************************************
+// Start tree shaking for a new upload plan.  The entry words are the first reachable words.	    *
+//***************************************************************************************************
+void shake_start()
+{
+  char buf[sizeof(shk_entry)] ;				// Copy, word_list() modifies
+
+  word_clear ( &wreach ) ;
+  shkc = shk_poolc = 0 ;
+  shk_def = -1 ;
+  shk_name = shk_paren = FALSE ;
+  shk_unsafe[0] = '\0' ;
+  shk_dropped = shk_lines = 0 ;
+  strcpy ( buf, shk_entry ) ;
+  word_list ( &wreach, buf ) ;
+}
+
+
+//***************************************************************************************************
+//					S H A K E _ R E A C H					    *
+//***************************************************************************************************
+// Mark a word as reachable.  If the set is full, nothing may be left out.			    *
+//***************************************************************************************************
+void shake_reach ( const char* w )
+{
+  if ( ! word_in ( &wreach, w ) )			// New word?
+  {
+    if ( wreach.n >= WORDHASH / 4 * 3 )			// Yes, room in set?
+    {
+      snprintf ( shk_unsafe, sizeof(shk_unsafe), "too many words" ) ;
+    }
+    word_add ( &wreach, w ) ;
+  }
+}
+
+
+//***************************************************************************************************
+//					S H A K E _ E N D					    *
+//***************************************************************************************************
+// Close the list of referenced words of the current definition.  A definition that is not ended   *
+// by ";" in the same file is always sent.							    *
+//***************************************************************************************************
+void shake_end()
+{
+  if ( shk_def >= 0 )					// Definition open?
+  {
+    if ( shk_poolc < SHAKEPOOL )			// Yes, end of list
+    {
+      shk_pool[shk_poolc++] = '\0' ;
+    }
+    if ( shk[shk_def].last == 0 )			// Not ended by ";"?
+    {
+      shk[shk_def].alone = FALSE ;			// Yes, send it anyway
+    }
+    shk_def = -1 ;
+  }
+}
+
+
+//***************************************************************************************************
+//					S H A K E _ L I N E					    *
+//***************************************************************************************************
+// Scan a line of the upload plan for tree shaking.  Colon definitions are collected with the	    *
+// words they reference.  Words used outside definitions are reachable, because they are executed  *
+// during the upload.  A definition can only be left out if ":" is the first and ";" the last	    *
+// token of its lines, and no IMMEDIATE or similar follows.  Words that look up other words by	    *
+// name at run time make the upload unsafe to shake.						    *
+//***************************************************************************************************
+void shake_line ( const char* line, int file, int lineno )
+{
+  const char*     lookups[] = { "EVALUATE", "FIND", "SFIND", "SEARCH-WORDLIST", NULL } ;
+  const char*     modifiers[] = { "IMMEDIATE", "COMPILE-ONLY", "COMPILEONLY", "INLINE", NULL } ;
+  char            tok[64] ;				// Token from line
+  const char*     p = line ;				// Pointer in line
+  const char*     end ;					// End of comment or string
+  BOOL            first = TRUE ;			// Token is the first of the line
+  BOOL            lookup ;				// Token looks up words by name
+  struct shake_t* d ;					// Definition
+  int             n ;					// Length of token
+  int             i ;					// Index in lookups, modifiers
+
+  while ( *p )
+  {
+    if ( shk_paren )					// Inside ( comment?
+    {
+      if ( ( end = strchr ( p, ')' ) ) == NULL )	// Yes, look for the end
+      {
+        break ;						// Continues on next line
+      }
+      p = end + 1 ;
+      shk_paren = FALSE ;
+    }
+    while ( *p && isspace ( (BYTE)*p ) )		// Skip white space
+    {
+      p++ ;
+    }
+    for ( n = 0 ; p[n] && ! isspace ( (BYTE)p[n] ) ; n++ ) ;	// Find end of token
+    if ( n == 0 )
+    {
+      break ;						// End of line
+    }
+    snprintf ( tok, sizeof(tok), "%.*s", n, p ) ;	// Isolate token
+    p += n ;
+    if ( shk_name )					// Name of a new definition?
+    {
+      shk_name = FALSE ;
+      if ( shkc == MAXSHAKE )				// Yes, room for it?
+      {
+        snprintf ( shk_unsafe, sizeof(shk_unsafe), "too many definitions" ) ;
+        continue ;
+      }
+      d = &shk[shkc] ;					// Fill new entry
+      snprintf ( d->name, sizeof(d->name), "%s", tok ) ;
+      d->file = file ;
+      d->first = lineno ;
+      d->last = 0 ;
+      d->ref = shk_poolc ;
+      d->alone = shk_alone ;
+      d->lookup = d->keep = FALSE ;
+      shk_def = shkc++ ;
+      first = FALSE ;
+      continue ;
+    }
+    if ( strcmp ( tok, "(" ) == 0 )			// Comment?
+    {
+      shk_paren = TRUE ;
+    }
+    else if ( strcmp ( tok, ".(" ) == 0 )		// Print till ")"
+    {
+      p = ( end = strchr ( p, ')' ) ) ? end + 1 : p + strlen ( p ) ;
+    }
+    else if ( n <= 6 && tok[n - 1] == '"' )		// String word like ." S" ABORT"
+    {
+      p = ( end = strchr ( p, '"' ) ) ? end + 1 : p + strlen ( p ) ;
+    }
+    else if ( shk_def < 0 && strcmp ( tok, ":" ) == 0 )	// Start of colon definition?
+    {
+      shk_name = TRUE ;
+      shk_alone = first ;				// Nothing in front of it
+    }
+    else if ( shk_def >= 0 && strcmp ( tok, ";" ) == 0 )	// End of colon definition?
+    {
+      shk[shk_def].last = lineno ;
+      if ( p[strspn ( p, " \t\r\n" )] )			// Something behind it?
+      {
+        shk[shk_def].alone = FALSE ;			// Yes, keep the lines together
+      }
+      shake_end() ;
+    }
+    else
+    {
+      lookup = FALSE ;
+      for ( i = 0 ; lookups[i] ; i++ )
+      {
+        lookup |= ( strcasecmp ( tok, lookups[i] ) == 0 ) ;
+      }
+      if ( shk_def >= 0 )				// Inside a definition?
+      {
+        if ( lookup || strcmp ( tok, "'" ) == 0 )	// Yes, name found at run time?
+        {
+          shk[shk_def].lookup = TRUE ;
+        }
+        if ( shk_poolc + n + 1 < SHAKEPOOL )		// Add to referenced words
+        {
+          strcpy ( shk_pool + shk_poolc, tok ) ;
+          shk_poolc += n + 1 ;
+        }
+        else
+        {
+          snprintf ( shk_unsafe, sizeof(shk_unsafe), "too many references" ) ;
+        }
+      }
+      else
+      {
+        if ( lookup )					// Executed during upload
+        {
+          snprintf ( shk_unsafe, sizeof(shk_unsafe), "%s used outside definitions", tok ) ;
+        }
+        for ( i = 0 ; modifiers[i] ; i++ )		// Changes the last definition?
+        {
+          if ( shkc && strcasecmp ( tok, modifiers[i] ) == 0 )
+          {
+            shk[shkc - 1].alone = FALSE ;		// Yes, always send it
+          }
+        }
+        shake_reach ( tok ) ;
+      }
+    }
+    first = FALSE ;
+  }
+}
+
+
+//***************************************************************************************************
+//					S H A K E _ R E S O L V E				    *
+//***************************************************************************************************
+// Find the reachable definitions after the plan is made.  Definitions are kept while their name   *
+// is reachable, and the words they reference become reachable in turn.  All definitions with a    *
+// reachable name are kept, so redefinitions stay as they are.  The word of each planned file is   *
+// kept too, #require tests for it.								    *
+//***************************************************************************************************
+void shake_resolve()
+{
+  const char* w ;					// Referenced word
+  BOOL        more = TRUE ;				// Something was added
+  int         i ;					// Index in plan, shk
+
+  shake_end() ;						// Close open definition
+  for ( i = 0 ; i < planc ; i++ )
+  {
+    shake_reach ( plan[i].word ) ;
+  }
+  while ( more && shk_unsafe[0] == '\0' )		// Until nothing changes
+  {
+    more = FALSE ;
+    for ( i = 0 ; i < shkc ; i++ )
+    {
+      if ( shk[i].keep ||
+           ( shk[i].alone && ! word_in ( &wreach, shk[i].name ) ) )
+      {
+        continue ;					// Already kept or not reachable yet
+      }
+      shk[i].keep = more = TRUE ;
+      shake_reach ( shk[i].name ) ;
+      for ( w = shk_pool + shk[i].ref ; *w ; w += strlen ( w ) + 1 )
+      {
+        shake_reach ( w ) ;
+      }
+      if ( shk[i].lookup )				// Uses words by name?
+      {
+        snprintf ( shk_unsafe, sizeof(shk_unsafe), "%.*s looks up words by name",
+                   (int)sizeof(shk[i].name) - 1, shk[i].name ) ;
+      }
+    }
+  }
+  for ( i = 0 ; i < shkc ; i++ )			// Count what is left out
+  {
+    if ( shk_unsafe[0] )				// Unsafe, send everything
+    {
+      shk[i].keep = TRUE ;
+    }
+    if ( ! shk[i].keep )
+    {
+      shk_dropped++ ;
+      shk_lines += shk[i].last - shk[i].first + 1 ;
+    }
+  }
+  text_attr ( YELLOW ) ;
+  if ( shk_unsafe[0] )
+  {
+    printf ( "Tree shaking: %s, all definitions are sent\n", shk_unsafe ) ;
+  }
+  else
+  {
+    printf ( "Tree shaking: %d of %d definitions left out, %d lines\n",
+             shk_dropped, shkc, shk_lines ) ;
+  }
+  text_attr ( 0 ) ;
+}
+
+
+//***************************************************************************************************
+//					S H A K E _ D R O P P E D				    *
+//***************************************************************************************************
+// Check if a line of a file belongs to a definition that is left out.  Returns the index of the   *
+// definition in shk, or -1 if the line must be sent.						    *
+//***************************************************************************************************
+int shake_dropped ( const char* file, int lineno )
+{
+  int i ;						// Index in shk
+
+  for ( i = 0 ; i < shkc ; i++ )
+  {
+    if ( ! shk[i].keep && lineno >= shk[i].first && lineno <= shk[i].last &&
+         strcmp ( plan[shk[i].file].file, file ) == 0 )
+    {
+      return i ;
+    }
+  }
+  return -1 ;
+}
+
+
+//***************************************************************************************************
+//					S H A K E _ L E F T _ O U T				    *
+//***************************************************************************************************
+// Check if a word was left out of the last upload.						    *
+//***************************************************************************************************
+BOOL shake_left_out ( const char* w )
+{
+  int i ;						// Index in shk
+
+  for ( i = 0 ; i < shkc ; i++ )
+  {
+    if ( ! shk[i].keep && strcasecmp ( shk[i].name, w ) == 0 )
+    {
+      return TRUE ;
+    }
+  }
+  return FALSE ;
+}
+
+
+//***************************************************************************************************
+//					L I N E _ R E A D Y					    *
+//***************************************************************************************************
+// Check if a complete line was typed on the console, so readcons() will not wait for the rest.    *
+//***************************************************************************************************
+BOOL line_ready()
+{
+  INPUT_RECORD ir[256] ;				// Console input events
+  DWORD        n ;					// Number of events
+  DWORD        i ;					// Index in ir
+
+  if ( headless || ! PeekConsoleInput ( hConsoleIn, ir, 256, &n ) )
+  {
+    return FALSE ;
+  }
+  for ( i = 0 ; i < n ; i++ )
+  {
+    if ( ir[i].EventType == KEY_EVENT && ir[i].Event.KeyEvent.bKeyDown &&
+         ir[i].Event.KeyEvent.wVirtualKeyCode == VK_RETURN )
+    {
+      return TRUE ;					// Enter pressed
+    }
+  }
+  return FALSE ;
+}
+
+
+//***************************************************************************************************
+//					J O B _ S E R V I C E					    *
+//***************************************************************************************************
+// Service the console between two lines of an upload.  A typed Forth line is sent between two	    *
+// upload lines and its reply is shown, but not inside a colon definition of the upload.	    *
+// "#pause" holds the upload here until "#resume" or "#abort".  "#abort" stops the upload after	    *
+// the current definition, so the target is not left compiling.  They act within the time of one    *
+// upload line, as lines inside a definition do not wait for a time-out, see exchange().  Other	    *
+// commands have to wait for the end of the upload.  Returns FALSE if the upload must stop.	    *
+//***************************************************************************************************
+BOOL job_service()
+{
+  char buf[256] ;					// Line from console
+  char reply[512] ;					// Reply of target
+
+  if ( headless )					// Console available?
+  {
+    return TRUE ;					// No, nothing to do
+  }
+  while ( TRUE )
+  {
+    if ( *job_pend && ! ses.compiling )			// Typed line and target interpreting?
+    {
+      if ( streaming && ! stream_sync ( 0 ) )		// Yes, needs a quiet line
+      {
+        return FALSE ;
+      }
+      exchange ( job_pend, reply, sizeof(reply) ) ;	// Send between upload lines
+      text_attr ( GREEN ) ;				// Show reply in green
+      printf ( "%s", reply ) ;
+      text_attr ( 0 ) ;
+      job_pend[0] = '\0' ;
+    }
+    if ( job_abort && ! ses.compiling )			// Stop now?
+    {
+      job_abort = FALSE ;
+      return FALSE ;
+    }
+    if ( line_ready() && readcons ( buf, sizeof(buf) ) > 0 )	// Line typed?
+    {
+      if ( buf[0] == '#' )				// Yes, directive?
+      {
+        log_put ( '#', buf, strcspn ( buf, "\r" ) ) ;	// Log it, Forth is logged when sent
+      }
+      if ( strncasecmp ( buf, "#pause", 6 ) == 0 )	// Pause?
+      {
+        job_paused = TRUE ;
+        printf ( "Upload paused, #resume or #abort\n" ) ;
+      }
+      else if ( strncasecmp ( buf, "#resume", 7 ) == 0 )	// Resume?
+      {
+        job_paused = FALSE ;
+      }
+      else if ( strncasecmp ( buf, "#abort", 6 ) == 0 )	// Abort?
+      {
+        job_abort = TRUE ;
+        job_paused = FALSE ;				// Let the definition finish
+      }
+      else if ( buf[0] == '#' || buf[0] == '\\' || *job_pend )	// Command or line waiting?
+      {
+        user_error ( "Upload running, line ignored" ) ;
+      }
+      else
+      {
+        snprintf ( job_pend, sizeof(job_pend), "%s", buf ) ;	// Send at next chance
+      }
+      continue ;
+    }
+    if ( ! job_paused )
+    {
+      return TRUE ;					// Go on with the upload
+    }
+    Sleep ( 10 ) ;					// Paused, wait for a command
+  }
+}
+
+
+//***************************************************************************************************
+//					U P L O A D _ F I L E					    *
+//***************************************************************************************************
+// File hook of esc_include().  A #require is answered from the known-word cache if possible and    *
+// waits for a quiet line in a streaming upload.  The start and end of a file are shown between	    *
+// separation lines and traced, the source of the lines sent is set for the log.		    *
+//***************************************************************************************************
+int upload_file ( struct esc_session* s, int event, const char* file, BOOL conditional, BOOL result )
+{
+  struct upl_file_t* f ;				// Entry of the file
+
+  switch ( event )
+  {
+    case ESC_REQUIRE :
+      if ( is_known ( esc_file_word ( file ) ) )	// Known to exist from earlier probe?
+      {
+        return ESC_SKIP ;				// Yes, no need to ask the target
+      }
+      if ( streaming && ! stream_sync ( 0 ) )		// Probe needs a quiet line
+      {
+        return ESC_STOP ;
+      }
+      break ;
+    case ESC_KNOWN :
+      add_known ( esc_file_word ( file ) ) ;		// Remember for next time
+      break ;
+    case ESC_OPEN :
+      f = &upl_file[upl_depth++] ;			// Nesting is checked by make_plan()
+      memset ( f, 0, sizeof(*f) ) ;
+      f->savefile = srcfile ;				// Source of caller, for log
+      f->saveline = srcline ;
+      f->margin = 85 ;
+      f->t0 = usec_now() ;
+      f->lines0 = ses.lines ;
+      f->bytes0 = ses.bytes ;
+      srcfile = file ;					// Source of sent lines, for log
+      srcline = 0 ;
+      print_sep() ;					// Print separation line
+      break ;
+    case ESC_CLOSE :
+      f = &upl_file[--upl_depth] ;
+      trace_event ( "file", file, f->t0, "\"lines\":%d,\"bytes\":%d,\"required\":%s,\"result\":%s",
+                    ses.lines - f->lines0, ses.bytes - f->bytes0, conditional ? "true" : "false",
+                    result ? "true" : "false" ) ;
+      print_sep() ;					// Print separation line
+      srcfile = f->savefile ;				// Restore source for log
+      srcline = f->saveline ;
+      break ;
+  }
+  return ESC_SEND ;
+}
+
+
+//***************************************************************************************************
+//					U P L O A D _ F I L T E R				    *
+//***************************************************************************************************
+// Line filter of esc_include().  The console is serviced and [IF] is evaluated here.  "\res" lines *
+// are handled with streaming and trace, #keep lines and definitions left out by tree shaking are   *
+// shown but not sent.  All other lines are left to the library.				    *
+//***************************************************************************************************
+int upload_filter ( struct esc_session* s, char* line, const char* file, int lineno )
+{
+  struct upl_file_t* f = &upl_file[upl_depth - 1] ;	// File being uploaded
+  int                len_1 = strlen ( line ) - 1 ;	// Length of line minus 1
+  int                depth = f->cond.depth ;		// Nesting of [IF] before this line
+  int                n ;				// Result of cond_line() or definition
+  LONGLONG           t1 ;				// Start of "\res", for trace
+  BOOL               result ;				// Result of "\res"
+
+  if ( ! job_service() )				// Console wants attention?
+  {
+    user_error ( "Upload aborted" ) ;			// Yes, #abort given
+    return ESC_STOP ;
+  }
+  srcline = lineno ;					// Count lines for log
+  if ( len_1 < 0 )					// Empty line?
+  {
+    printf ( "\n" ) ;					// Yes, show it
+    return ESC_SKIP ;
+  }
+  if ( ( n = cond_line ( &f->cond, line ) ) )		// Left out by [IF]?
+  {
+    if ( n == COND_DIRECTIVE )				// Show evaluated directives
+    {
+      log_put ( '#', line, len_1 ) ;
+      text_attr ( YELLOW ) ;
+      printf ( "%.*s", len_1, line ) ;
+      if ( f->cond.depth >= depth )			// [IF] or [ELSE]: show decision
+      {
+        printf ( "  \\ escom: %s",
+                 f->cond.state[f->cond.depth - 1] == COND_DEAD ? "skip" : "send" ) ;
+      }
+      printf ( "\n" ) ;
+      text_attr ( 0 ) ;
+    }
+    return ESC_SKIP ;
+  }
+  if ( strncmp ( line, "\\res", 4 ) == 0 )		// Line starts with "\res"?
+  {
+    log_put ( '#', line, len_1 ) ;			// Log local directive
+    if ( streaming && ! stream_sync ( 0 ) )		// Export needs a quiet line
+    {
+      return ESC_STOP ;
+    }
+    t1 = usec_now() ;
+    result = handle_res ( line ) ;			// Yes, handle it
+    fp_here = -1 ;					// Exports may have used memory
+    trace_event ( "res", line, t1, "\"line\":%d,\"result\":%s",
+                  lineno, result ? "true" : "false" ) ;
+    return result ? ESC_SKIP : ESC_STOP ;
+  }
+  if ( strncmp ( line, "#keep", 5 ) == 0 )		// Entry words for tree shaking?
+  {
+    log_put ( '#', line, len_1 ) ;			// Yes, local directive
+    text_attr ( YELLOW ) ;
+    printf ( "%s\n", line ) ;
+    text_attr ( 0 ) ;
+    return ESC_SKIP ;
+  }
+  if ( shk_on && line[0] != '\\' &&			// Unused definition?
+       strncmp ( line, "#include", 8 ) != 0 && strncmp ( line, "#require", 8 ) != 0 &&
+       ( n = shake_dropped ( file, lineno ) ) >= 0 )
+  {
+    if ( lineno == shk[n].first )			// Yes, show it once
+    {
+      text_attr ( YELLOW ) ;
+      printf ( "\\ escom: %s left out\n", shk[n].name ) ;
+      text_attr ( 0 ) ;
+    }
+    return ESC_SKIP ;
+  }
+  return ESC_SEND ;
+}
+
+
+//***************************************************************************************************
+//					U P L O A D _ S E N D					    *
+//***************************************************************************************************
+// Send hook of esc_include() for nested #include and #require lines, shown in green.  In a	    *
+// streaming upload the line takes a slot, so the replies stay in sync.				    *
+//***************************************************************************************************
+BOOL upload_send ( struct esc_session* s, const char* line )
+{
+  BOOL result ;						// Function result
+
+  text_attr ( GREEN ) ;					// Show line in green
+  result = streaming ? stream_line ( line, srcfile ) : writecom ( line ) ;
+  text_attr ( 0 ) ;					// Color back to normal
+  return result ;
+}
+
+
+//***************************************************************************************************
+//					U P L O A D _ L I N E					    *
+//***************************************************************************************************
+// Upload hook of esc_include().  In a streaming upload the reply is not awaited.  Otherwise HERE   *
+// is sampled for the footprint, the line is traced and the "ok" of the reply is moved to the	    *
+// margin.  Returns the length of the reply, or -1 if streaming found an error.			    *
+//***************************************************************************************************
+int upload_line ( struct esc_session* s, const char* line, char* reply, DWORD maxlen )
+{
+  struct upl_file_t* f = &upl_file[upl_depth - 1] ;	// File being uploaded
+  char               buf[256] ;				// Line with samples of HERE
+  int                n ;				// Length of reply
+  LONGLONG           t1 ;				// Start of line, for trace
+
+  *reply = '\0' ;
+  if ( streaming )					// Streaming upload?
+  {
+    return stream_line ( line, srcfile ) ? 0 : -1 ;	// Yes, do not wait for the reply
+  }
+  snprintf ( buf, sizeof(buf), "%s", line ) ;
+  if ( fp_on )						// Footprint wanted?
+  {
+    fp_line ( buf, sizeof(buf), srcfile ) ;		// Yes, sample HERE with this line
+  }
+  t1 = usec_now() ;
+  n = exchange ( buf, reply, maxlen ) ;			// Send to com port and read reply
+  if ( fp_on )
+  {
+    n = fp_reply ( reply ) ;				// Take samples out of the reply
+  }
+  trace_event ( "line", line, t1, "\"line\":%d,\"bytes\":%d,\"reply\":%d,\"flash\":%s",
+                srcline, (int)strlen ( line ), n, ses.nvm ? "true" : "false" ) ;
+  if ( n > 0 )						// Anything to show?
+  {
+    if ( n > f->margin )				// Need to widen output ?
+    {
+      f->margin = n ;					// Yes
+    }
+    beautify ( reply, f->margin ) ;
+    n = strlen ( reply ) ;
+  }
+  if ( strchr ( reply, 0x07 ) )				// BELL in the string means error
+  {
+    knownc = 0 ;					// State of target is unknown now
+  }
+  return n ;
+}
+
+
+//***************************************************************************************************
+//					I N C L U D E _ F I L E					    *
+//***************************************************************************************************
+// Include a source file and send it to the serial port.  The engine is esc_include() of the	    *
+// library, the hooks above add the console service, [IF], tree shaking, footprint, trace and	    *
+// streaming.  Works also for conditonal include ( #require ), nested files are handled by the	    *
+// library.											    *
+//***************************************************************************************************
+BOOL include_file ( const char* filename, BOOL conditional )
+{
+  ses.filter = upload_filter ;				// Extras of escom
+  ses.file = upload_file ;
+  ses.send = upload_send ;
+  ses.upload = upload_line ;
+  return esc_include ( &ses, filename, conditional ) ;
+}
+
+
+//***************************************************************************************************
+//					L O A D _ W O R D S					    *
+//***************************************************************************************************
+// Get the words of the target for the check on undefined words.  The words are read from the file *
+// <target>.wrd in the search path.  If there is no such file, the target is asked once with WORDS. *
+// The words stay valid for the session.  Returns FALSE if no words are available.		    *
+//***************************************************************************************************
+BOOL load_words()
+{
+  char        wrd[48] ;					// Name of word file
+  char        line[256] ;				// Line from word file
+  char*       buf ;					// Reply to WORDS
+  const char* p ;					// Full filespec
+  FILE*       fp ;					// Word file
+
+  if ( chk_loaded )					// Already done?
+  {
+    return TRUE ;
+  }
+  snprintf ( wrd, sizeof(wrd), "%s.wrd", target ) ;
+  if ( ( p = search_file ( wrd ) ) &&			// Word file in path?
+       ( fp = fopen ( p, "r" ) ) )
+  {
+    while ( fgets ( line, sizeof(line), fp ) )		// Yes, read all words
+    {
+      if ( line[0] != '\\' )				// Skip comment lines
+      {
+        word_list ( &wbuiltin, line ) ;
+      }
+    }
+    fclose ( fp ) ;
+  }
+  else if ( ( buf = malloc ( WORDSBUF ) ) )		// No, ask the target
+  {
+    PurgeComm ( ses.hcom, PURGE_RXCLEAR ) ;		// Discard any stale input
+    writecom ( "WORDS\r" ) ;
+    esc_read_reply ( &ses, buf, WORDSBUF, 30000 ) ;
+    word_list ( &wbuiltin, buf ) ;
+    free ( buf ) ;
+  }
+  chk_loaded = ( wbuiltin.n > 10 ) ;			// Reasonable list?
+  if ( ! chk_loaded )
+  {
+    word_clear ( &wbuiltin ) ;				// No, try again next time
+  }
+  return chk_loaded ;
+}
+
+
+//***************************************************************************************************
+//					I S _ N U M B E R					    *
+//***************************************************************************************************
+// Check if a token is a number for the target.  Accepted are an optional prefix "$", "#", "%" or  *
+// "&", an optional "-", digits in the base and a trailing "." for double numbers.  A character in  *
+// single quotes like 'A' is also a number.							    *
+//***************************************************************************************************
+BOOL is_number ( const char* tok, int base )
+{
+  int   d ;						// Value of digit
+  BOOL  digits = FALSE ;				// Digit seen
+
+  if ( strlen ( tok ) == 3 && tok[0] == '\'' && tok[2] == '\'' )
+  {
+    return TRUE ;					// Character literal
+  }
+  switch ( *tok )					// Base prefix?
+  {
+    case '$' : base = 16 ; tok++ ; break ;
+    case '#' :
+    case '&' : base = 10 ; tok++ ; break ;
+    case '%' : base = 2 ;  tok++ ; break ;
+  }
+  if ( *tok == '-' )					// Negative?
+  {
+    tok++ ;
+  }
+  for ( ; *tok ; tok++ )				// Check all digits
+  {
+    if ( *tok == '.' && tok[1] == '\0' && digits )	// Double number?
+    {
+      break ;
+    }
+    if ( isdigit ( *tok ) )
+    {
+      d = *tok - '0' ;
+    }
+    else if ( isalpha ( *tok ) )
+    {
+      d = tolower ( *tok ) - 'a' + 10 ;
+    }
+    else
+    {
+      return FALSE ;
+    }
+    if ( d >= base )
+    {
+      return FALSE ;
+    }
+    digits = TRUE ;
+  }
+  return digits ;
+}
+
+
+//***************************************************************************************************
+//					C H E C K _ S T A R T					    *
+//***************************************************************************************************
+// Prepare for a check on undefined words.  Called before the upload tree is planned.		    *
+//***************************************************************************************************
+void check_start()
+{
+  init_definers() ;					// Standard defining words
+  word_clear ( &wdefined ) ;				// Nothing defined yet
+  chk_errors = 0 ;
+  chk_paren = FALSE ;
+  chk_next[0] = '\0' ;
+  chk_colon[0] = '\0' ;
+  chk_creates = FALSE ;
+  chk_base = 10 ;
+  chk_active = TRUE ;
+}
+
+
+//***************************************************************************************************
+//					C H E C K _ L I N E					    *
+//***************************************************************************************************
+// Check a source line for undefined words.  Names made by defining words are added to wdefined.   *
+// A colon definition that uses a defining word becomes a defining word itself.  Comments and	    *
+// strings are skipped.  Undefined words are reported with file and line.			    *
+//***************************************************************************************************
+void check_line ( const char* line, const char* file, int lineno )
+{
+  char        tok[64] ;					// Token from line
+  const char* p = line ;				// Pointer in line
+  const char* end ;					// End of string or comment
+  int         n ;					// Length of token
+
+  while ( *p )
+  {
+    if ( chk_paren )					// Inside ( comment?
+    {
+      if ( ( end = strchr ( p, ')' ) ) == NULL )	// Yes, look for the end
+      {
+        return ;					// Continues on next line
+      }
+      p = end + 1 ;
+      chk_paren = FALSE ;
+    }
+    while ( *p && isspace ( (BYTE)*p ) )		// Skip white space
+    {
+      p++ ;
+    }
+    for ( n = 0 ; p[n] && ! isspace ( (BYTE)p[n] ) ; n++ ) ;	// Find end of token
+    if ( n == 0 )
+    {
+      break ;						// End of line
+    }
+    snprintf ( tok, sizeof(tok), "%.*s", n, p ) ;	// Isolate token
+    p += n ;
+    if ( chk_next[0] )					// Token is the name of a new word?
+    {
+      if ( strcmp ( chk_next, ":" ) == 0 )		// Colon definition?
+      {
+        strcpy ( chk_colon, tok ) ;			// Yes, remember name
+        chk_creates = FALSE ;
+      }
+      if ( strcasecmp ( chk_next, "CHAR" ) )		// CHAR takes a character, not a name
+      {
+        word_add ( &wdefined, tok ) ;
+      }
+      chk_next[0] = '\0' ;
+      continue ;
+    }
+    if ( strcmp ( tok, "\\" ) == 0 )			// Comment to end of line?
+    {
+      break ;
+    }
+    if ( strcmp ( tok, "(" ) == 0 )			// Comment?
+    {
+      chk_paren = TRUE ;
+      continue ;
+    }
+    if ( strcmp ( tok, ".(" ) == 0 )			// Print till ")"
+    {
+      p = ( end = strchr ( p, ')' ) ) ? end + 1 : p + strlen ( p ) ;
+      continue ;
+    }
+    if ( n <= 6 && tok[n - 1] == '"' &&			// String word like ." S" ABORT"?
+         ( word_in ( &wbuiltin, tok ) || word_in ( &wdefined, tok ) ) )
+    {
+      p = ( end = strchr ( p, '"' ) ) ? end + 1 : p + strlen ( p ) ;
+      continue ;
+    }
+    if ( strcasecmp ( tok, "HEX" ) == 0 )		// Track number base
+    {
+      chk_base = 16 ;
+    }
+    else if ( strcasecmp ( tok, "DECIMAL" ) == 0 )
+    {
+      chk_base = 10 ;
+    }
+    else if ( strcasecmp ( tok, "BINARY" ) == 0 )
+    {
+      chk_base = 2 ;
+    }
+    if ( strcasecmp ( tok, "CHAR" ) == 0 ||		// Next token is a character?
+         strcasecmp ( tok, "[CHAR]" ) == 0 )
+    {
+      strcpy ( chk_next, "CHAR" ) ;
+    }
+    else if ( word_in ( &wdefiner, tok ) )		// Defining word?
+    {
+      if ( chk_colon[0] )				// Used in a colon definition?
+      {
+        chk_creates = TRUE ;				// Yes, that is a defining word too
+      }
+      else
+      {
+        strcpy ( chk_next, strcmp ( tok, ":" ) ? "NAME" : ":" ) ;
+      }
+      continue ;
+    }
+    if ( strcmp ( tok, ";" ) == 0 && chk_colon[0] )	// End of colon definition?
+    {
+      if ( chk_creates )				// Was it a defining word?
+      {
+        word_add ( &wdefiner, chk_colon ) ;		// Yes, remember
+      }
+      chk_colon[0] = '\0' ;
+    }
+    if ( word_in ( &wdefined, tok ) ||			// Known word?
+         word_in ( &wbuiltin, tok ) ||
+         is_number ( tok, chk_base ) )			// or a number?
+    {
+      continue ;
+    }
+    if ( chk_errors++ < CHKMAXERR )			// Report undefined word
+    {
+      user_error ( "%s line %d: %s is undefined", file, lineno, tok ) ;
+    }
+  }
+}
+
+
+//***************************************************************************************************
+//					P L A N _ F I L E					    *
+//***************************************************************************************************
+// Add a file and the files it includes to the upload plan.  The directives are parsed the same way *
+// include_file() does, but nothing is sent to the target.  Repeated #require of the same word is   *
+// folded to one visit.  Missing files and cycles are reported with the location of the directive.  *
+// The symbols of "\res MCU:" and "\res ... equ" are put in the dictionary here already, so an [IF] *
+// on them is decided the same way in the plan, the check, tree shaking and the upload.		    *
+// May be called recursively.  Returns FALSE on error.						    *
+//***************************************************************************************************
+BOOL plan_file ( const char* filename, BOOL conditional, const char* from, int fromline )
+{
+  char          line[256] ;				// Input buffer for 1 line
+  FILE*         fp = NULL ;				// File handle
+  const char*   p ;					// Full filespec or parameter
+  char          param[128] ;				// Copy of parameter of directive
+  char          cpu[36] ;				// Name of .efr file
+  struct plan_t* pl ;					// Entry for this file
+  int           me ;					// Index of this file in plan
+  int           lineno = 0 ;				// Line number in file
+  int           len_1 ;					// Length of line minus 1
+  BOOL          rcond ;					// Recursive conditional
+  int           i ;					// Index in plan/planstack
+  BOOL          result = TRUE ;				// Function result
+  struct cond_t cond = { 0 } ;				// Conditional compilation state
+  int           cres ;					// Result of cond_line()
+
+  p = search_file ( filename ) ;			// Search file in path
+  if ( p == NULL )					// Found?
+  {
+    user_error ( "%s not found (%s line %d)",		// No, show error
+                 filename, from, fromline ) ;
+    return FALSE ;
+  }
+  for ( i = 0 ; i < plandepth ; i++ )			// Check for cycle
+  {
+    if ( strcmp ( plan[planstack[i]].file, p ) == 0 )
+    {
+      user_error ( "Cycle: %s includes %s (line %d)",	// Cycle found
+                   from, p, fromline ) ;
+      return FALSE ;
+    }
+  }
+  if ( conditional )					// #require?
+  {
+    for ( i = 0 ; i < planc ; i++ )			// Yes, fold repeated requires
+    {
+      if ( strcmp ( plan[i].word,
+                    esc_file_word ( filename ) ) == 0 )
+      {
+        return TRUE ;					// Word will exist, no visit
+      }
+    }
+  }
+  if ( planc == MAXPLAN || plandepth == MAXDEPTH )	// Room in plan?
+  {
+    user_error ( "Upload plan too large" ) ;		// No, show error
+    return FALSE ;
+  }
+  me = planc++ ;					// New entry in plan
+  pl = &plan[me] ;
+  strcpy ( pl->file, p ) ;				// Fill entry
+  strncpy ( pl->word, esc_file_word ( filename ),
+            sizeof(pl->word) - 1 ) ;
+  pl->word[sizeof(pl->word) - 1] = '\0' ;
+  pl->depth = plandepth ;
+  pl->conditional = conditional ;
+  pl->lines = pl->bytes = pl->skipped = 0 ;
+  fp = fopen ( pl->file, "r" ) ;			// Open the file
+  if ( fp == NULL )
+  {
+    user_error ( "Unable to open %s", pl->file ) ;
+    return FALSE ;
+  }
+  planstack[plandepth++] = me ;				// On the stack for cycle detection
+  while ( result && fgets ( line, sizeof(line), fp ) )	// Read next line from file
+  {
+    lineno++ ;
+    len_1 = strlen ( line ) - 1 ;			// Get length of line - 1
+    if ( len_1 <= 0 )					// Skip empty lines
+    {
+      continue ;
+    }
+    if ( line[len_1] == '\n' )				// Same conversion as esc_include
+    {
+      line[len_1] = '\r' ;
+    }
+    else
+    {
+      strcat ( line, "\r" ) ;
+    }
+    if ( ( cres = cond_line ( &cond, line ) ) )		// Left out by [IF]?
+    {
+      if ( cres == COND_SKIP )
+      {
+        pl->skipped++ ;					// Count for the plan
+      }
+      continue ;
+    }
+    if ( strstr ( line, "\\\\" ) == line )		// Line starts with double backslash?
+    {
+      break ;						// Yes, skip rest of file
+    }
+    if ( strstr ( line, "\\res" ) == line )		// Line starts with "\res"?
+    {
+      p = gettoken ( line, 1 ) ;			// Check resource file
+      if ( chk_active && p &&				// Exported symbols are target words
+           strcasecmp ( p, "export" ) == 0 )
+      {
+        for ( i = 2 ; ( p = gettoken ( line, i ) ) ; i++ )
+        {
+          word_add ( &wdefined, p ) ;
+        }
+        continue ;
+      }
+      if ( p && strcasecmp ( p, "MCU:" ) == 0 &&
+           ( p = gettoken ( line, 2 ) ) )
+      {
+        snprintf ( cpu, sizeof(cpu), "%s.efr", p ) ;
+        if ( ( p = search_file ( cpu ) ) == NULL )
+        {
+          user_error ( "%s not found (%s line %d)",
+                       cpu, pl->file, lineno ) ;
+          result = FALSE ;
+        }
+        else
+        {
+          result = esc_load_res ( &ses, p ) ;		// Symbols for [IF], as in the upload
+        }
+      }
+      else if ( p && strcasecmp ( p, "export" ) != 0 )	// Symbol defined by "equ"?
+      {
+        result = esc_handle_res ( &ses, line ) ;	// Nothing sent to the target
+      }
+      continue ;
+    }
+    if ( strstr ( line, "#keep" ) == line )		// Entry words for tree shaking?
+    {
+      for ( i = 1 ; shk_on && ( p = gettoken ( line, i ) ) ; i++ )
+      {
+        shake_reach ( p ) ;
+      }
+      continue ;
+    }
+    if ( line[0] == '\\' )				// Comment line?
+    {
+      continue ;					// Yes, not sent
+    }
+    rcond = ( strstr ( line, "#require" ) == line ) ;	// Starts with "#require"?
+    if ( rcond ||
+         strstr ( line, "#include" ) == line )		// Or starts with "#include"?
+    {
+      p = gettoken ( line, 1 ) ;			// Get parameter (=filename)
+      if ( p )
+      {
+        strcpy ( param, p ) ;				// Copy, gettoken() is not reentrant
+        result = plan_file ( param, rcond,		// Plan recursively
+                             pl->file, lineno ) ;
+        pl = &plan[me] ;				// Entry of this file
+      }
+      continue ;
+    }
+    esc_strip_comment ( line ) ;			// Same as in esc_include
+    if ( chk_active )					// Check for undefined words?
+    {
+      check_line ( line, pl->file, lineno ) ;
+    }
+    if ( shk_on )					// Tree shaking?
+    {
+      shake_line ( line, me, lineno ) ;
+    }
+    pl->lines++ ;					// Count line
+    pl->bytes += strlen ( line ) ;
+  }
+  for ( i = 0 ; i < cond.depth ; i++ )			// All [IF]s of escom closed?
+  {
+    if ( result && cond.state[i] != COND_TARGET )
+    {
+      user_error ( "[IF] without [THEN] in %s", pl->file ) ;
+      result = FALSE ;
+    }
+  }
+  if ( shk_on )						// Definitions end in their file
+  {
+    shake_end() ;
+  }
+  plandepth-- ;
+  fclose ( fp ) ;
+  return result ;
+}
+
+
+//***************************************************************************************************
+//					M A K E _ P L A N					    *
+//***************************************************************************************************
+// Make a new upload plan for a file.  Returns FALSE if a file is missing or there is a cycle.	    *
+// With tree shaking, the unused definitions are found as well.					    *
+//***************************************************************************************************
+BOOL make_plan ( const char* filename, BOOL conditional )
+{
+  BOOL result ;						// Function result
+
+  planc = 0 ;						// Start with an empty plan
+  plandepth = 0 ;
+  if ( shk_on )						// Tree shaking?
+  {
+    shake_start() ;
+  }
+  result = plan_file ( filename, conditional, "console", 0 ) ;
+  if ( result && shk_on )
+  {
+    shake_resolve() ;
+  }
+  return result ;
+}
+
+
+//***************************************************************************************************
+//					S H O W _ P L A N					    *
+//***************************************************************************************************
+// Show the upload plan with line and byte counts and an estimated upload time.  The estimate	    *
+// counts the bytes sent and echoed by the target (10 bits per byte) and a fixed processing time    *
+// per line.  Conditional files are counted as if they must be uploaded.			    *
+//***************************************************************************************************
+void show_plan()
+{
+  int lines = 0 ;					// Total number of lines
+  int bytes = 0 ;					// Total number of bytes
+  int skipped = 0 ;					// Total number of lines left out by [IF]
+  int ms ;						// Estimated time
+  int i ;						// Index in plan
+
+  print_sep() ;
+  printf ( "  # Lines   Bytes File\n" ) ;			// Header
+  printf ( "--- ----- ------- ------------------------\n" ) ;
+  for ( i = 0 ; i < planc ; i++ )
+  {
+    printf ( "%3d %5d %7d %*s%s%s\n", i + 1,
+             plan[i].lines, plan[i].bytes,
+             plan[i].depth * 2, "", plan[i].file,
+             plan[i].conditional ? " (require)" : "" ) ;
+    lines += plan[i].lines ;
+    bytes += plan[i].bytes ;
+    skipped += plan[i].skipped ;
+  }
+  ms = (int)( ( 2LL * bytes * 10 * 1000 ) / baudrate ) +	// Time for sending and echo
+       lines * LINEMSEC ;				// and for processing
+  printf ( "Total %d files, %d lines, %d bytes, "
+           "estimated %d.%d sec at %d baud\n",
+           planc, lines, bytes, ms / 1000, ( ms % 1000 ) / 100,
+           baudrate ) ;
+  if ( skipped )
+  {
+    printf ( "%d lines left out by [IF]\n", skipped ) ;
+  }
+  print_sep() ;
+}
+
+
+//***************************************************************************************************
+//					U P L O A D						    *
+//***************************************************************************************************
+// Upload a file after checking the complete include tree.  Nothing is sent to the target if a	    *
+// file is missing or the tree has a cycle.							    *
+//***************************************************************************************************
+BOOL upload ( const char* filename, BOOL conditional )
+{
+  char     myfile[128] ;				// Copy of filename
+  BOOL     result ;					// Function result
+  int      i ;						// Slot in wdefined
+  LONGLONG t0 = usec_now() ;				// Start of upload, for trace
+  LONGLONG t1 ;						// Start of plan, for trace
+  int      lines0 = ses.lines ;				// Statistics at start, for trace
+  int      bytes0 = ses.bytes ;
+  int      retries0 = ver_retries ;			// Echo check statistics at start
+  int      failed0 = ver_failed ;
+
+  strncpy ( myfile, filename, sizeof(myfile) - 1 ) ;	// Filename may be in gettoken buffer
+  myfile[sizeof(myfile) - 1] = '\0' ;
+  if ( chk_on && load_words() )				// Check for undefined words?
+  {
+    check_start() ;
+  }
+  if ( fp_on )						// Footprint wanted?
+  {
+    fp_start() ;					// Yes, start counting
+  }
+  t1 = usec_now() ;
+  result = make_plan ( myfile, conditional ) ;		// Check the tree
+  chk_active = FALSE ;
+  trace_event ( "plan", myfile, t1, "\"files\":%d,\"undefined\":%d,\"left_out\":%d",
+                planc, chk_errors, shk_on ? shk_dropped : 0 ) ;
+  if ( result && chk_errors )				// Undefined words?
+  {
+    if ( chk_errors > CHKMAXERR )
+    {
+      user_error ( "%d more undefined words", chk_errors - CHKMAXERR ) ;
+    }
+    result = FALSE ;
+  }
+  if ( ! result )
+  {
+    user_error ( "Upload of %s cancelled", myfile ) ;	// Error, nothing sent
+    return FALSE ;
+  }
+  if ( ! wf_active )					// Remember for #watch-files
+  {
+    strcpy ( lastupl, myfile ) ;
+  }
+  job_paused = job_abort = FALSE ;			// Console is serviced during upload
+  job_pend[0] = '\0' ;
+  ses.compiling = FALSE ;
+  result = include_file ( myfile, conditional ) ;	// Tree is fine, upload
+  if ( *job_pend )					// Typed line still waiting?
+  {
+    writecom ( job_pend ) ;				// Yes, reply is shown by main loop
+    job_pend[0] = '\0' ;
+  }
+  trace_event ( "upload", myfile, t0, "\"lines\":%d,\"bytes\":%d,\"result\":%s",
+                ses.lines - lines0, ses.bytes - bytes0, result ? "true" : "false" ) ;
+  if ( ver_retries > retries0 || ver_failed > failed0 )	// Bad echoes?
+  {
+    text_attr ( YELLOW ) ;				// Yes, show statistics
+    printf ( "Echo check: %d lines sent again, %d failed\n",
+             ver_retries - retries0, ver_failed - failed0 ) ;
+    text_attr ( 0 ) ;
+  }
+  if ( fp_on && ! streaming )				// Footprint counted?
+  {
+    fp_report ( myfile ) ;				// Yes, show it
+  }
+  if ( trace_fp )					// Trace usable after each upload
+  {
+    fflush ( trace_fp ) ;
+  }
+  if ( result && chk_loaded && ! ses.sim )		// Uploaded words are on the target now
+  {
+    for ( i = 0 ; i < WORDHASH ; i++ )
+    {
+      if ( wdefined.w[i] &&				// Not if left out by tree shaking
+           ! ( shk_on && shake_left_out ( wdefined.w[i] ) ) )
+      {
+        word_add ( &wbuiltin, wdefined.w[i] ) ;
+      }
+    }
+  }
+  return result ;
+}
+
+
+//***************************************************************************************************
+//					W A T C H						    *
+//***************************************************************************************************
+// Live watch of variables and registers on the target.						    *
+// The parameter is a list of symbols, optionally preceded by the sample interval in milliseconds.  *
+// A symbol may have a width in bits, for example "PD_ODR:8".  The default and the largest width    *
+// is one cell.  Values are shown unsigned, as printed by U.					    *
+// Symbols in the escom dictionary are fetched by address, other names must be target words that    *
+// leave an address, like variables.  The symbols are fetched by composite lines that fit in the    *
+// TIB of the target, so a sample costs one round trip per line.  The table is updated until a key  *
+// is pressed.											    *
+//***************************************************************************************************
+BOOL watch ( const char* args )
+{
+  struct watch_t w[MAXWATCH] ;				// Watched symbols
+  int         wc = 0 ;					// Number of watched symbols
+  int         interval = 500 ;				// Sample interval in msec
+  char        cmd[MAXWATCH + 1][TIBLEN + 2] ;		// Lines to target, each fits in the TIB
+  int         cmdn[MAXWATCH + 1] ;			// Number of values fetched by each line
+  int         cmdc = 0 ;				// Number of lines
+  unsigned long vals[MAXWATCH] ;			// Values of this sample
+  BOOL        complete ;				// All values of the sample received
+  char        part[48] ;				// Fetch of one symbol
+  int         len ;					// Length of part
+  char        reply[512] ;				// Reply from target
+  char*       p ;					// Pointer in reply
+  char*       q ;					// Pointer in reply
+  const char* t ;					// Token from args
+  const char* fetch ;					// Fetch word for symbol
+  char*       colon ;					// Width separator
+  int         tinx = 1 ;				// Token index in args
+  int         i ;					// Index in w
+  int         j ;					// Index in cmd
+  int         inx ;					// Index in dictionary
+  unsigned long v ;					// Sampled value
+  int         samples = 0 ;				// Number of samples taken
+  DWORD       t0 ;					// Start of watch
+  DWORD       tprev ;					// Time of previous sample
+  DWORD       tnow ;					// Time of this sample
+  double      dt ;					// Time between samples in seconds
+  CONSOLE_SCREEN_BUFFER_INFO csbi ;			// To find the cursor position
+
+  if ( ( t = gettoken ( args, tinx ) ) && isdigit ( *t ) ) // Interval given?
+  {
+    interval = atoi ( t ) ;				// Yes, use it
+    tinx++ ;
+  }
+  strcpy ( cmd[0], "BASE @ DECIMAL" ) ;			// Output always in decimal
+  cmdn[0] = 0 ;
+  while ( wc < MAXWATCH && ( t = gettoken ( args, tinx++ ) ) )
+  {
+    strncpy ( w[wc].name, t, sizeof(w[wc].name) - 1 ) ;
+    w[wc].name[sizeof(w[wc].name) - 1] = '\0' ;
+    w[wc].bits = ses.cellbits ;				// Default width is a cell
+    if ( ( colon = strchr ( w[wc].name, ':' ) ) )	// Width given?
+    {
+      *colon++ = '\0' ;				// Yes, split name and width
+      w[wc].bits = atoi ( colon ) ;
+    }
+    if ( w[wc].bits > ses.cellbits )			// Wider than the fetch words?
+    {
+      user_error ( "Width of %s is more than a cell", w[wc].name ) ;
+      return FALSE ;
+    }
+    if ( w[wc].bits == 8 )				// Select fetch word for width
+    {
+      fetch = "C@" ;
+    }
+    else if ( w[wc].bits == 16 && ses.cellbits > 16 )
+    {
+      fetch = "H@" ;
+    }
+    else if ( w[wc].bits == 16 || w[wc].bits == 32 )
+    {
+      fetch = "@" ;
+    }
+    else
+    {
+      user_error ( "Bad width for %s", w[wc].name ) ;
+      return FALSE ;
+    }
+    inx = esc_search_dict ( &ses, w[wc].name ) ;	// Symbol in dictionary?
+    if ( inx >= 0 )
+    {
+      len = snprintf ( part, sizeof(part), " $%X %s U.",	// Yes, fetch by address
+                       ses.dict[inx].value, fetch ) ;
+    }
+    else
+    {
+      len = snprintf ( part, sizeof(part), " %s %s U.",	// No, target word leaves address
+                       w[wc].name, fetch ) ;
+    }
+    if ( strlen ( cmd[cmdc] ) + len > TIBLEN )		// Line full?
+    {
+      cmdc++ ;						// Yes, start a new one
+      cmd[cmdc][0] = '\0' ;
+      cmdn[cmdc] = 0 ;
+    }
+    strcat ( cmd[cmdc], part ) ;			// Fits, a part is less than TIBLEN
+    cmdn[cmdc]++ ;
+    w[wc].min = 0xFFFFFFFF ;
+    w[wc].max = 0 ;
+    w[wc].rate = 0.0 ;
+    wc++ ;
+  }
+  if ( wc == 0 )
+  {
+    user_error ( "No symbols to watch" ) ;
+    return FALSE ;
+  }
+  if ( strlen ( cmd[cmdc] ) + 7 > TIBLEN )		// Room for restore of base?
+  {
+    cmdc++ ;						// No, separate line
+    cmd[cmdc][0] = '\0' ;
+    cmdn[cmdc] = 0 ;
+  }
+  strcat ( cmd[cmdc++], " BASE !" ) ;			// Restore base
+  print_sep() ;
+  printf ( "Watching %d symbols every %d msec, "
+           "press a key to stop\n", wc, interval ) ;
+  printf ( "Symbol                    Value          Min          Max       Rate/s\n" ) ;
+  GetConsoleScreenBufferInfo ( hConsoleOut, &csbi ) ;	// Table starts here
+  PurgeComm ( ses.hcom, PURGE_RXCLEAR ) ;		// Discard any stale input
+  t0 = tprev = GetTickCount() ;
+  while ( ! available() )				// Until a key is pressed
+  {
+    complete = TRUE ;
+    for ( i = j = 0 ; j < cmdc ; j++ )			// Request all values, line by line
+    {
+      strcat ( cmd[j], "\r" ) ;
+      writecom ( cmd[j] ) ;
+      cmd[j][strlen ( cmd[j] ) - 1] = '\0' ;		// Echo has no CR
+      esc_read_reply ( &ses, reply, sizeof(reply), 1000 ) ;
+      if ( strchr ( reply, 0x07 ) )			// Error?
+      {
+        printf ( "%s", reply ) ;			// Yes, show reply of target
+        user_error ( "Watch failed" ) ;
+        return FALSE ;
+      }
+      p = echoFilter ( reply, cmd[j] ) ;		// Skip echoed line
+      for ( len = 0 ; len < cmdn[j] ; len++, i++ )	// Get the values of this line
+      {
+        v = strtoul ( p, &q, 10 ) ;
+        if ( q == p )					// Number found?
+        {
+          complete = FALSE ;				// No, incomplete reply
+        }
+        p = q ;
+        vals[i] = v ;
+      }
+    }
+    tnow = GetTickCount() ;
+    if ( ! complete )					// Complete sample?
+    {
+      continue ;					// No, try again
+    }
+    dt = ( tnow - tprev ) / 1000.0 ;
+    for ( i = 0 ; i < wc ; i++ )			// Statistics
+    {
+      v = vals[i] ;
+      if ( samples && dt > 0.0 )			// Rate of change, smoothed
+      {
+        w[i].rate += 0.2 * ( ( (double)v - w[i].value ) / dt - w[i].rate ) ;
+      }
+      w[i].value = v ;
+      if ( v < w[i].min )				// Track minimum
+      {
+        w[i].min = v ;
+      }
+      if ( v > w[i].max )				// and maximum
+      {
+        w[i].max = v ;
+      }
+    }
+    samples++ ;
+    tprev = tnow ;
+    SetConsoleCursorPosition ( hConsoleOut,		// Back to top of table
+                               csbi.dwCursorPosition ) ;
+    for ( i = 0 ; i < wc ; i++ )			// Show table
+    {
+      printf ( "%-20s %10lu   %10lu   %10lu   %10.1f\n",
+               w[i].name, w[i].value, w[i].min, w[i].max, w[i].rate ) ;
+    }
+    if ( tnow > t0 )
+    {
+      printf ( "%d samples, %.1f samples/sec   \n", samples,
+               samples * 1000.0 / ( tnow - t0 ) ) ;
+    }
+    tnow = GetTickCount() - tnow ;			// Time used for display
+    if ( tnow < interval )
+    {
+      Sleep ( interval - tnow ) ;			// Wait for next sample
+    }
+  }
+  FlushConsoleInputBuffer ( hConsoleIn ) ;		// Discard the key
+  print_sep() ;
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//					T I M E _ L I N E					    *
+//***************************************************************************************************
+// Send a line to the target and wait for the complete reply.  The elapsed time in microseconds    *
+// is returned in *usec.  If "value" is not NULL, the first number in the output of the line is    *
+// stored there.  Returns FALSE on an error.							    *
+//***************************************************************************************************
+BOOL time_line ( const char* line, LONGLONG* usec, long* value )
+{
+  char     reply[256] ;					// Reply from target
+  char     echo[128] ;					// Line as echoed by target
+  char*    p ;						// Output after echo
+  char*    q ;						// End of number
+  LONGLONG t0 ;						// Start time
+
+  t0 = usec_now() ;
+  writecom ( line ) ;					// Send the line
+  esc_read_reply ( &ses, reply, sizeof(reply), TIMEMAXMS ) ;	// and wait for the reply
+  *usec = usec_now() - t0 ;
+  if ( strchr ( reply, 0x07 ) ||			// Error or time-out?
+       strlen ( reply ) < 4 || ! ses.ok_chk ( reply ) )
+  {
+    printf ( "%s", reply ) ;				// Yes, show reply
+    return FALSE ;
+  }
+  if ( value )						// Number wanted?
+  {
+    strcpy ( echo, line ) ;				// Echo has no CR
+    echo[strcspn ( echo, "\r" )] = '\0' ;
+    p = echoFilter ( reply, echo ) ;			// Skip the echo
+    *value = strtol ( p, &q, 10 ) ;			// Get the number
+    if ( q == p )
+    {
+      return FALSE ;					// No number in output
+    }
+  }
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//					T I M E _ W O R D					    *
+//***************************************************************************************************
+// Measure the execution time of a word on the target.  Parameters: word, optional number of	    *
+// iterations and optional CSV file to append the result to.					    *
+// The word is executed in a loop by the helper escom-t, that is defined on the target only once.   *
+// The same loop with the empty word escom-e gives the overhead, that is subtracted.  If the	    *
+// dialect has a tick counter, the loops are timed by the target itself.  Otherwise the round trip  *
+// is timed on the host.  The measurement is repeated TIMERUNS times.				    *
+//***************************************************************************************************
+BOOL time_word ( const char* args )
+{
+  char        word[32] ;				// Word to time
+  char        csvfile[128] = "" ;			// CSV file for results
+  char        line[128] ;				// Line to target
+  const char* t ;					// Token from args
+  int         iter = 100 ;				// Number of iterations
+  double      us[TIMERUNS] ;				// Time per iteration per run
+  double      mean = 0.0 ;				// Mean time per iteration
+  double      min ;					// Minimum time per iteration
+  double      max ;					// Maximum time per iteration
+  LONGLONG    tword ;					// Time for loop with word
+  LONGLONG    tempty ;					// Time for empty loop
+  long        ticks ;					// Ticks from target
+  long        eticks ;					// Ticks for empty loop from target
+  const char* method ;					// "tick" or "host"
+  FILE*       fp ;					// CSV file
+  SYSTEMTIME  st ;					// Date and time for CSV
+  int         i ;					// Run number
+
+  if ( ( t = gettoken ( args, 1 ) ) == NULL )		// Word given?
+  {
+    user_error ( "Word missing" ) ;			// No, error
+    return FALSE ;
+  }
+  strncpy ( word, t, sizeof(word) - 1 ) ;
+  word[sizeof(word) - 1] = '\0' ;
+  if ( ( t = gettoken ( args, 2 ) ) )			// Iterations given?
+  {
+    iter = atoi ( t ) ;
+    if ( iter <= 0 )
+    {
+      iter = 1 ;
+    }
+    if ( ( t = gettoken ( args, 3 ) ) )			// CSV file given?
+    {
+      strncpy ( csvfile, t, sizeof(csvfile) - 1 ) ;	// Yes, remember
+    }
+  }
+  if ( ses.cellbits == 16 && iter > 32767 )		// Keep loop count in range
+  {
+    iter = 32767 ;
+  }
+  method = tick_word ? "tick" : "host" ;
+  PurgeComm ( ses.hcom, PURGE_RXCLEAR ) ;		// Discard any stale input
+  sprintf ( line, "' %s DROP\r", word ) ;		// Word known on target?
+  if ( ! esc_check ( &ses, line ) )
+  {
+    user_error ( "Unknown word %s", word ) ;
+    return FALSE ;
+  }
+  if ( ! esc_check ( &ses, "' escom-t DROP\r" ) )	// Helpers already defined?
+  {
+    if ( ! esc_check ( &ses, ": escom-e ;\r" ) ||	// No, define empty word
+         ! esc_check ( &ses,				// and the loop ( xt n -- )
+                       ": escom-t 0 DO DUP EXECUTE LOOP DROP ;\r" ) )
+    {
+      user_error ( "Cannot define timing loop" ) ;
+      return FALSE ;
+    }
+  }
+  printf ( "Timing %s, %d iterations, %d runs, %s timing\n",
+           word, iter, TIMERUNS, method ) ;
+  for ( i = 0 ; i < TIMERUNS ; i++ )			// Do the runs
+  {
+    if ( tick_word )					// Target has tick counter?
+    {
+      sprintf ( line, "%s ' escom-e %d escom-t %s SWAP - U.\r",	// Yes, time empty loop on target
+                tick_word, iter, tick_word ) ;
+      if ( ! time_line ( line, &tempty, &eticks ) )
+      {
+        break ;
+      }
+      sprintf ( line, "%s ' %s %d escom-t %s SWAP - U.\r",	// and the loop with the word
+                tick_word, word, iter, tick_word ) ;
+      if ( ! time_line ( line, &tword, &ticks ) )
+      {
+        break ;
+      }
+      us[i] = (double)( ticks - eticks ) * tick_us / iter ;
+    }
+    else
+    {
+      sprintf ( line, "' escom-e %d escom-t\r", iter ) ;	// Time empty loop on host
+      if ( ! time_line ( line, &tempty, NULL ) )
+      {
+        break ;
+      }
+      sprintf ( line, "' %s %d escom-t\r", word, iter ) ;	// and the loop with the word
+      if ( ! time_line ( line, &tword, NULL ) )
+      {
+        break ;
+      }
+      us[i] = (double)( tword - tempty ) / iter ;
+    }
+    mean += us[i] ;
+  }
+  if ( i < TIMERUNS )					// All runs done?
+  {
+    user_error ( "Timing of %s failed", word ) ;	// No, error
+    return FALSE ;
+  }
+  mean /= TIMERUNS ;
+  min = max = us[0] ;
+  for ( i = 1 ; i < TIMERUNS ; i++ )			// Find extremes
+  {
+    if ( us[i] < min )
+    {
+      min = us[i] ;
+    }
+    if ( us[i] > max )
+    {
+      max = us[i] ;
+    }
+  }
+  printf ( "%s: mean %.2f usec, min %.2f, max %.2f, spread %.2f usec\n",
+           word, mean, min, max, max - min ) ;
+  if ( tick_word && mean * iter < tick_us * 10 )	// Resolution of ticks good enough?
+  {
+    printf ( "Increase the number of iterations for a better resolution\n" ) ;
+  }
+  if ( *csvfile )					// Results to CSV file?
+  {
+    fp = fopen ( csvfile, "a" ) ;			// Yes, append
+    if ( fp == NULL )
+    {
+      user_error ( "Unable to open %s", csvfile ) ;
+      return FALSE ;
+    }
+    fseek ( fp, 0, SEEK_END ) ;
+    if ( ftell ( fp ) == 0 )				// New file?
+    {
+      fprintf ( fp, "date,target,word,iterations,runs,"	// Yes, write header
+                    "method,mean_us,min_us,max_us,spread_us\n" ) ;
+    }
+    GetLocalTime ( &st ) ;
+    fprintf ( fp, "%04d-%02d-%02d %02d:%02d:%02d,%s,%s,%d,%d,%s,"
+                  "%.2f,%.2f,%.2f,%.2f\n",
+              st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute,
+              st.wSecond, target, word, iter, TIMERUNS, method,
+              mean, min, max, max - min ) ;
+    fclose ( fp ) ;
+  }
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//					W F _ S T O P						    *
+//***************************************************************************************************
+// Stop watching the files of the last upload.							    *
+//***************************************************************************************************
+void wf_stop()
+{
+  while ( wf_dirc )					// Close all notifications
+  {
+    FindCloseChangeNotification ( wf_dir[--wf_dirc] ) ;
+  }
+  wf_filec = 0 ;
+  wf_changed = 0 ;
+  wf_active = FALSE ;
+}
+
+
+//***************************************************************************************************
+//					W F _ F I L E T I M E					    *
+//***************************************************************************************************
+// Get the last write time of a file.								    *
+//***************************************************************************************************
+FILETIME wf_filetime ( const char* file )
+{
+  WIN32_FILE_ATTRIBUTE_DATA fad ;			// Attributes of file
+  FILETIME                  ft = { 0 } ;		// Function result
+
+  if ( GetFileAttributesEx ( file, GetFileExInfoStandard, &fad ) )
+  {
+    ft = fad.ftLastWriteTime ;
+  }
+  return ft ;
+}
+
+
+//***************************************************************************************************
+//					W F _ S T A R T						    *
+//***************************************************************************************************
+// Start watching the files in the include tree of the last upload.  A change notification is	    *
+// registered for every directory that holds one of the files.					    *
+//***************************************************************************************************
+BOOL wf_start()
+{
+  char dir[128] ;					// Directory of a file
+  char dirs[MAXIMUM_WAIT_OBJECTS][128] ;		// Directories watched
+  char* p ;						// Last (back)slash in path
+  int  i ;						// Index in plan
+  int  j ;						// Index in dirs
+
+  wf_stop() ;						// Stop old watch
+  if ( *lastupl == '\0' )				// Was there an upload?
+  {
+    user_error ( "No upload to watch" ) ;		// No, nothing to watch
+    return FALSE ;
+  }
+  if ( ! make_plan ( lastupl, FALSE ) )			// Get the include tree
+  {
+    return FALSE ;
+  }
+  for ( i = 0 ; i < planc ; i++ )			// Register all files
+  {
+    strcpy ( wf_file[wf_filec], plan[i].file ) ;
+    wf_time[wf_filec++] = wf_filetime ( plan[i].file ) ;
+    strcpy ( dir, plan[i].file ) ;			// Isolate directory
+    p = (char*)esc_file_word ( dir ) ;
+    if ( p == dir )					// No directory in path?
+    {
+      strcpy ( dir, "." ) ;				// Yes, current directory
+    }
+    else
+    {
+      p[-1] = '\0' ;					// Cut at (back)slash
+    }
+    for ( j = 0 ; j < wf_dirc ; j++ )			// Directory already watched?
+    {
+      if ( strcmp ( dirs[j], dir ) == 0 )
+      {
+        break ;
+      }
+    }
+    if ( j == wf_dirc && wf_dirc < MAXIMUM_WAIT_OBJECTS )
+    {
+      wf_dir[wf_dirc] = FindFirstChangeNotification ( dir, FALSE,
+                          FILE_NOTIFY_CHANGE_LAST_WRITE |
+                          FILE_NOTIFY_CHANGE_FILE_NAME ) ;
+      if ( wf_dir[wf_dirc] == INVALID_HANDLE_VALUE )
+      {
+        user_error ( "Unable to watch %s", dir ) ;
+        continue ;
+      }
+      strcpy ( dirs[wf_dirc++], dir ) ;
+    }
+  }
+  wf_active = ( wf_dirc > 0 ) ;
+  if ( wf_active )
+  {
+    printf ( "Watching %d files of %s in %d directories\n",
+             wf_filec, lastupl, wf_dirc ) ;
+  }
+  return wf_active ;
+}
+
+
+//***************************************************************************************************
+//					W F _ P O L L						    *
+//***************************************************************************************************
+// Check for changes in the watched files.  Waits at most "wait" msec for a change notification.    *
+// After a quiet period the changed file is uploaded again.  If that is not the top file, only the  *
+// changed file (with its own includes) is uploaded.  If more files changed in the same period,	    *
+// the top file is uploaded, so no change is left out.						    *
+//***************************************************************************************************
+void wf_poll ( int wait )
+{
+  DWORD    r ;						// Result of wait
+  FILETIME ft ;						// Last write time of file
+  int      i ;						// Index in wf_file
+  int      changed = -1 ;				// Index of first changed file
+  int      nchanged = 0 ;				// Number of changed files
+
+  r = WaitForMultipleObjects ( wf_dirc, wf_dir, FALSE, wait ) ;
+  if ( r < WAIT_OBJECT_0 + wf_dirc )			// Change in a directory?
+  {
+    FindNextChangeNotification ( wf_dir[r - WAIT_OBJECT_0] ) ;	// Yes, rearm
+    wf_changed = GetTickCount() ;			// Start of quiet period
+    return ;
+  }
+  if ( wf_changed == 0 ||				// Change pending and quiet long enough?
+       GetTickCount() - wf_changed < WFDEBOUNCE )
+  {
+    return ;						// No, nothing to do yet
+  }
+  wf_changed = 0 ;
+  for ( i = 0 ; i < wf_filec ; i++ )			// Find changed files
+  {
+    ft = wf_filetime ( wf_file[i] ) ;
+    if ( memcmp ( &ft, &wf_time[i], sizeof(ft) ) )
+    {
+      wf_time[i] = ft ;
+      if ( changed < 0 )
+      {
+        changed = i ;
+      }
+      nchanged++ ;
+      text_attr ( GREEN ) ;
+      printf ( "%s%s changed\n", ( nchanged == 1 ) ? "\n" : "", wf_file[i] ) ;
+      text_attr ( 0 ) ;
+    }
+  }
+  if ( changed < 0 )					// Change in a watched file?
+  {
+    return ;						// No, other file in directory
+  }
+  if ( nchanged > 1 )					// More files changed?
+  {
+    changed = 0 ;					// Yes, upload everything
+  }
+  if ( changed == 0 )					// Top file changed?
+  {
+    upload ( lastupl, FALSE ) ;				// Yes, upload everything
+  }
+  else
+  {
+    upload ( wf_file[changed], FALSE ) ;		// No, start at the changed file
+  }
+  for ( i = 0 ; i < wf_filec ; i++ )			// Tree may have changed
+  {
+    if ( strcmp ( wf_file[i], plan[i].file ) )		// Same files in the plan?
+    {
+      break ;
+    }
+  }
+  if ( changed == 0 && ( i < wf_filec || planc != wf_filec ) )
+  {
+    wf_start() ;					// No, watch the new tree
+  }
+  writecom ( "\r" ) ;					// Force Forth prompt
+}
+
+
+//***************************************************************************************************
+//					F I N D _ B Y T E S					    *
+//***************************************************************************************************
+// Search for a byte pattern in a buffer.  The buffer may contain NUL bytes.			    *
+// Returns a pointer to the first match or NULL.						    *
+//***************************************************************************************************
+const char* find_bytes ( const char* buf, int len, const char* pat, int plen )
+{
+  const char* p = buf ;					// Start of search
+  const char* end = buf + len - plen ;			// Last possible start of match
+
+  while ( p <= end )
+  {
+    p = memchr ( p, *pat, end - p + 1 ) ;		// Find first byte of pattern
+    if ( p == NULL )
+    {
+      break ;
+    }
+    if ( memcmp ( p, pat, plen ) == 0 )			// Rest matches too?
+    {
+      return p ;
+    }
+    p++ ;
+  }
+  return NULL ;
+}
+
+
+//***************************************************************************************************
+//					C A P T U R E						    *
+//***************************************************************************************************
+// Capture the raw output of the target in a file.  Syntax:					    *
+//   #capture <file> [<until-pattern>|<bytes>] [-- <line to send>]				    *
+// The received bytes are written to the file as they are, including NUL bytes.  Capture stops	    *
+// after the given number of bytes, after the pattern (included in the file), after CAPIDLE msec   *
+// without data or when a key is pressed.  Only a progress counter is shown on the screen.	    *
+// The optional line is sent to the target to start the output, for example a DUMP command.	    *
+//***************************************************************************************************
+BOOL capture ( const char* args )
+{
+  static char buf[CAPBUFSIZE + 64] ;			// Receive buffer, room for pattern tail
+  char        file[128] ;				// Output file
+  char        pat[64] = "" ;				// Stop pattern
+  char        cmd[128] = "" ;				// Line to send
+  const char* t ;					// Token from args
+  const char* q ;					// Match of pattern
+  FILE*       fp ;					// Output file
+  int         plen = 0 ;				// Length of pattern
+  unsigned long limit = 0 ;				// Max number of bytes, 0 is no limit
+  unsigned long total = 0 ;				// Bytes captured
+  int         keep = 0 ;				// Bytes of previous chunk kept for match
+  DWORD       n ;					// Bytes received
+  DWORD       tlast ;					// Time of last data
+  DWORD       tshow = 0 ;				// Time of last progress report
+  DWORD       t0 ;					// Start time
+  BOOL        done = FALSE ;				// Stop condition reached
+
+  if ( ( t = gettoken ( args, 1 ) ) == NULL )		// File given?
+  {
+    user_error ( "Filename missing" ) ;			// No, error
+    return FALSE ;
+  }
+  strncpy ( file, t, sizeof(file) - 1 ) ;
+  file[sizeof(file) - 1] = '\0' ;
+  if ( ( t = strstr ( args, " -- " ) ) )		// Line to send?
+  {
+    snprintf ( cmd, sizeof(cmd), "%s", t + 4 ) ;	// Yes, copy it
+    cmd[strcspn ( cmd, "\r\n" )] = '\0' ;
+    strcat ( cmd, "\r" ) ;
+  }
+  if ( ( t = gettoken ( args, 2 ) ) && strcmp ( t, "--" ) )	// Stop condition given?
+  {
+    if ( strspn ( t, "0123456789" ) == strlen ( t ) )	// Yes, number of bytes?
+    {
+      limit = strtoul ( t, NULL, 10 ) ;			// Yes, set limit
+    }
+    else
+    {
+      strncpy ( pat, t, sizeof(pat) - 1 ) ;		// No, stop pattern
+      plen = strlen ( pat ) ;
+    }
+  }
+  fp = fopen ( file, "wb" ) ;				// Open output file
+  if ( fp == NULL )
+  {
+    user_error ( "Unable to open %s", file ) ;
+    return FALSE ;
+  }
+  setvbuf ( fp, NULL, _IOFBF, CAPBUFSIZE ) ;		// Large buffered writes
+  SetupComm ( ses.hcom, CAPBUFSIZE, 4096 ) ;		// Large driver input queue
+  PurgeComm ( ses.hcom, PURGE_RXCLEAR ) ;		// Discard any stale input
+  printf ( "Capturing to %s, press a key to stop\n", file ) ;
+  if ( *cmd )						// Line to send?
+  {
+    writecom ( cmd ) ;					// Yes, start output of target
+  }
+  t0 = tlast = GetTickCount() ;
+  while ( ! done )
+  {
+    if ( ! ReadFile ( ses.hcom, buf + keep, CAPBUFSIZE,	// Read what is there, max 50 msec
+                      &n, NULL ) )
+    {
+      user_error ( "Read error" ) ;
+      break ;
+    }
+    if ( n == 0 )					// Anything received?
+    {
+      done = ( GetTickCount() - tlast > CAPIDLE ) ;	// No, stop if idle too long
+    }
+    else
+    {
+      tlast = GetTickCount() ;
+      if ( limit && total + n >= limit )		// Byte limit reached?
+      {
+        n = limit - total ;				// Yes, cut
+        done = TRUE ;
+      }
+      if ( plen &&					// Pattern in old tail and new data?
+           ( q = find_bytes ( buf, keep + n, pat, plen ) ) )
+      {
+        n = q + plen - ( buf + keep ) ;			// Yes, stop after pattern
+        done = TRUE ;
+      }
+      fwrite ( buf + keep, 1, n, fp ) ;			// Save raw data
+      total += n ;
+      if ( plen > 1 )					// Keep tail for pattern match
+      {
+        n += keep ;					// Bytes in buffer
+        keep = ( n < plen - 1 ) ? n : plen - 1 ;
+        memmove ( buf, buf + n - keep, keep ) ;
+      }
+    }
+    if ( available() )					// Key pressed?
+    {
+      FlushConsoleInputBuffer ( hConsoleIn ) ;		// Yes, stop
+      done = TRUE ;
+    }
+    if ( done || GetTickCount() - tshow >= 200 )	// Time for progress report?
+    {
+      tshow = GetTickCount() ;
+      printf ( "\r%lu bytes", total ) ;
+    }
+  }
+  fclose ( fp ) ;
+  n = GetTickCount() - t0 ;
+  printf ( " in %lu msec\n", n ) ;
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//					C R C 1 6						    *
+//***************************************************************************************************
+// Update a CRC-16/XMODEM (polynomial $1021, start 0) with one byte.  The target helper escom-crc   *
+// computes the same CRC.									    *
+//***************************************************************************************************
+WORD crc16 ( WORD crc, BYTE b )
+{
+  int i ;						// Bit counter
+
+  crc ^= b << 8 ;
+  for ( i = 0 ; i < 8 ; i++ )
+  {
+    crc = ( crc & 0x8000 ) ? ( crc << 1 ) ^ 0x1021 : crc << 1 ;
+  }
+  return crc ;
+}
+
+
+//***************************************************************************************************
+//					H E X V A L						    *
+//***************************************************************************************************
+// Convert 2 hexadecimal digits to a value.  Returns -1 if not hexadecimal.			    *
+//***************************************************************************************************
+int hexval ( const char* p )
+{
+  char hex[3] ;						// Copy of digits
+  char* end ;						// End of conversion
+
+  if ( ! isxdigit ( p[0] ) || ! isxdigit ( p[1] ) )
+  {
+    return -1 ;
+  }
+  hex[0] = p[0] ;
+  hex[1] = p[1] ;
+  hex[2] = '\0' ;
+  return strtol ( hex, &end, 16 ) ;
+}
+
+
+//***************************************************************************************************
+//				I N S T A L L _ H E L P E R					    *
+//***************************************************************************************************
+// Install the target helper words for backup and restore, if not yet present:			    *
+//   escom-crc ( crc b -- crc' )	-- Update CRC-16 with a byte.				    *
+//   escom-h   ( n -- )		-- Print a hex digit.						    *
+//   escom-b   ( b -- )		-- Print the low byte of b in hex.				    *
+//   escom-rd  ( a n -- )		-- Print n bytes in hex and the CRC-16 of them.		    *
+//   escom-wr  ( bn..b1 a n -- )	-- Store n bytes, b1 at address a.			    *
+// The hex digits are made by hand: pictured output takes a double on mecrisp and zepto, but a	    *
+// single cell on stm8ef.									    *
+//***************************************************************************************************
+BOOL install_helper()
+{
+  const char* defs[] =					// Definitions, short lines for small TIBs
+  {
+    ": escom-crc 256 * XOR 8 0 DO DUP $8000 AND\r",
+    "IF 2* $1021 XOR ELSE 2* THEN LOOP $FFFF AND ;\r",
+    ": escom-h DUP 9 > IF 7 + THEN 48 + EMIT ;\r",
+    ": escom-b 255 AND 16 /MOD escom-h escom-h ;\r",
+    ": escom-rd 0 ROT ROT OVER + SWAP\r",
+    "DO I C@ DUP escom-b escom-crc LOOP\r",
+    "SPACE DUP 8 0 DO 2/ LOOP escom-b escom-b ;\r",
+    NULL
+  } ;
+  char line[80] ;					// Definition of escom-wr
+  int  i ;						// Index in defs
+
+  if ( esc_check ( &ses, "' escom-wr DROP\r" ) )	// Already installed?
+  {
+    return TRUE ;					// Yes, nothing to do
+  }
+  for ( i = 0 ; defs[i] ; i++ )				// Send the definitions
+  {
+    if ( ! esc_check ( &ses, defs[i] ) )
+    {
+      user_error ( "Unable to install helper" ) ;
+      return FALSE ;
+    }
+  }
+  sprintf ( line, ": escom-wr 0 DO DUP I + ROT SWAP %s LOOP DROP ;\r",
+            store_word ) ;
+  if ( ! esc_check ( &ses, line ) )
+  {
+    user_error ( "Unable to install helper" ) ;
+    return FALSE ;
+  }
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//					R E A D _ C H U N K					    *
+//***************************************************************************************************
+// Read a chunk of target memory with the helper.  The CRC is checked, and the chunk is read again  *
+// if it does not match.  The number of retransmits is added to *retries.			    *
+// Returns FALSE if the chunk could not be read correctly.					    *
+//***************************************************************************************************
+BOOL read_chunk ( DWORD addr, int n, BYTE* data, int* retries )
+{
+  char  line[64] ;					// Line to target
+  char  reply[512] ;					// Reply of target
+  char* p ;						// Pointer in reply
+  WORD  crc ;						// CRC computed here
+  int   v ;						// Value of byte
+  int   try ;						// Attempt number
+  int   i ;						// Index in data
+
+  sprintf ( line, "$%lX %d escom-rd", addr, n ) ;
+  for ( try = 0 ; try <= BRETRY ; try++ )
+  {
+    if ( try )
+    {
+      ( *retries )++ ;					// Count retransmit
+    }
+    writecom ( line ) ;					// Send line without CR
+    writecom ( "\r" ) ;
+    esc_read_reply ( &ses, reply, sizeof(reply), 2000 ) ;
+    p = echoFilter ( reply, line ) ;			// Skip echo
+    while ( *p == ' ' )
+    {
+      p++ ;
+    }
+    crc = 0 ;
+    for ( i = 0 ; i < n ; i++ )				// Get the bytes
+    {
+      if ( ( v = hexval ( p ) ) < 0 )
+      {
+        break ;
+      }
+      data[i] = v ;
+      crc = crc16 ( crc, v ) ;
+      p += 2 ;
+    }
+    if ( i == n && *p == ' ' &&				// All bytes and CRC matches?
+         strtol ( p + 1, NULL, 16 ) == crc )
+    {
+      return TRUE ;
+    }
+  }
+  return FALSE ;
+}
+
+
+//***************************************************************************************************
+//					I H E X _ R E C O R D					    *
+//***************************************************************************************************
+// Write an Intel HEX record.									    *
+//***************************************************************************************************
+void ihex_record ( FILE* fp, int type, WORD addr, const BYTE* data, int n )
+{
+  BYTE sum ;						// Checksum
+  int  i ;						// Index in data
+
+  sum = n + ( addr >> 8 ) + ( addr & 0xFF ) + type ;
+  fprintf ( fp, ":%02X%04X%02X", n, addr, type ) ;
+  for ( i = 0 ; i < n ; i++ )
+  {
+    fprintf ( fp, "%02X", data[i] ) ;
+    sum += data[i] ;
+  }
+  fprintf ( fp, "%02X\n", (BYTE)( -sum ) ) ;
+}
+
+
+//***************************************************************************************************
+//					B A C K U P						    *
+//***************************************************************************************************
+// Read target memory into an Intel HEX file.  Syntax: #backup <start> <len> <file>		    *
+// Start and length may be decimal or hexadecimal with "$" or "0x" prefix.			    *
+//***************************************************************************************************
+BOOL backup ( const char* args )
+{
+  char        file[128] ;				// Output file
+  const char* t ;					// Token from args
+  DWORD       start ;					// Start address
+  DWORD       len ;					// Number of bytes
+  DWORD       addr ;					// Address of chunk
+  DWORD       upper = 0 ;				// Upper 16 bits of address in HEX file
+  BYTE        data[BCHUNK] ;				// Chunk of memory
+  int         n ;					// Bytes in chunk
+  int         i ;					// Index in data
+  int         retries = 0 ;				// Number of retransmits
+  DWORD       t0 ;					// Start time
+  FILE*       fp ;					// Output file
+  BOOL        result = TRUE ;				// Function result
+
+  if ( gettoken ( args, 3 ) == NULL )			// All parameters given?
+  {
+    user_error ( "Usage: #backup <start> <len> <file>" ) ;
+    return FALSE ;
+  }
+  t = gettoken ( args, 1 ) ;
+  start = strtoul ( *t == '$' ? t + 1 : t, NULL, *t == '$' ? 16 : 0 ) ;
+  t = gettoken ( args, 2 ) ;
+  len = strtoul ( *t == '$' ? t + 1 : t, NULL, *t == '$' ? 16 : 0 ) ;
+  strncpy ( file, gettoken ( args, 3 ), sizeof(file) - 1 ) ;
+  file[sizeof(file) - 1] = '\0' ;
+  PurgeComm ( ses.hcom, PURGE_RXCLEAR ) ;		// Discard any stale input
+  if ( ! install_helper() )				// Helper on target?
+  {
+    return FALSE ;
+  }
+  fp = fopen ( file, "w" ) ;
+  if ( fp == NULL )
+  {
+    user_error ( "Unable to open %s", file ) ;
+    return FALSE ;
+  }
+  t0 = GetTickCount() ;
+  for ( addr = start ; addr < start + len ; addr += n )	// Read all chunks
+  {
+    n = ( start + len - addr < BCHUNK ) ? start + len - addr : BCHUNK ;
+    if ( ! read_chunk ( addr, n, data, &retries ) )
+    {
+      user_error ( "\nUnable to read at $%lX", addr ) ;
+      result = FALSE ;
+      break ;
+    }
+    for ( i = 0 ; i < n ; i += 16 )			// Write records of 16 bytes
+    {
+      if ( ( ( addr + i ) >> 16 ) != upper )		// Beyond 64 KB?
+      {
+        BYTE ela[2] ;					// Extended linear address
+        upper = ( addr + i ) >> 16 ;
+        ela[0] = upper >> 8 ;
+        ela[1] = upper & 0xFF ;
+        ihex_record ( fp, 4, 0, ela, 2 ) ;
+      }
+      ihex_record ( fp, 0, ( addr + i ) & 0xFFFF, data + i,
+                    ( n - i < 16 ) ? n - i : 16 ) ;
+    }
+    printf ( "\r%lu of %lu bytes", addr + n - start, len ) ;
+  }
+  ihex_record ( fp, 1, 0, NULL, 0 ) ;			// End of file record
+  fclose ( fp ) ;
+  printf ( "\n%lu bytes in %lu msec, %d retransmits\n",
+           addr - start, GetTickCount() - t0, retries ) ;
+  return result ;
+}
+
+
+//***************************************************************************************************
+//					R E S T O R E						    *
+//***************************************************************************************************
+// Write an Intel HEX file to target memory.  Syntax: #restore <file>				    *
+// A record with a bad checksum or a length that does not match its count stops the restore.	    *
+// Every chunk is read back and compared by CRC.  A chunk that does not match is written again.    *
+// Flash that cannot be written twice (cflash! of mecrisp and zepto) is read first: a chunk that    *
+// is already there is skipped, and a chunk over flash that is not erased is an error.  Erasing is  *
+// left to the user, as the page size depends on the chip.					    *
+//***************************************************************************************************
+BOOL restore ( const char* args )
+{
+  char        line[256] ;				// Line from HEX file / to target
+  char        reply[256] ;				// Reply of target
+  const char* t ;					// Token from args
+  FILE*       fp ;					// Input file
+  BYTE        rec[256] ;				// Data of HEX record
+  BYTE        check[RCHUNK] ;				// Data read back
+  int         n ;					// Bytes in record
+  int         c ;					// Bytes in chunk
+  int         i ;					// Index in rec
+  int         j ;					// Index in chunk
+  int         v ;					// Value of byte
+  int         type ;					// Record type
+  int         len ;					// Number of hex digits in record
+  int         sum ;					// Sum of the bytes of the record
+  int         lineno = 0 ;				// Line number in HEX file
+  int         try ;					// Attempt number
+  DWORD       addr ;					// Address of chunk
+  DWORD       upper = 0 ;				// Upper 16 bits of address
+  DWORD       total = 0 ;				// Bytes written or already there
+  int         retries = 0 ;				// Number of retransmits
+  DWORD       t0 ;					// Start time
+  BOOL        result = TRUE ;				// Function result
+
+  if ( ( t = gettoken ( args, 1 ) ) == NULL )		// File given?
+  {
+    user_error ( "Filename missing" ) ;
+    return FALSE ;
+  }
+  fp = fopen ( t, "r" ) ;
+  if ( fp == NULL )
+  {
+    user_error ( "Unable to open %s", t ) ;
+    return FALSE ;
+  }
+  PurgeComm ( ses.hcom, PURGE_RXCLEAR ) ;		// Discard any stale input
+  if ( ! install_helper() )				// Helper on target?
+  {
+    fclose ( fp ) ;
+    return FALSE ;
+  }
+  if ( store_pre )					// Unlock flash
+  {
+    esc_check ( &ses, store_pre ) ;
+  }
+  t0 = GetTickCount() ;
+  while ( result && fgets ( line, sizeof(line), fp ) )	// Read next record
+  {
+    lineno++ ;
+    if ( line[0] != ':' )				// Skip non-records
+    {
+      continue ;
+    }
+    len = strcspn ( line + 1, "\r\n" ) ;		// Count, address, type, data, checksum
+    for ( i = sum = 0 ; i < len / 2 ; i++ )		// Bytes of the record add up to 0
+    {
+      if ( ( v = hexval ( line + 1 + 2 * i ) ) < 0 )
+      {
+        break ;
+      }
+      sum += v ;
+    }
+    n = hexval ( line + 1 ) ;
+    if ( i < len / 2 || n < 0 || len != 2 * ( n + 5 ) || ( sum & 0xFF ) )
+    {
+      user_error ( "Bad record in %s line %d", t, lineno ) ;
+      result = FALSE ;
+      break ;
+    }
+    addr = ( hexval ( line + 3 ) << 8 ) | hexval ( line + 5 ) ;
+    type = hexval ( line + 7 ) ;
+    for ( i = 0 ; i < n ; i++ )				// Get data of record, checked above
+    {
+      rec[i] = hexval ( line + 9 + 2 * i ) ;
+    }
+    if ( type == 1 )					// End of file?
+    {
+      break ;
+    }
+    if ( type == 4 && n == 2 )				// Extended linear address?
+    {
+      upper = ( rec[0] << 8 ) | rec[1] ;
+      continue ;
+    }
+    if ( type != 0 )					// Only data records
+    {
+      continue ;
+    }
+    addr |= upper << 16 ;
+    for ( i = 0 ; result && i < n ; i += c )		// Write in chunks
+    {
+      c = ( n - i < RCHUNK ) ? n - i : RCHUNK ;
+      if ( store_erased )				// Flash must be erased?
+      {
+        if ( ! read_chunk ( addr + i, c, check, &retries ) )
+        {
+          user_error ( "\nUnable to read at $%lX", addr + i ) ;
+          result = FALSE ;
+          break ;
+        }
+        if ( memcmp ( check, rec + i, c ) == 0 )	// Already there?
+        {
+          total += c ;					// Yes, skip
+          continue ;
+        }
+        for ( j = 0 ; j < c && check[j] == 0xFF ; j++ ) ;	// Erased?
+        if ( j < c )
+        {
+          user_error ( "\nFlash at $%lX is not erased", addr + i + j ) ;
+          result = FALSE ;
+          break ;
+        }
+      }
+      for ( try = 0 ; try <= BRETRY ; try++ )
+      {
+        line[0] = '\0' ;
+        for ( j = c - 1 ; j >= 0 ; j-- )		// Last byte first, first byte on top
+        {
+          sprintf ( line + strlen ( line ), "$%X ", rec[i + j] ) ;
+        }
+        sprintf ( line + strlen ( line ), "$%lX %d escom-wr\r", addr + i, c ) ;
+        writecom ( line ) ;
+        esc_read_reply ( &ses, reply, sizeof(reply), 2000 ) ;
+        if ( ! strchr ( reply, 0x07 ) &&		// Written and read back correctly?
+             read_chunk ( addr + i, c, check, &retries ) &&
+             memcmp ( check, rec + i, c ) == 0 )
+        {
+          break ;
+        }
+        retries++ ;
+      }
+      if ( try > BRETRY )
+      {
+        user_error ( "\nUnable to write at $%lX", addr + i ) ;
+        result = FALSE ;
+      }
+      else
+      {
+        total += c ;					// Count only what is written
+      }
+    }
+    printf ( "\r%lu bytes", total ) ;
+  }
+  if ( store_post )					// Lock flash again
+  {
+    esc_check ( &ses, store_post ) ;
+  }
+  fclose ( fp ) ;
+  printf ( "\n%lu bytes in %lu msec, %d retransmits\n",
+           total, GetTickCount() - t0, retries ) ;
+  return result ;
+}
+
+
+//***************************************************************************************************
+//					S T R E A M _ F I L E					    *
+//***************************************************************************************************
+// Upload a file in streaming mode and show some statistics.					    *
+//***************************************************************************************************
+BOOL stream_file ( const char* filename )
+{
+  DWORD t0 ;						// Start time of upload
+  DWORD ms ;						// Duration of upload
+  BOOL  result ;					// Function result
+
+  if ( strcasecmp ( flowctl, "none" ) == 0 )		// Flow control configured?
+  {
+    text_attr ( YELLOW ) ;				// No, target may be overrun
+    printf ( "Warning: no flow control, see -f option\n" ) ;
+    text_attr ( 0 ) ;
+  }
+  ses.lines = ses.bytes = 0 ;				// Clear statistics
+  str_sent = str_done = str_plen = 0 ;			// Nothing in flight
+  t0 = GetTickCount() ;
+  PurgeComm ( ses.hcom, PURGE_RXCLEAR ) ;		// Discard any stale input
+  streaming = TRUE ;
+  result = upload ( filename, FALSE ) ;			// Upload the file
+  if ( result )
+  {
+    result = stream_sync ( 0 ) ;			// Wait for the last replies
+  }
+  streaming = FALSE ;
+  if ( ! result )
+  {
+    user_error ( "\nError in %s, line %d",		// Show location of error
+                 ses.errfile, ses.errline ) ;
+  }
+  ms = GetTickCount() - t0 ;
+  printf ( "\n%d lines, %d bytes in %lu msec",		// Show statistics
+           ses.lines, ses.bytes, ms ) ;
+  if ( ms )
+  {
+    printf ( ", %lu bytes/sec, line rate %d bytes/sec",
+             ses.bytes * 1000UL / ms, baudrate / 10 ) ;
+  }
+  printf ( "\n" ) ;
+  return result ;
+}
+
+
+//***************************************************************************************************
+//					S H O W _ F I L E					    *
+//***************************************************************************************************
+// Show a source file.										    *
+//***************************************************************************************************
+BOOL show_file ( const char* filename )
+{
+  char        line[128] ;				// Input buffer for 1 line
+  FILE*       fp ;					// File handle
+  fp = fopen ( filename, "r" ) ;			// Open the file
+  if ( fp == NULL)					// Success?
+  {
+    user_error ( "Unable to open %s", filename ) ;	// No, show error
+    return FALSE ;
+  }
+  print_sep() ;						// Print separation line
+  while ( fgets ( line, sizeof(line), fp ) != NULL )
+  {
+    printf ( "%s", line ) ;
+  }
+  fclose ( fp ) ;					// Close input file
+  printf ( "\n" ) ;					// Extra newline
+  print_sep() ;						// Print separation line
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//					T E S T _ N O R M					    *
+//***************************************************************************************************
+// Normalize output for comparison: white space is collapsed to one space, leading and trailing    *
+// white space is removed.									    *
+//***************************************************************************************************
+void test_norm ( char* str )
+{
+  char* s ;						// Source
+  char* d = str ;					// Destination
+  BOOL  space = FALSE ;					// White space before the next character
+
+  for ( s = str ; *s ; s++ )
+  {
+    if ( isspace ( (BYTE)*s ) )				// White space?
+    {
+      space = ( d != str ) ;				// Yes, not at the start
+      continue ;
+    }
+    if ( space )					// One space in between
+    {
+      *d++ = ' ' ;
+      space = FALSE ;
+    }
+    *d++ = *s ;
+  }
+  *d = '\0' ;
+}
+
+
+//***************************************************************************************************
+//					T E S T _ S E N D					    *
+//***************************************************************************************************
+// Send a line of tests and return the output of the target in out, without the echo and the	    *
+// reply phrase of the dialect.  A line that leaves the target compiling ends without a reply	    *
+// phrase.  The time of the exchange is returned in *usec.  Returns FALSE if the target reported    *
+// an error or did not answer, the reply is in out then.					    *
+//***************************************************************************************************
+BOOL test_send ( const char* code, char* out, int size, LONGLONG* usec )
+{
+  char     line[TESTLINE + 2] ;				// Line to target
+  char     reply[512] ;					// Reply of target
+  char*    p ;						// Output after echo
+  char*    ok ;						// Reply phrase at the end
+  LONGLONG t0 ;						// Start time
+
+  snprintf ( line, sizeof(line), "%s\r", code ) ;
+  t0 = usec_now() ;
+  writecom ( line ) ;					// Send the line
+  esc_read_reply ( &ses, reply, sizeof(reply), TESTMAXMS ) ;	// and wait for the reply
+  *usec = usec_now() - t0 ;
+  trace_event ( "test", code, t0, "\"bytes\":%d", (int)strlen ( line ) ) ;
+  if ( ( ok = ses.ok_chk ( reply ) ) == NULL && ses.compiling )	// No "ok" while compiling
+  {
+    ok = strchr ( reply, '\n' ) ;			// End of line instead
+  }
+  if ( strchr ( reply, 0x07 ) )				// Error?
+  {
+    ses.compiling = FALSE ;				// Target has left the definition
+  }
+  if ( strchr ( reply, 0x07 ) || ok == NULL )		// Error or time-out?
+  {
+    reply[strcspn ( reply, "\x07" )] = '\0' ;		// Yes, return reply without BELL
+    p = echoFilter ( reply, (char*)code ) ;		// and without echo
+    snprintf ( out, size, "%s", *reply ? p : "no reply" ) ;
+    return FALSE ;
+  }
+  *ok = '\0' ;						// Cut reply phrase
+  p = echoFilter ( reply, (char*)code ) ;		// Skip the echo
+  snprintf ( out, size, "%s", p ) ;
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//					T E S T _ R E S U L T					    *
+//***************************************************************************************************
+// Compare the output of a test with the expected output and count the result.  A failing test is  *
+// shown with both outputs and a caret at the first difference.					    *
+//***************************************************************************************************
+void test_result ( struct teststat_t* st, struct test_t* t, char* out, BOOL error, LONGLONG usec )
+{
+  SYSTEMTIME st_time ;					// Date and time for CSV
+  BOOL       pass ;					// Test passed
+  int        i ;					// Index of first difference
+
+  test_norm ( out ) ;
+  pass = ! error && strcmp ( out, t->expect ) == 0 ;
+  st->tests++ ;
+  st->passed += pass ;
+  if ( usec > st->slowusec )				// Slowest so far?
+  {
+    st->slowusec = usec ;
+    st->slowline = t->line ;
+  }
+  if ( ! pass )						// Show failure
+  {
+    for ( i = 0 ; out[i] && out[i] == t->expect[i] ; i++ ) ;
+    text_attr ( RED ) ;
+    printf ( "%s line %d: %s\n", error ? "ERROR" : "FAIL ", t->line, t->code ) ;
+    text_attr ( 0 ) ;
+    printf ( "  expected: %s\n", t->expect ) ;
+    printf ( "  got:      %s\n", out ) ;
+    if ( ! error )
+    {
+      printf ( "            %*s^\n", i, "" ) ;
+    }
+  }
+  if ( st->csv )					// Results to CSV file?
+  {
+    GetLocalTime ( &st_time ) ;
+    fprintf ( st->csv, "%04d-%02d-%02d %02d:%02d:%02d,%s,%s,%s,%d,%s,%.0f\n",
+              st_time.wYear, st_time.wMonth, st_time.wDay, st_time.wHour,
+              st_time.wMinute, st_time.wSecond, target, device,
+              esc_file_word ( st->file ), t->line,
+              pass ? "pass" : ( error ? "error" : "fail" ), (double)usec ) ;
+  }
+}
+
+
+//***************************************************************************************************
+//					T E S T _ B A T C H					    *
+//***************************************************************************************************
+// Run a batch of tests.  The tests are sent as one line with CR between them, so the outputs are   *
+// on separate lines of the reply.  No test is run twice, unless the lines do not match up:	    *
+// - On an error the target stops the line.  The tests with a complete output line have passed or   *
+//   failed, the next one is the culprit and the tests after it have not run.  Those are sent as a  *
+//   new batch.											    *
+// - If the number of output lines does not match, a test printed CR itself.  The lines are matched *
+//   with the expected output from the start, a test may take more lines, and from the end.  If one *
+//   test is left in between, the lines in between are its output.  If more are left, only those    *
+//   are sent again one by one.									    *
+//***************************************************************************************************
+void test_batch ( struct teststat_t* st, struct test_t* t, int n )
+{
+  char     line[TESTLINE + 1] = "" ;			// Tests as one line
+  char     out[512] ;					// Output of target
+  char*    part[TESTBATCH] ;				// Output per test
+  char*    p ;						// Pointer in out
+  int      parts = 0 ;					// Number of parts
+  int      done = 0 ;					// Number of tests with a result
+  int      back = 0 ;					// Tests matched from the end
+  int      pos = 0 ;					// Next line to match from the start
+  char     joined[512] = "" ;				// Output lines of the test in between
+  LONGLONG usec ;					// Time of exchange
+  LONGLONG busec = 0 ;					// Time per test in the batch
+  BOOL     ok ;						// No error
+  int      i ;						// Index in batch
+
+  if ( n > 1 )						// More than one test?
+  {
+    for ( i = 0 ; i < n ; i++ )				// Yes, combine
+    {
+      strcat ( line, i ? " CR " : "" ) ;
+      strcat ( line, t[i].code ) ;
+    }
+    st->sent++ ;
+    ok = test_send ( line, out, sizeof(out), &usec ) ;
+    busec = usec / n ;
+    for ( p = out ; p && parts < TESTBATCH ; parts++ )	// Split in lines
+    {
+      part[parts] = p ;
+      if ( ( p = strchr ( p, '\n' ) ) )
+      {
+        *p++ = '\0' ;
+      }
+    }
+    if ( ! ok )						// Error, last part is of the culprit
+    {
+      done = ( parts - 1 < n - 1 ) ? parts - 1 : n - 1 ;
+      for ( i = 0 ; i < done ; i++ )			// Tests before the culprit
+      {
+        test_result ( st, &t[i], part[i], FALSE, busec ) ;
+      }
+      test_result ( st, &t[done], part[done], TRUE, busec ) ;
+      if ( ++done < n )					// Rest has not run yet
+      {
+        test_batch ( st, t + done, n - done ) ;
+      }
+      return ;
+    }
+    if ( p == NULL && parts == n )			// One line per test?
+    {
+      for ( i = 0 ; i < n ; i++ )
+      {
+        test_result ( st, &t[i], part[i], FALSE, busec ) ;
+      }
+      return ;
+    }
+    for ( i = 0 ; i < parts ; i++ )
+    {
+      test_norm ( part[i] ) ;
+    }
+    while ( done < n && pos < parts )			// Lines as expected from the start
+    {
+      joined[0] = '\0' ;
+      for ( i = pos ; i < parts ; i++ )			// Output of a test may take more lines
+      {
+        snprintf ( joined + strlen ( joined ), sizeof(joined) - strlen ( joined ), "%s%s",
+                   *joined ? " " : "", part[i] ) ;
+        if ( strcmp ( joined, t[done].expect ) == 0 )
+        {
+          break ;
+        }
+      }
+      if ( i == parts )					// Not as expected?
+      {
+        break ;
+      }
+      test_result ( st, &t[done++], joined, FALSE, busec ) ;
+      pos = i + 1 ;
+    }
+    while ( back < n - done && back < parts - pos &&	// and from the end
+            strcmp ( part[parts - 1 - back], t[n - 1 - back].expect ) == 0 )
+    {
+      back++ ;
+    }
+    if ( done + back == n - 1 )				// One test in between?
+    {
+      joined[0] = '\0' ;
+      for ( i = pos ; i < parts - back ; i++ )		// Yes, it has the lines in between
+      {
+        snprintf ( joined + strlen ( joined ), sizeof(joined) - strlen ( joined ), "%s%s",
+                   *joined ? " " : "", part[i] ) ;
+      }
+      test_result ( st, &t[done++], joined, FALSE, busec ) ;
+    }
+  }
+  for ( i = done ; i < n - back ; i++ )			// Others one by one
+  {
+    st->sent++ ;
+    ok = test_send ( t[i].code, out, sizeof(out), &usec ) ;
+    test_result ( st, &t[i], out, ! ok, usec ) ;
+  }
+  for ( i = n - back ; i < n ; i++ )			// Tests matched from the end
+  {
+    test_result ( st, &t[i], part[i - n + parts], FALSE, busec ) ;
+  }
+}
+
+
+//***************************************************************************************************
+//					T E S T _ F I L E					    *
+//***************************************************************************************************
+// Run the regression tests in a file.  A test is a line with the expected output after "\>":	    *
+//    1 2 3 + + .  \> 6										    *
+// "\>" is not a Forth word: an upload of the file with #include strips it with the rest of the	    *
+// line, like any backslash comment.  Other lines are sent as they are, for setting up the tests,   *
+// and must not give an error.  Comment lines are skipped.  The code is sent unchanged, only the    *
+// output of the target is compared after normalizing white space.				    *
+// Tests are sent in batches, see test_batch().  The optional second parameter is a CSV file to	    *
+// append the results to, one line per test.  Returns FALSE if a test failed.			    *
+//***************************************************************************************************
+BOOL test_file ( const char* args )
+{
+  char              testfile[128] ;			// Test file
+  char              csvfile[128] = "" ;			// CSV file for results
+  char              line[256] ;				// Line from file
+  char              out[512] ;				// Output of setup line
+  struct test_t     batch[TESTBATCH] ;			// Tests waiting to be sent
+  struct teststat_t st = { 0 } ;			// Results
+  const char*       t ;					// Token from args
+  char*             mark ;				// Position of TESTMARK in line
+  char*             p ;					// Start of code in line
+  char*             q ;					// End of code in line
+  FILE*             fp ;				// Test file
+  int               n = 0 ;				// Number of tests in batch
+  int               len = 0 ;				// Length of batch as one line
+  int               lineno = 0 ;			// Line number in test file
+  BOOL              result = TRUE ;			// Function result
+  LONGLONG          t0 = usec_now() ;			// Start of run
+  LONGLONG          usec ;				// Time of setup line
+
+  if ( ( t = gettoken ( args, 1 ) ) == NULL )		// File given?
+  {
+    user_error ( "Filename missing" ) ;
+    return FALSE ;
+  }
+  snprintf ( testfile, sizeof(testfile), "%s", t ) ;
+  if ( ( t = gettoken ( args, 2 ) ) )			// CSV file given?
+  {
+    snprintf ( csvfile, sizeof(csvfile), "%s", t ) ;
+  }
+  if ( ( t = search_file ( testfile ) ) == NULL ||	// Find and open test file
+       ( fp = fopen ( t, "r" ) ) == NULL )
+  {
+    user_error ( "Unable to open %s", testfile ) ;
+    return FALSE ;
+  }
+  st.file = testfile ;
+  if ( *csvfile )					// Results to CSV file?
+  {
+    if ( ( st.csv = fopen ( csvfile, "a" ) ) == NULL )
+    {
+      user_error ( "Unable to open %s", csvfile ) ;
+      fclose ( fp ) ;
+      return FALSE ;
+    }
+    fseek ( st.csv, 0, SEEK_END ) ;
+    if ( ftell ( st.csv ) == 0 )			// New file?
+    {
+      fprintf ( st.csv, "date,target,device,file,line,result,usec\n" ) ;	// Yes, write header
+    }
+  }
+  print_sep() ;
+  text_attr ( YELLOW ) ;
+  printf ( "Testing %s\n", testfile ) ;
+  text_attr ( 0 ) ;
+  PurgeComm ( ses.hcom, PURGE_RXCLEAR ) ;		// Discard any stale input
+  while ( result )
+  {
+    t = fgets ( line, sizeof(line), fp ) ;		// Next line, NULL at end of file
+    lineno++ ;
+    if ( t )
+    {
+      line[strcspn ( line, "\r\n" )] = '\0' ;		// Remove line end
+      for ( p = line ; isspace ( (BYTE)*p ) ; p++ ) ;	// Skip leading white space
+      if ( *p == '\0' || *p == '\\' )			// Empty or comment line?
+      {
+        continue ;					// Yes, skip
+      }
+      mark = strstr ( p, TESTMARK ) ;			// Test line?
+      if ( mark && isspace ( (BYTE)mark[-1] ) )
+      {
+        for ( q = mark ; isspace ( (BYTE)q[-1] ) ; q-- ) ;	// Yes, end of code
+        if ( q - p >= TESTLINE )			// Fits in a line?
+        {
+          user_error ( "Test too long at line %d", lineno ) ;
+          result = FALSE ;
+          break ;
+        }
+        *mark = '\0' ;					// Split code and expected output
+        if ( n > 0 && len + 4 + ( q - p ) > TESTLINE - 1 )	// Fits in batch?
+        {
+          test_batch ( &st, batch, n ) ;		// No, send batch first
+          n = len = 0 ;
+        }
+        batch[n].line = lineno ;
+        snprintf ( batch[n].code, sizeof(batch[n].code), "%.*s", (int)( q - p ), p ) ;
+        snprintf ( batch[n].expect, sizeof(batch[n].expect), "%s", mark + strlen ( TESTMARK ) ) ;
+        test_norm ( batch[n].expect ) ;
+        len += ( n ? 4 : 0 ) + strlen ( batch[n].code ) ;
+        if ( ++n < TESTBATCH )				// Batch full?
+        {
+          continue ;					// No, next line
+        }
+      }
+    }
+    if ( n )						// Send tests before setup or at end
+    {
+      test_batch ( &st, batch, n ) ;
+      n = len = 0 ;
+    }
+    if ( t == NULL )					// End of file?
+    {
+      break ;
+    }
+    if ( mark == NULL || *mark )			// Setup line?
+    {
+      st.sent++ ;
+      if ( ! test_send ( line, out, sizeof(out), &usec ) )
+      {
+        test_norm ( out ) ;				// Reply on one line
+        user_error ( "Setup failed at line %d: %s", lineno, out ) ;
+        result = FALSE ;
+      }
+    }
+  }
+  fclose ( fp ) ;
+  if ( st.csv )
+  {
+    fclose ( st.csv ) ;
+  }
+  result = result && st.passed == st.tests ;
+  text_attr ( result ? GREEN : RED ) ;
+  printf ( "%d tests, %d passed, %d failed, %d lines sent in %.2f sec\n",
+           st.tests, st.passed, st.tests - st.passed, st.sent,
+           ( usec_now() - t0 ) / 1000000.0 ) ;
+  text_attr ( 0 ) ;
+  if ( st.tests )
+  {
+    printf ( "Slowest test at line %d, %.1f msec\n", st.slowline, st.slowusec / 1000.0 ) ;
+  }
+  print_sep() ;
+  return result ;
+}
+
+
+//***************************************************************************************************
+//				S I M _ C O N N E C T						    *
+//***************************************************************************************************
+// Connect the console to the simulator, or back to the target if m is NULL.  Both keep their own   *
+// flash mode and compile state, so the modes tracked for the simulator do not leak to the target.  *
+//***************************************************************************************************
+void sim_connect ( struct esc_sim* m )
+{
+  BOOL nvm = ses.nvm ;					// Modes of the side now connected
+  BOOL comp = ses.compiling ;
+
+  if ( ( m != NULL ) != ( ses.sim != NULL ) )		// Other side?
+  {
+    ses.nvm = other_nvm ;				// Yes, swap the modes
+    ses.compiling = other_compiling ;
+    other_nvm = nvm ;
+    other_compiling = comp ;
+  }
+  ses.sim = m ;
+}
+
+
+//***************************************************************************************************
+//					S I M U L A T E						    *
+//***************************************************************************************************
+// Handle the #simulate command.  The parameter is a file, "on", "off", "reset" or NULL.	    *
+// A file is uploaded to the host-side interpreter of escomsim.c instead of the target, with the    *
+// same line stream as an upload.  Errors are reported as usual.  Afterwards the time, the final    *
+// stack and the lines that changed the stack depth are shown.  "on" connects the console to	    *
+// the simulator until "off", "reset" empties its dictionary.  The simulator keeps its words	    *
+// between commands, like a target.								    *
+//***************************************************************************************************
+BOOL simulate ( const char* p )
+{
+  BOOL     attached = ( ses.sim != NULL ) ;		// Console is connected to the simulator
+  BOOL     loaded = chk_loaded ;			// Target words known before
+  BOOL     result ;					// Function result
+  LONGLONG t0 ;						// Start of upload
+  LONGLONG steps0 ;					// Statistics at start
+  int      lines0, errors0 ;
+  int      i ;						// Index in stack or effects
+
+  if ( sim == NULL )					// First use?
+  {
+    if ( ( sim = malloc ( sizeof(struct esc_sim) ) ) == NULL )
+    {
+      user_error ( "Not enough memory for the simulator" ) ;
+      return FALSE ;
+    }
+    esc_sim_init ( sim, target ) ;
+  }
+  if ( p == NULL )					// Show status?
+  {
+    printf ( "Simulator for %s with %d bits cells is %s, %d words, %d lines, %d errors\n",
+             target, sim->cellbits, attached ? "connected" : "not connected",
+             sim->wordc, sim->lines, sim->errors ) ;
+    return TRUE ;
+  }
+  if ( strcasecmp ( p, "reset" ) == 0 )
+  {
+    esc_sim_init ( sim, target ) ;			// Only the primitives
+    printf ( "Simulator reset\n" ) ;
+    return TRUE ;
+  }
+  knownc = 0 ;						// Known words are for the other target
+  if ( strcasecmp ( p, "on" ) == 0 || strcasecmp ( p, "off" ) == 0 )
+  {
+    sim_connect ( ( strcasecmp ( p, "on" ) == 0 ) ? sim : NULL ) ;
+    printf ( "Console connected to %s\n", ses.sim ? "the simulator" : device ) ;
+    return TRUE ;
+  }
+  sim_connect ( sim ) ;					// Upload to the simulator
+  sim->effectc = 0 ;
+  lines0 = sim->lines ;
+  errors0 = sim->errors ;
+  steps0 = sim->totsteps ;
+  t0 = usec_now() ;
+  result = upload ( p, FALSE ) ;
+  t0 = usec_now() - t0 ;
+  if ( ! attached )					// Back to the target
+  {
+    sim_connect ( NULL ) ;
+    knownc = 0 ;
+  }
+  if ( chk_loaded && ! loaded )				// Words asked from the simulator?
+  {
+    word_clear ( &wbuiltin ) ;				// Yes, not valid for the target
+    chk_loaded = FALSE ;
+  }
+  text_attr ( result ? GREEN : RED ) ;
+  printf ( "Simulated %d lines in %.1f msec, %lld words executed, %d errors\n",
+           sim->lines - lines0, t0 / 1000.0, (long long)( sim->totsteps - steps0 ),
+           sim->errors - errors0 ) ;
+  text_attr ( 0 ) ;
+  printf ( "Stack <%d>", sim->sp ) ;
+  for ( i = 0 ; i < sim->sp ; i++ )			// Signed, like "." on the target
+  {
+    printf ( " %d", ( sim->cellbits == 16 ) ? (SHORT)sim->ds[i] : (int)sim->ds[i] ) ;
+  }
+  printf ( "\n" ) ;
+  if ( sim->effectc )
+  {
+    printf ( "%d lines outside definitions changed the stack depth:\n", sim->effectc ) ;
+    for ( i = 0 ; i < sim->effectc && i < ESC_SIMEFFECTS ; i++ )
     {
-      word++ ;						// Skip over (back)slash
+      printf ( "  %d -> %d  %s\n", sim->effects[i].before, sim->effects[i].after,
+               sim->effects[i].line ) ;
     }
-    sprintf ( wordtest, "\' %s DROP\r", word ) ;	// Format a test for this word
-    if ( forth_check ( wordtest ) )			// Send to target and check result
+  }
+  print_sep() ;
+  return result ;
+}
+
+
+//***************************************************************************************************
+//				H A N D L E _ S P E C I A L					    *
+//***************************************************************************************************
+// Handle console commands starting with "#".							    *
+// The next commands are supported:								    *
+//   "ls"      -- List the files in the current directory.					    *
+//   "dir"     -- Same as "ls".									    *
+//   "cat"     -- Show a file.									    *
+//   "cd"      -- Change working directory.							    *
+//   "include" -- Include file.  Send file to serial port.					    *
+//   "i"       -- Same as "include".								    *
+//   "require" -- Insert file if word does not yet exist on the target device.			    *
+//   "r"       -- Same as "require".								    *
+//   "log"     -- Start logging to a file, "#log off" stops, "#log" shows the status.		    *
+//   "stream"  -- Upload a file without waiting for each reply, see -f option.			    *
+//   "plan"    -- Show the files that an upload of a file will send, with an estimated time.	    *
+//   "watch"   -- Show live values of symbols on the target, for example "#watch 200 PD_ODR:8".    *
+//   "time"    -- Time a word on the target, for example "#time isprime? 100 times.csv".	    *
+//   "capture" -- Capture raw output of the target in a file, for example			    *
+//		   "#capture dump.bin 8192 -- $8000 8192 DUMP".					    *
+//   "backup"  -- Save target memory in an Intel HEX file: "#backup $8000 8192 flash.hex".	    *
+//   "restore" -- Write an Intel HEX file to target memory: "#restore flash.hex".		    *
+//   "watch-files" -- Upload the last uploaded file again when one of its files is saved.	    *
+//		   "#watch-files off" stops watching.						    *
+//   "rtt"     -- Show the reply time estimates for RAM and flash mode.				    *
+//   "check"   -- Check for undefined words before upload: "#check on|off|reload".  The words of   *
+//		  the target are read from <target>.wrd in the path, or asked once with WORDS.	    *
+//   "footprint" -- Report the growth of HERE per word after each upload: "#footprint on|off" or   *
+//		   "#footprint file.csv" to keep a history too, see -F option.			    *
+//   "pause"   -- Pause a running upload.  While an upload runs, typed Forth lines are sent between  *
+//		   two of its lines, outside colon definitions.					    *
+//   "resume"  -- Resume a paused upload.							    *
+//   "abort"   -- Stop a running upload after the current colon definition.		    *
+//   "verify"  -- Check the echo of each line before its CR and send it again if it differs:	    *
+//		   "#verify on|off", "#verify" shows the statistics.  See -E option.		    *
+//   "test"    -- Run the regression tests in a file, for example "#test test.fs results.csv".	    *
+//		   A test line has the expected output after "\>": "1 2 + .  \> 3".		    *
+//   "simulate" -- Upload a file to a host-side Forth interpreter instead of the target and	    *
+//		   show errors, time and stack effects: "#simulate primes_32.fs".  "#simulate on|off" *
+//		   connects the console to the simulator or back, "#simulate reset" clears it.	    *
+//   "shake"   -- Leave out the colon definitions that the entry words do not use: "#shake w1 w2",  *
+//		   "#shake on|off", "#shake" shows the status.  See -K option.			    *
+//   "trace"   -- Write a timeline of the uploads to a file, see -T option.  "#trace off" stops,   *
+//		   "#trace" shows the status.							    *
+// Returns FALSE if the command failed.								    *
+//***************************************************************************************************
+BOOL handle_special ( const char* command )
+{
+  const char* p ;					// Pointer to 2nd token
+  char        dir[128] = "." ;				// Default directory
+  const char* fm = "Filename missing" ;			// Common error
+  BOOL        result = TRUE ;				// Function result
+  int         n ;					// Index for rtt
+
+  log_put ( '#', command, strlen ( command ) ) ;	// Log the directive
+  p = gettoken ( command, 1 ) ;				// Get parameter (path/filename)
+  if ( strstr ( command, "log" ) == command )		// "log" command?
+  {
+    if ( p == NULL )					// Yes, parameter given?
+    {
+      if ( log_active )					// No, show status
+      {
+        printf ( "Logging to %s, %ld entries lost\n",
+                 logfile, log_lost ) ;
+      }
+      else
+      {
+        printf ( "Logging is off\n" ) ;
+      }
+    }
+    else if ( strcasecmp ( p, "off" ) == 0 )		// Stop logging?
+    {
+      log_stop() ;					// Yes, stop it
+    }
+    else
     {
-      fclose ( fp ) ;					// Word existing, close input file
-      return TRUE ;					// and exit
+      strncpy ( logfile, p, sizeof(logfile) - 1 ) ;	// Set new log file
+      if ( ! log_start() )				// and start logging
+      {
+        user_error ( "Unable to log to %s", logfile ) ;
+        result = FALSE ;
+      }
     }
   }
-  // File must be included.
-  print_sep() ;						// Print separation line
-  text_attr ( YELLOW ) ;				// Info in yellow
-  printf ( "Uploading %s\n\n", myfile ) ;		// Show info
-  text_attr ( 0 ) ;					// Normal text
-  while ( fgets ( line, sizeof(line), fp ) != NULL )	// Read next line from file
+  else if ( ( strstr ( command, "ls" ) == command ) ||	// "ls" command?
+       ( strstr ( command, "dir" ) == command ) )	// or "dir" command?
   {
-    len_1 = strlen ( line ) - 1 ;			// Get length of line - 1
-    if ( len_1 > 0 )					// Protect against empty lines
+    if ( p )						// Yes, directory given?
+    {
+      strcpy ( dir, p ) ;				// Yes, change default
+    }
+    strcat ( dir, "\\" ) ;				// Add backslash
+    result = ListDirectoryContents ( dir ) ;		// Yes, list files on this directory
+  }
+  else if ( strstr ( command, "cd" ) == command )	// "cd" command?
+  {
+    if ( ( p == NULL ) ||				// Yes, directory given?
+         ( ! SetCurrentDirectory ( p ) ) )		// Yes, try to change directory
+    {
+      user_error ( "Directory does not exist" ) ;	// Did not work
+      result = FALSE ;
+    }
+  }
+  else if ( strstr ( command, "rtt" ) == command )	// "rtt" command?
+  {
+    for ( n = 0 ; n < 2 ; n++ )				// Yes, show both modes
+    {
+      printf ( "%-5s: %d samples, reply %d.%d msec, deviation %d.%d msec, "
+               "%d time-outs%s\n", n ? "flash" : "RAM", rtt[n].samples,
+               rtt[n].srtt / 1000, ( rtt[n].srtt % 1000 ) / 100,
+               rtt[n].rttvar / 1000, ( rtt[n].rttvar % 1000 ) / 100,
+               rtt[n].timeouts, n == ses.nvm ? " (current mode)" : "" ) ;
+    }
+  }
+  else if ( strstr ( command, "check" ) == command )	// "check" command?
+  {
+    if ( p && strcasecmp ( p, "off" ) == 0 )		// Yes, switch off?
+    {
+      chk_on = FALSE ;
+    }
+    else if ( p && strcasecmp ( p, "on" ) == 0 )	// Switch on?
     {
-      if ( line[len_1] == '\n' )			// Line ends with newline?
+      chk_on = TRUE ;
+    }
+    else if ( p && strcasecmp ( p, "reload" ) == 0 )	// Get target words again?
+    {
+      word_clear ( &wbuiltin ) ;
+      chk_loaded = FALSE ;
+      result = load_words() ;
+    }
+    printf ( "Check on undefined words is %s, %d target words known\n",
+             chk_on ? "on" : "off", wbuiltin.n ) ;
+  }
+  else if ( strstr ( command, "backup" ) == command )	// "backup" command?
+  {
+    result = backup ( command ) ;			// Yes, save memory
+  }
+  else if ( strstr ( command, "restore" ) == command )	// "restore" command?
+  {
+    result = restore ( command ) ;			// Yes, write memory
+  }
+  else if ( strstr ( command, "capture" ) == command )	// "capture" command?
+  {
+    result = capture ( command ) ;			// Yes, capture output
+  }
+  else if ( strstr ( command, "watch-files" ) == command ) // "watch-files" command?
+  {
+    if ( p && strcasecmp ( p, "off" ) == 0 )		// Yes, stop watching?
+    {
+      wf_stop() ;					// Yes, stop
+    }
+    else
+    {
+      result = wf_start() ;				// No, start watching
+    }
+  }
+  else if ( strstr ( command, "watch" ) == command )	// "watch" command?
+  {
+    result = watch ( command ) ;			// Yes, watch symbols
+  }
+  else if ( strstr ( command, "footprint" ) == command )	// "footprint" command?
+  {
+    if ( p && strcasecmp ( p, "off" ) == 0 )		// Yes, switch off?
+    {
+      fp_on = FALSE ;
+    }
+    else if ( p && strcasecmp ( p, "on" ) == 0 )	// Switch on?
+    {
+      fp_on = TRUE ;
+    }
+    else if ( p )					// History file?
+    {
+      strncpy ( fpfile, p, sizeof(fpfile) - 1 ) ;
+      fp_on = TRUE ;
+    }
+    printf ( "Footprint is %s, history %s\n", fp_on ? "on" : "off",
+             *fpfile ? fpfile : "off" ) ;
+  }
+  else if ( strstr ( command, "shake" ) == command )	// "shake" command?
+  {
+    if ( p && strcasecmp ( p, "off" ) == 0 )		// Yes, switch off?
+    {
+      shk_on = FALSE ;
+    }
+    else if ( p && strcasecmp ( p, "on" ) == 0 )	// Switch on?
+    {
+      shk_on = TRUE ;
+    }
+    else if ( p )					// Entry words?
+    {
+      p = command + strcspn ( command, " \t" ) ;	// Yes, all tokens after "shake"
+      p += strspn ( p, " \t" ) ;
+      snprintf ( shk_entry, sizeof(shk_entry), "%.*s", (int)strcspn ( p, "\r\n" ), p ) ;
+      shk_on = TRUE ;
+    }
+    printf ( "Tree shaking is %s, entry words: %s\n", shk_on ? "on" : "off",
+             *shk_entry ? shk_entry : "none" ) ;
+  }
+  else if ( strstr ( command, "trace" ) == command )	// "trace" command?
+  {
+    if ( p == NULL )					// Yes, parameter given?
+    {
+      if ( trace_fp )					// No, show status
       {
-        line[len_1] = '\r' ;				// Yes, change to CR
+        printf ( "Tracing to %s, %d events\n", tracefile, trace_events ) ;
       }
       else
       {
-        strcat ( line, "\r" ) ;				// No, append CR
+        printf ( "Tracing is off\n" ) ;
+      }
+    }
+    else if ( strcasecmp ( p, "off" ) == 0 )		// Stop tracing?
+    {
+      trace_stop() ;					// Yes, close the file
+    }
+    else
+    {
+      strncpy ( tracefile, p, sizeof(tracefile) - 1 ) ;	// Set new trace file
+      if ( ! trace_start() )				// and start tracing
+      {
+        user_error ( "Unable to trace to %s", tracefile ) ;
+        result = FALSE ;
+      }
+    }
+  }
+  else if ( strstr ( command, "pause" ) == command ||	// Upload commands?
+            strstr ( command, "resume" ) == command ||
+            strstr ( command, "abort" ) == command )
+  {
+    printf ( "No upload running\n" ) ;			// Yes, only during upload
+  }
+  else if ( strstr ( command, "verify" ) == command )	// "verify" command?
+  {
+    if ( p )						// Yes, on or off given?
+    {
+      ver_on = ( strcasecmp ( p, "off" ) != 0 ) ;
+    }
+    printf ( "Echo check is %s, %d lines checked, %d sent again (%.2f%%), %d failed\n",
+             ver_on ? "on" : "off", ver_lines, ver_retries,
+             ver_lines ? 100.0 * ver_retries / ver_lines : 0.0, ver_failed ) ;
+  }
+  else if ( strstr ( command, "simulate" ) == command )	// "simulate" command?
+  {
+    result = simulate ( p ) ;				// Yes, run on the host
+  }
+  else if ( strstr ( command, "test" ) == command )	// "test" command?
+  {
+    result = test_file ( command ) ;			// Yes, run the tests
+  }
+  else if ( strstr ( command, "time" ) == command )	// "time" command?
+  {
+    result = time_word ( command ) ;			// Yes, time a word
+  }
+  else if ( strstr ( command, "plan" ) == command )	// "plan" command?
+  {
+    if ( p )						// Yes, filename given?
+    {
+      result = make_plan ( p, FALSE ) ;			// Yes, make the plan
+      if ( result )
+      {
+        show_plan() ;					// and show it
+      }
+    }
+    else
+    {
+      user_error ( fm ) ;				// No, show error
+      result = FALSE ;
+    }
+  }
+  else if ( strstr ( command, "stream" ) == command )	// "stream" command?
+  {
+    if ( p )						// Yes, filename given?
+    {
+      result = stream_file ( p ) ;			// Yes, stream the file
+    }
+    else
+    {
+      user_error ( fm ) ;				// No, show error
+      result = FALSE ;
+    }
+  }
+  else if ( strstr ( command, "i" )  == command )	// "include" command?
+  {
+    if ( p )						// Yes, filename given?
+    {
+      result = upload ( p, FALSE ) ;			// Yes, include the file
+    }
+    else
+    {
+      user_error ( fm ) ;				// No, show error
+      result = FALSE ;
+    }
+  }
+  else if ( strstr ( command, "r" ) == command )	// "r" or "require" command?
+  {
+    if ( p )						// Yes, filename given?
+    {
+      result = upload ( p, TRUE ) ;			// Yes, include the file conditional
+    }
+    else
+    {
+      user_error ( fm ) ;				// No, show error
+      result = FALSE ;
+    }
+  }
+  else if ( strstr ( command, "cat" ) == command )	// "cat" command?
+  {
+    if ( p )						// Yes, filename given?
+    {
+      result = show_file ( p ) ;			// Yes, include the file
+    }
+    else
+    {
+      user_error ( fm ) ;				// No, show error
+      result = FALSE ;
+    }
+  }
+  if ( ! headless )					// Interactive?
+  {
+    writecom ( "\r" ) ;				// Yes, force Forth prompt
+  }
+  return result ;
+}
+
+
+//***************************************************************************************************
+//				S E T _ T A R G E T _ S P E C I A L S				    *
+//***************************************************************************************************
+// Set up the session with the options and set target dependant stuff.				    *
+//***************************************************************************************************
+void set_target_specials()
+{
+  esc_init ( &ses, target, ses_output, NULL ) ;		// Check for "ok" and cell size
+  ses.baudrate = baudrate ;				// Options for the port
+  strcpy ( ses.flowctl, flowctl ) ;
+  strcpy ( ses.path, path ) ;
+  ses.exchange = ses_exchange ;				// Adaptive time-out
+  if ( sim )						// Simulator made for another target?
+  {
+    esc_sim_init ( sim, target ) ;			// Yes, start again
+  }
+  tick_word = "TIM" ;					// and a 5 msec tick counter
+  tick_us = 5000 ;
+  store_word = "C!" ;					// Flash is written by C! when unlocked
+  store_pre = "ULOCKF\r" ;
+  store_post = "LOCKF\r" ;
+  store_erased = FALSE ;
+  erase_char = "\b" ;					// Backspace for the echo check
+  chk_case = TRUE ;					// Words are case sensitive
+  if ( strcasecmp ( target, "mecrisp" ) == 0 )		// Target is "mecrisp" ?
+  {
+    tick_word = NULL ;					// No standard tick counter
+    store_word = "cflash!" ;				// Flash needs a special store
+    store_pre = store_post = NULL ;
+    store_erased = TRUE ;				// and cannot be written twice
+    chk_case = FALSE ;
+  }
+  else if ( strcasecmp ( target, "zepto" ) == 0 )       // Target is "zepto" ?
+  {
+    tick_word = "systick-counter" ;			// 100 usec ticks
+    tick_us = 100 ;
+    store_word = "cflash!" ;				// Flash needs a special store
+    store_pre = store_post = NULL ;
+    store_erased = TRUE ;
+    chk_case = FALSE ;
+  }
+  word_clear ( &wbuiltin ) ;				// Words of the target are read again
+  chk_loaded = FALSE ;
+}
+
+
+//***************************************************************************************************
+//					P R O B E _ T H R E A D					    *
+//***************************************************************************************************
+// Probe one port for discovery.  An empty line is sent and the reply is checked with the "ok"	    *
+// checks of the targets, zepto first.  The result is stored in the probe_t of the port.	    *
+//***************************************************************************************************
+DWORD WINAPI probe_thread ( LPVOID param )
+{
+  struct probe_t* pr = (struct probe_t*)param ;		// Port to probe
+  HANDLE       h ;					// Handle of port
+  COMMTIMEOUTS timeouts = { 0 } ;			// Short read time-out
+  char         buf[128] ;				// Reply of target
+  DWORD        n ;					// Number of bytes read or written
+  DWORD        totread = 0 ;				// Total bytes read
+  DWORD        t0 ;					// Start time
+
+  if ( ( h = esc_open_comm ( pr->port, baudrate, flowctl ) ) == INVALID_HANDLE_VALUE )	// Open, may be in use
+  {
+    return 0 ;
+  }
+  timeouts.ReadTotalTimeoutConstant = 20 ;		// Poll every 20 msec
+  SetCommTimeouts ( h, &timeouts ) ;
+  PurgeComm ( h, PURGE_RXCLEAR ) ;
+  WriteFile ( h, "\r", 1, &n, NULL ) ;			// Harmless line
+  t0 = GetTickCount() ;
+  while ( GetTickCount() - t0 < PROBEMS && totread < sizeof(buf) - 1 )
+  {
+    if ( ! ReadFile ( h, buf + totread, sizeof(buf) - 1 - totread, &n, NULL ) )
+    {
+      break ;
+    }
+    totread += n ;
+    buf[totread] = '\0' ;
+    if ( totread < 4 || n == 0 )			// Something new to check?
+    {
+      continue ;
+    }
+    if ( esc_ok_zepto ( buf ) )				// Check zepto first, its reply
+    {							// also ends in "ok" and "\n"
+      strcpy ( pr->target, "zepto" ) ;
+    }
+    else if ( esc_ok_mecrisp ( buf ) )
+    {
+      strcpy ( pr->target, "mecrisp" ) ;
+    }
+    else if ( esc_ok_stm8ef ( buf ) )
+    {
+      strcpy ( pr->target, "stm8ef" ) ;
+    }
+    if ( pr->target[0] )				// Found?
+    {
+      break ;
+    }
+  }
+  CloseHandle ( h ) ;
+  return 0 ;
+}
+
+
+//***************************************************************************************************
+//					D I S C O V E R						    *
+//***************************************************************************************************
+// Find the target for "-d auto".  All COM ports are probed at the same time, so the discovery	    *
+// takes one probe time-out.  If more ports answer, a port with the configured target is preferred. *
+// A probe that hangs in opening its port (Bluetooth ports may do that) is not waited for.	    *
+// The device and target are set.  Returns FALSE if no target answered.			    *
+//***************************************************************************************************
+BOOL discover()
+{
+  static struct probe_t probes[MAXPROBE] ;		// Ports to probe, static for slow threads
+  HANDLE         threads[MAXPROBE] ;			// Threads of the probes
+  int            probec = 0 ;				// Number of ports
+  int            threadc = 0 ;				// Number of threads
+  char*          devs ;					// List of DOS devices
+  char*          p ;					// Device in devs
+  int            found = -1 ;				// Selected probe
+  int            i ;					// Index in probes
+
+  devs = malloc ( 65536 ) ;				// Get all DOS device names
+  if ( devs == NULL || QueryDosDevice ( NULL, devs, 65536 ) == 0 )
+  {
+    free ( devs ) ;
+    user_error ( "Unable to list the serial ports" ) ;
+    return FALSE ;
+  }
+  for ( p = devs ; *p && probec < MAXPROBE ; p += strlen ( p ) + 1 )
+  {
+    if ( strncasecmp ( p, "COM", 3 ) == 0 && isdigit ( p[3] ) &&	// Serial port?
+         strlen ( p ) < sizeof(probes[0].port) )
+    {
+      strcpy ( probes[probec].port, p ) ;
+      probes[probec].target[0] = '\0' ;
+      probes[probec].thread = CreateThread ( NULL, 0, probe_thread,
+                                             &probes[probec], 0, NULL ) ;
+      if ( probes[probec].thread )
+      {
+        threads[threadc++] = probes[probec].thread ;
       }
-      if ( strstr ( line, "\\\\" ) == line )		// Line starts with double backslash?
+      probec++ ;
+    }
+  }
+  free ( devs ) ;
+  if ( threadc )					// Wait for all probes
+  {
+    WaitForMultipleObjects ( threadc, threads, TRUE, PROBEMS + 2000 ) ;
+  }
+  for ( i = 0 ; i < probec ; i++ )			// Show and select results
+  {
+    if ( probes[i].target[0] )
+    {
+      printf ( "Found %s on %s\n", probes[i].target, probes[i].port ) ;
+      if ( found < 0 || ( strcasecmp ( probes[i].target, target ) == 0 &&
+                          strcasecmp ( probes[found].target, target ) ) )
       {
-        break ;						// Yes, skip rest of file
+        found = i ;					// First one, or first with configured target
       }
-      if ( strstr ( line, "\\res" ) == line )		// Line starts with "\res"?
+    }
+    if ( probes[i].thread )
+    {
+      CloseHandle ( probes[i].thread ) ;
+    }
+  }
+  if ( found < 0 )
+  {
+    user_error ( "No target found on %d ports", probec ) ;
+    return FALSE ;
+  }
+  strcpy ( device, probes[found].port ) ;		// Use this port
+  strcpy ( target, probes[found].target ) ;		// and target
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//					R U N _ B A T C H					    *
+//***************************************************************************************************
+// Headless batch mode.  Upload the files given by the -x options.  "-x -" reads commands from	    *
+// stdin: lines starting with "#" are handled as console commands, other lines are sent to the	    *
+// target.  Stops at the first error.  A summary line per step is printed in the form:		    *
+//   escom: file=primes_8.fs status=ok lines=25 bytes=812 ms=1530				    *
+//   escom: result=error steps=2 ms=1622 errfile=./lib/x.fs errline=12				    *
+// If the port cannot be opened, the summary is "escom: result=error steps=0 porterror=COM5".	    *
+// Returns the exit status for the program: 0 for success, 1 for an error.			    *
+//***************************************************************************************************
+int run_batch()
+{
+  char  line[256] ;					// Line from stdin or reply from target
+  DWORD t0 ;						// Start time of batch
+  DWORD t1 ;						// Start time of step
+  int   steps = 0 ;					// Number of steps done
+  BOOL  result = TRUE ;					// Result of current step
+  int   i ;						// Index in batchv
+  int   n ;						// Length of reply
+
+  t0 = GetTickCount() ;
+  PurgeComm ( ses.hcom, PURGE_RXCLEAR ) ;		// Discard any stale input
+  for ( i = 0 ; i < batchc && result ; i++ )		// Handle all -x options
+  {
+    ses.lines = ses.bytes = 0 ;				// Clear statistics
+    t1 = GetTickCount() ;
+    if ( strcmp ( batchv[i], "-" ) == 0 )		// Commands from stdin?
+    {
+      while ( result && fgets ( line, sizeof(line) - 1,	// Yes, read next command
+                                stdin ) )
       {
-        result = handle_res ( line ) ;			// Yes, handle it
-        if ( ! result )					// Check result
+        line[strcspn ( line, "\r\n" )] = '\0' ;	// Remove line delimiter
+        if ( line[0] == '\0' )				// Skip empty lines
         {
-          break ;					// Error, stop
+          continue ;
         }
-        continue ;					// Next line
-      }
-      if ( line[0] == '\\' )				// Starts with backslash?
-      {
-        text_attr ( YELLOW ) ;				// Show comments in yellow
-        printf ( "%s\n", line ) ;			// Show comment line
-        text_attr ( 0 ) ;				// Back to normal
-        continue ;					// Yes, skip
-      }
-      rcond = ( strstr ( line, "#require" ) == line ) ;	// Starts with "#require"?
-      if ( rcond ||
-           strstr ( line, "#include" ) == line )	// Or starts with "#include"?
-      {
-        text_attr ( GREEN ) ;				// Show line in green
-        writecom ( line ) ;				// Send to com port
-        text_attr ( 0 ) ;				// Color back to normal
-        p = gettoken ( line, 1 ) ;			// Get parameter (=filename)
-        if ( p )					// Filename supplied?
+        if ( line[0] == '\\' )				// End of commands?
         {
-          result = include_file ( p, rcond ) ;		// Include recursively
-          if ( ! result )				// Check result
-          {
-            break ;					// Error, stop
-          }
+          break ;					// Yes, stop reading
         }
-        continue ;					// No error, go to next line
-      }
-      strip_comment ( line ) ;				// Strip off comments at end of line
-      writecom ( line ) ;				// Send to com port
-      int n = readcom ( line, sizeof(line), 12 ) ;	// Read reply from com port
-      if ( n > 0 )					// Success?
-      {
-        if ( n > margin )				// Need to widen output ?
+        steps++ ;
+        if ( line[0] == '#' )				// Special input?
         {
-          margin = n ;					// Yes
+          result = handle_special ( line + 1 ) ;	// Yes, handle it
+          continue ;
         }
-        beautify ( line, margin ) ;
-        printf ( "%s", line ) ;				// Print result
-        if ( strchr ( line, 0x07 ) )			// BELL in the string means error
+        strcat ( line, "\r" ) ;				// Send line to target
+        ses.lines++ ;
+        ses.bytes += strlen ( line ) ;
+        n = exchange ( line, line, sizeof(line) ) ;	// Read reply
+        if ( n > 0 )
         {
-          user_error ( "\nError, abort upload" ) ;	// Show error
-          break ;
+          fputs ( line, stdout ) ;			// Show reply
+          if ( strchr ( line, 0x07 ) )			// BELL in the string means error
+          {
+            strcpy ( ses.errfile, "stdin" ) ;		// Remember location of error
+            ses.errline = steps ;
+            result = FALSE ;
+          }
         }
       }
     }
-    else						// Empty line
+    else
     {
-      printf ( "\n" ) ;					// Show empty line
+      steps++ ;
+      result = upload ( batchv[i], FALSE ) ;		// Upload the file
     }
+    printf ( "escom: file=%s status=%s lines=%d bytes=%d ms=%lu\n",
+             batchv[i], result ? "ok" : "error",
+             ses.lines, ses.bytes, GetTickCount() - t1 ) ;
   }
-  text_attr ( YELLOW ) ;				// Info in yellow
-  printf ( "\nClosing %s\n", myfile ) ;			// Show info
-  text_attr ( 0 ) ;					// Normal text
-  fclose ( fp ) ;					// Close input file
-  print_sep() ;						// Print separation line
-  return result ;					// Return the result
+  printf ( "escom: result=%s steps=%d ms=%lu",		// Final summary
+           result ? "ok" : "error", steps,
+           GetTickCount() - t0 ) ;
+  if ( ! result && *ses.errfile )			// Location of error known?
+  {
+    printf ( " errfile=%s errline=%d", ses.errfile,	// Yes, show it
+             ses.errline ) ;
+  }
+  printf ( "\n" ) ;
+  log_stop() ;						// Flush and close the log
+  return result ? 0 : 1 ;
 }
 
 
 //***************************************************************************************************
-//					S H O W _ F I L E					    *
+//					P I P E _ I O						    *
 //***************************************************************************************************
-// Show a source file.										    *
+// Server mode: read (wr is FALSE) or write a pipe instance of a client.  The instances are opened  *
+// overlapped, so the tee thread can write to a client while its client thread waits for the next   *
+// request on the same instance.  Waits at most ms msec for the end of the transfer, a transfer	    *
+// that takes longer is cancelled.  Returns FALSE on error or time-out.				    *
 //***************************************************************************************************
-BOOL show_file ( const char* filename )
+BOOL pipe_io ( HANDLE hc, BOOL wr, void* buf, DWORD len, DWORD* n, DWORD ms )
 {
-  char        line[128] ;				// Input buffer for 1 line
-  FILE*       fp ;					// File handle
-  fp = fopen ( filename, "r" ) ;			// Open the file
-  if ( fp == NULL)					// Success?
+  OVERLAPPED ov ;					// Own event for this transfer
+  BOOL       result ;					// Function result
+
+  memset ( &ov, 0, sizeof(ov) ) ;
+  if ( ( ov.hEvent = CreateEvent ( NULL, TRUE, FALSE, NULL ) ) == NULL )
   {
-    user_error ( "Unable to open %s", filename ) ;	// No, show error
     return FALSE ;
   }
-  print_sep() ;						// Print separation line
-  while ( fgets ( line, sizeof(line), fp ) != NULL )
+  result = wr ? WriteFile ( hc, buf, len, n, &ov ) : ReadFile ( hc, buf, len, n, &ov ) ;
+  if ( ! result && GetLastError() == ERROR_IO_PENDING )	// Still busy?
   {
-    printf ( "%s", line ) ;
+    if ( WaitForSingleObject ( ov.hEvent, ms ) != WAIT_OBJECT_0 )	// Yes, done in time?
+    {
+      CancelIoEx ( hc, &ov ) ;				// No, client does not read, give up
+    }
+    result = GetOverlappedResult ( hc, &ov, n, TRUE ) ;	// End of transfer or of cancel
   }
-  fclose ( fp ) ;					// Close input file
-  printf ( "\n" ) ;					// Extra newline
-  print_sep() ;						// Print separation line
-  return TRUE ;
+  CloseHandle ( ov.hEvent ) ;
+  return result ;
 }
 
 
 //***************************************************************************************************
-//				H A N D L E _ S P E C I A L					    *
+//					D R O P _ C L I E N T					    *
 //***************************************************************************************************
-// Handle console commands starting with "#".							    *
-// The next commands are supported:								    *
-//   "ls"      -- List the files in the current directory.					    *
-//   "dir"     -- Same as "ls".									    *
-//   "cat"     -- Show a file.									    *
-//   "cd"      -- Change working directory.							    *
-//   "include" -- Include file.  Send file to serial port.					    *
-//   "i"       -- Same as "include".								    *
-//   "require" -- Insert file if word does not yet exist on the target device.			    *
-//   "r"       -- Same as "require".								    *
+// Server mode: a client that does not read its output is dropped from the stream and from the	    *
+// running request, and disconnected.  Its client thread sees the end of the pipe and cleans up.    *
 //***************************************************************************************************
-void handle_special ( const char* command )
+void drop_client ( HANDLE hc )
 {
-  const char* p ;					// Pointer to 2nd token
-  char        dir[128] = "." ;				// Default directory
-  const char* fm = "Filename missing" ;			// Common error
+  int i ;						// Index in srv_clients
 
-  p = gettoken ( command, 1 ) ;				// Get parameter (path/filename)
-  if ( ( strstr ( command, "ls" ) == command ) ||	// "ls" command?
-       ( strstr ( command, "dir" ) == command ) )	// or "dir" command?
+  EnterCriticalSection ( &srv_lock ) ;
+  for ( i = 0 ; i < srv_clientc ; i++ )			// Remove from stream clients
   {
-    if ( p )						// Yes, directory given?
+    if ( srv_clients[i] == hc )
     {
-      strcpy ( dir, p ) ;				// Yes, change default
+      srv_clients[i] = srv_clients[--srv_clientc] ;
+      break ;
     }
-    strcat ( dir, "\\" ) ;				// Add backslash
-    ListDirectoryContents ( dir ) ;			// Yes, list files on this directory
   }
-  else if ( strstr ( command, "cd" ) == command )	// "cd" command?
+  if ( srv_owner == hc )				// No more output for the request
   {
-    if ( ( p == NULL ) ||				// Yes, directory given?
-         ( ! SetCurrentDirectory ( p ) ) )		// Yes, try to change directory
+    srv_owner = NULL ;
+  }
+  LeaveCriticalSection ( &srv_lock ) ;
+  DisconnectNamedPipe ( hc ) ;
+}
+
+
+//***************************************************************************************************
+//					T E E _ T H R E A D					    *
+//***************************************************************************************************
+// Server mode: forward the captured stdout to the console, to the clients attached to the console  *
+// stream and to the client that issued the running request.  The list of clients is copied, so	    *
+// srv_lock is not held during the writes.  A write that does not end within PIPEWAIT msec drops    *
+// the client.  Data is only taken from the pipe while holding tee_lock, see tee_drain().	    *
+//***************************************************************************************************
+DWORD WINAPI tee_thread ( LPVOID param )
+{
+  HANDLE hcon = (HANDLE)param ;				// Original console output
+  char   buf[1024] ;					// Data from stdout
+  HANDLE hc[MAXCLIENTS + 1] ;				// Clients to forward to, owner included
+  int    hcc ;						// Number of clients in hc
+  DWORD  avail ;					// Bytes in the pipe
+  DWORD  n ;						// Number of bytes read
+  DWORD  nw ;						// Number of bytes written
+  int    i ;						// Index in srv_clients or hc
+
+  while ( PeekNamedPipe ( tee_rd, NULL, 0, NULL, &avail, NULL ) )	// Until stdout is closed
+  {
+    if ( avail == 0 )					// Output waiting?
     {
-      user_error ( "Directory does not exist" ) ;	// Did not work
+      Sleep ( 1 ) ;					// No, try again later
+      continue ;
+    }
+    EnterCriticalSection ( &tee_lock ) ;		// Data off the pipe until forwarded
+    if ( ! ReadFile ( tee_rd, buf, ( avail < sizeof(buf) ) ? avail : sizeof(buf), &n, NULL ) )
+    {
+      LeaveCriticalSection ( &tee_lock ) ;
+      break ;
+    }
+    WriteFile ( hcon, buf, n, &nw, NULL ) ;		// Show on console
+    EnterCriticalSection ( &srv_lock ) ;		// Copy the list of clients
+    for ( hcc = 0 ; hcc < srv_clientc ; hcc++ )
+    {
+      hc[hcc] = srv_clients[hcc] ;
+    }
+    for ( i = 0 ; i < hcc && hc[i] != srv_owner ; i++ ) ;	// Owner is also stream client?
+    if ( srv_owner && i == hcc )			// No, forward to owner too
+    {
+      hc[hcc++] = srv_owner ;
     }
+    LeaveCriticalSection ( &srv_lock ) ;
+    for ( i = 0 ; i < hcc ; i++ )			// Forward, handles stay open, see client_thread
+    {
+      if ( ! pipe_io ( hc[i], TRUE, buf, n, &nw, PIPEWAIT ) )
+      {
+        drop_client ( hc[i] ) ;				// Stalled or gone
+      }
+    }
+    LeaveCriticalSection ( &tee_lock ) ;
   }
-  else if ( strstr ( command, "i" )  == command )	// "include" command?
+  return 0 ;
+}
+
+
+//***************************************************************************************************
+//					T E E _ D R A I N					    *
+//***************************************************************************************************
+// Wait until all output so far has been forwarded by the tee thread.  The tee thread takes data    *
+// off the pipe only while holding tee_lock, so an empty pipe seen under tee_lock means that	    *
+// everything is forwarded.									    *
+//***************************************************************************************************
+void tee_drain()
+{
+  DWORD avail ;						// Bytes not yet forwarded
+
+  fflush ( stdout ) ;
+  while ( TRUE )
   {
-    if ( p )						// Yes, filename given?
+    EnterCriticalSection ( &tee_lock ) ;		// Tee thread not forwarding
+    avail = 0 ;
+    PeekNamedPipe ( tee_rd, NULL, 0, NULL, &avail, NULL ) ;
+    LeaveCriticalSection ( &tee_lock ) ;
+    if ( avail == 0 )					// All forwarded?
+    {
+      break ;
+    }
+    Sleep ( 1 ) ;
+  }
+}
+
+
+//***************************************************************************************************
+//					S E R V E _ R E Q U E S T				    *
+//***************************************************************************************************
+// Handle one request from a client.  The requests are:						    *
+//   upload <file>	-- Upload a file, like #include.					    *
+//   require <file>	-- Upload a file if the word does not exist, like #require.		    *
+//   send <line>	-- Send a line to the target and show the reply.			    *
+//   stream		-- Attach to the console stream.					    *
+//   status		-- Show the state of the session.					    *
+//   forget		-- Clear the known-word cache, for example after a reset of the target.	    *
+// The output of the request is sent to the client, followed by a line with the result:	    *
+//   escom: result=ok									    *
+//***************************************************************************************************
+void serve_request ( HANDLE hc, char* req )
+{
+  char        line[256] ;				// Line for target or result
+  char        arg[128] = "" ;				// Parameter of request
+  const char* p ;					// Start of parameter
+  BOOL        result = TRUE ;				// Result of request
+  DWORD       nw ;					// Bytes written
+
+  req[strcspn ( req, "\r\n" )] = '\0' ;		// Remove line delimiter
+  if ( ( p = strchr ( req, ' ' ) ) )			// Parameter given?
+  {
+    strncpy ( arg, p + 1, sizeof(arg) - 1 ) ;		// Yes, copy it
+  }
+  if ( strstr ( req, "stream" ) == req )		// Attach to stream?
+  {
+    EnterCriticalSection ( &srv_lock ) ;
+    if ( srv_clientc < MAXCLIENTS )			// Yes, room for another?
     {
-      include_file ( p, FALSE ) ;			// Yes, include the file
+      srv_clients[srv_clientc++] = hc ;			// Yes, add
     }
     else
     {
-      user_error ( fm ) ;				// No, show error
+      result = FALSE ;
+    }
+    LeaveCriticalSection ( &srv_lock ) ;
+    if ( result )
+    {
+      return ;						// Stream clients get no result line
     }
   }
-  else if ( strstr ( command, "r" ) == command )	// "r" or "require" command?
+  else if ( strstr ( req, "status" ) == req )		// Status request?
   {
-    if ( p )						// Yes, filename given?
+    EnterCriticalSection ( &com_lock ) ;		// Session not in use
+    EnterCriticalSection ( &srv_lock ) ;
+    sprintf ( line, "escom: device=%s target=%s baud=%d clients=%d "
+                    "symbols=%d known=%d requests=%d\n",
+              device, target, baudrate, srv_clientc, ses.dinx, knownc,
+              srv_requests ) ;
+    LeaveCriticalSection ( &srv_lock ) ;
+    LeaveCriticalSection ( &com_lock ) ;
+    pipe_io ( hc, TRUE, line, strlen ( line ), &nw, PIPEWAIT ) ;
+  }
+  else if ( strstr ( req, "forget" ) == req )		// Clear cache?
+  {
+    EnterCriticalSection ( &com_lock ) ;		// Not during an upload
+    knownc = 0 ;
+    LeaveCriticalSection ( &com_lock ) ;
+  }
+  else
+  {
+    EnterCriticalSection ( &com_lock ) ;		// Get the serial port
+    EnterCriticalSection ( &srv_lock ) ;
+    srv_owner = hc ;					// Output goes to this client
+    LeaveCriticalSection ( &srv_lock ) ;
+    srv_requests++ ;
+    if ( strstr ( req, "upload" ) == req && *arg )	// Upload?
+    {
+      result = upload ( arg, FALSE ) ;
+    }
+    else if ( strstr ( req, "require" ) == req && *arg ) // Conditional upload?
+    {
+      result = upload ( arg, TRUE ) ;
+    }
+    else if ( strstr ( req, "send" ) == req && *arg )	// Send a line?
     {
-      include_file ( p, TRUE ) ;			// Yes, include the file conditional
+      snprintf ( line, sizeof(line), "%s\r", arg ) ;
+      writecom ( line ) ;
+      esc_read_reply ( &ses, line, sizeof(line), 2000 ) ;	// Wait for the reply
+      printf ( "%s", line ) ;
+      result = ( strchr ( line, 0x07 ) == NULL ) ;	// BELL in the string means error
     }
     else
     {
-      user_error ( fm ) ;				// No, show error
+      printf ( "Unknown request: %s\n", req ) ;
+      result = FALSE ;
     }
+    tee_drain() ;					// All output to the client
+    EnterCriticalSection ( &srv_lock ) ;
+    srv_owner = NULL ;
+    LeaveCriticalSection ( &srv_lock ) ;
+    LeaveCriticalSection ( &com_lock ) ;
   }
-  else if ( strstr ( command, "cat" ) == command )	// "cat" command?
+  sprintf ( line, "escom: result=%s\n", result ? "ok" : "error" ) ;
+  pipe_io ( hc, TRUE, line, strlen ( line ), &nw, PIPEWAIT ) ;
+}
+
+
+//***************************************************************************************************
+//					C L I E N T _ T H R E A D				    *
+//***************************************************************************************************
+// Server mode: serve one connected client.  Requests are lines of text.			    *
+//***************************************************************************************************
+DWORD WINAPI client_thread ( LPVOID param )
+{
+  HANDLE hc = (HANDLE)param ;				// Pipe to client
+  char   req[256] ;					// Request from client
+  int    len = 0 ;					// Length of request so far
+  char   c ;						// Character from client
+  DWORD  n ;						// Number of bytes read
+  int    i ;						// Index in srv_clients
+
+  while ( pipe_io ( hc, FALSE, &c, 1, &n, INFINITE ) && n )	// Read request
   {
-    if ( p )						// Yes, filename given?
+    if ( c == '\n' )					// End of request?
+    {
+      req[len] = '\0' ;				// Yes, handle it
+      serve_request ( hc, req ) ;
+      len = 0 ;
+    }
+    else if ( len < sizeof(req) - 1 )
+    {
+      req[len++] = c ;
+    }
+  }
+  EnterCriticalSection ( &srv_lock ) ;			// Client gone
+  for ( i = 0 ; i < srv_clientc ; i++ )			// Remove from stream clients
+  {
+    if ( srv_clients[i] == hc )
+    {
+      srv_clients[i] = srv_clients[--srv_clientc] ;
+      break ;
+    }
+  }
+  LeaveCriticalSection ( &srv_lock ) ;
+  EnterCriticalSection ( &tee_lock ) ;			// Tee thread may still write to hc
+  DisconnectNamedPipe ( hc ) ;
+  CloseHandle ( hc ) ;
+  LeaveCriticalSection ( &tee_lock ) ;
+  return 0 ;
+}
+
+
+//***************************************************************************************************
+//					L I S T E N _ T H R E A D				    *
+//***************************************************************************************************
+// Server mode: accept clients on the named pipe.  Every client is served by its own thread.	    *
+// The instances are overlapped, see pipe_io().							    *
+//***************************************************************************************************
+DWORD WINAPI listen_thread ( LPVOID param )
+{
+  HANDLE     hc ;					// Pipe instance for next client
+  HANDLE     ht ;					// Thread for client
+  OVERLAPPED ov ;					// For the wait on a client
+  DWORD      n ;					// Not used by a connect
+
+  memset ( &ov, 0, sizeof(ov) ) ;
+  ov.hEvent = CreateEvent ( NULL, TRUE, FALSE, NULL ) ;	// Manual reset event
+
+  while ( TRUE )
+  {
+    hc = CreateNamedPipe ( pipename, PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+                           PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+                           PIPE_UNLIMITED_INSTANCES, 4096, 4096, 0, NULL ) ;
+    if ( hc == INVALID_HANDLE_VALUE )
+    {
+      user_error ( "Unable to create %s", pipename ) ;
+      return 1 ;
+    }
+    if ( ConnectNamedPipe ( hc, &ov ) ||		// Wait for a client
+         GetLastError() == ERROR_PIPE_CONNECTED ||
+         ( GetLastError() == ERROR_IO_PENDING &&
+           GetOverlappedResult ( hc, &ov, &n, TRUE ) ) )
+    {
+      ht = CreateThread ( NULL, 0, client_thread, hc, 0, NULL ) ;
+      if ( ht )
+      {
+        CloseHandle ( ht ) ;				// Thread runs on its own
+        continue ;
+      }
+    }
+    CloseHandle ( hc ) ;				// Failed, try again
+  }
+  return 0 ;
+}
+
+
+//***************************************************************************************************
+//					R U N _ S E R V E R					    *
+//***************************************************************************************************
+// Server mode.  The serial port and the session (dictionary, known words) stay open, and requests  *
+// from clients are served on a named pipe.  The output of escom is captured and forwarded to the   *
+// clients.  Output from the target between requests goes to the attached stream clients.	    *
+//***************************************************************************************************
+int run_server()
+{
+  HANDLE hcon ;						// Original console output
+  HANDLE tee_wr ;					// Write side of captured stdout
+  char   combuf[256] ;					// Input from serial
+  int    n ;						// Number of bytes received
+
+  InitializeCriticalSection ( &com_lock ) ;
+  InitializeCriticalSection ( &srv_lock ) ;
+  InitializeCriticalSection ( &tee_lock ) ;
+  hcon = GetStdHandle ( STD_OUTPUT_HANDLE ) ;		// Capture stdout in a pipe
+  if ( ! CreatePipe ( &tee_rd, &tee_wr, NULL, 0 ) )
+  {
+    user_error ( "Unable to capture output" ) ;
+    return 2 ;
+  }
+  fflush ( stdout ) ;
+  _dup2 ( _open_osfhandle ( (intptr_t)tee_wr, 0 ), 1 ) ;
+  setvbuf ( stdout, NULL, _IONBF, 0 ) ;
+  CloseHandle ( CreateThread ( NULL, 0, tee_thread, hcon, 0, NULL ) ) ;
+  CloseHandle ( CreateThread ( NULL, 0, listen_thread, NULL, 0, NULL ) ) ;
+  printf ( "escom-" VERSION " serving %s on %s\n", device, pipename ) ;
+  while ( TRUE )					// Show output of target
+  {
+    EnterCriticalSection ( &com_lock ) ;
+    n = esc_read ( &ses, combuf, sizeof(combuf) - 1, 1 ) ;	// Try to read from serial
+    LeaveCriticalSection ( &com_lock ) ;
+    if ( n > 0 )
     {
-      show_file ( p ) ;					// Yes, include the file
+      fwrite ( combuf, 1, n, stdout ) ;			// To the stream clients
     }
     else
     {
-      user_error ( fm ) ;				// No, show error
+      Sleep ( 10 ) ;					// Give clients a chance
     }
   }
-  writecom ( "\r" ) ;					// Force Forth prompt
+  return 0 ;
 }
 
 
 //***************************************************************************************************
-//				S E T _ T A R G E T _ S P E C I A L S				    *
+//					R U N _ C L I E N T					    *
 //***************************************************************************************************
-// Set target dependant stuff.									    *
+// Client mode.  Send one request to the server and show the output until the result line.	    *
+// Returns the exit status for the program: 0 for success, 1 for an error, 2 if there is no server. *
 //***************************************************************************************************
-void set_target_specials()
+int run_client()
 {
-  // Set the check function for the "OK" replay of the target.
-  ok_chk = &check_ok_stm8e ;				// Assume target is "stm8ef"
-  if ( strcasecmp ( target, "mecrisp" ) == 0 )		// Target is "mecrisp" ?
+  HANDLE hp ;						// Pipe to server
+  char   buf[512] ;					// Data from server
+  char   last[64] = "" ;				// Start of last line, for result
+  int    lastlen = 0 ;					// Length of last
+  DWORD  n ;						// Number of bytes read/written
+  DWORD  i ;						// Index in buf
+
+  while ( TRUE )
   {
-    ok_chk = &check_ok_mecrisp ;			// Yes, use mecrist version
+    hp = CreateFile ( pipename, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                      OPEN_EXISTING, 0, NULL ) ;
+    if ( hp != INVALID_HANDLE_VALUE )			// Connected?
+    {
+      break ;						// Yes, send request
+    }
+    if ( GetLastError() != ERROR_PIPE_BUSY ||		// No, all instances busy?
+         ! WaitNamedPipe ( pipename, 5000 ) )		// Yes, wait for a free one
+    {
+      fprintf ( stderr, "No escom server on %s\n", pipename ) ;
+      return 2 ;
+    }
   }
-  else if ( strcasecmp ( target, "zepto" ) == 0 )       // Target is "zepto" ?
+  snprintf ( buf, sizeof(buf), "%s\n", client_req ) ;	// Send request
+  WriteFile ( hp, buf, strlen ( buf ), &n, NULL ) ;
+  while ( ReadFile ( hp, buf, sizeof(buf), &n, NULL ) && n )
+  {
+    fwrite ( buf, 1, n, stdout ) ;			// Show output
+    for ( i = 0 ; i < n ; i++ )				// Look for result line
+    {
+      if ( buf[i] == '\n' )
+      {
+        last[lastlen] = '\0' ;
+        if ( strstr ( last, "escom: result=" ) == last )
+        {
+          CloseHandle ( hp ) ;
+          return strstr ( last, "=ok" ) ? 0 : 1 ;
+        }
+        lastlen = 0 ;
+      }
+      else if ( lastlen < sizeof(last) - 1 )
+      {
+        last[lastlen++] = buf[i] ;
+      }
+    }
+  }
+  CloseHandle ( hp ) ;					// Server gone
+  return 1 ;
+}
+
+
+//***************************************************************************************************
+//				H E A D L E S S _ O P T I O N					    *
+//***************************************************************************************************
+// Check options for batch, server or client mode, before the console is touched.  Used for the	    *
+// command line and for the tokens of the config file.  The arguments are walked with the option   *
+// string of parse_options(), so the value of an option like "-l -c.log" is not taken for one.	    *
+//***************************************************************************************************
+BOOL headless_option ( int argc, char* argv[] )
+{
+  const char* p ;					// Option character in argv
+  const char* q ;					// Option in OPTIONS
+  int         n ;
+
+  for ( n = 1 ; n < argc ; n++ )
   {
-    ok_chk = &check_ok_zepto ;                          // Yes, use zeptoforth version
+    if ( strcmp ( argv[n], "--" ) == 0 )		// End of options?
+    {
+      break ;
+    }
+    if ( argv[n][0] != '-' )				// Not an option, getopt skips it
+    {
+      continue ;
+    }
+    for ( p = argv[n] + 1 ; *p ; p++ )			// Options may be grouped like "-SE"
+    {
+      if ( *p == ':' || ( q = strchr ( OPTIONS, *p ) ) == NULL )
+      {
+        break ;						// Unknown, parse_options() reports it
+      }
+      if ( *p == 'x' || *p == 'S' || *p == 'c' )	// Batch, server or client?
+      {
+        return TRUE ;
+      }
+      if ( q[1] == ':' )				// Option with value?
+      {
+        if ( p[1] == '\0' )				// Yes, value in next argument?
+        {
+          n++ ;						// Yes, skip it
+        }
+        break ;
+      }
+    }
   }
+  return FALSE ;
 }
 
 
+#ifndef ESCOM_NO_MAIN						// Left out by the host benchmark
 //***************************************************************************************************
 //					M A I N							    *
 //***************************************************************************************************
@@ -1147,11 +6400,56 @@ int main ( int argc, char* argv[] )
 
   hConsoleOut = GetStdHandle ( STD_OUTPUT_HANDLE ) ;	// Get handles for console
   hConsoleIn =  GetStdHandle ( STD_INPUT_HANDLE ) ;	// output and input
-  clear_screen() ;
   tokenize_conf_file() ;				// Read option in config file
+  if ( ! headless_option ( tokc, tokv ) &&		// Interactive?
+       ! headless_option ( argc, argv ) )
+  {
+    clear_screen() ;					// Yes, start with a clean screen
+  }
   parse_options ( tokc, tokv ) ;			// Parse config options
   parse_options ( argc, argv ) ;			// Parse commandline options
+  if ( strcasecmp ( device, "auto" ) == 0 &&		// Discovery requested?
+       client_req == NULL )
+  {
+    discover() ;					// Yes, find port and target
+  }
   set_target_specials() ;				// Set target dependant things
+  sprintf ( pipename, "\\\\.\\pipe\\escom-%s", device ) ;	// Pipe for server mode
+  if ( client_req )					// Client mode?
+  {
+    return run_client() ;				// Yes, let the server do the job
+  }
+  if ( *tracefile && ! trace_start() )			// Start tracing if requested
+  {
+    user_error ( "Unable to trace to %s", tracefile ) ;
+  }
+  if ( server )						// Server mode?
+  {
+    if ( *logfile && ! log_start() )			// Yes, start logging if requested
+    {
+      user_error ( "Unable to log to %s", logfile ) ;
+    }
+    if ( ! esc_open ( &ses, device ) )			// Open port for serial I/O to target
+    {
+      return 2 ;					// Serial port problem
+    }
+    return run_server() ;				// Serve until killed
+  }
+  if ( batchc )						// Batch mode?
+  {
+    if ( *logfile && ! log_start() )			// Yes, start logging if requested
+    {
+      user_error ( "Unable to log to %s", logfile ) ;
+    }
+    if ( ! esc_open ( &ses, device ) )			// Open port for serial I/O to target
+    {
+      printf ( "escom: result=error steps=0 "		// Machine readable result
+               "porterror=%s\n", device ) ;
+      return 2 ;					// Serial port problem
+    }
+    return run_batch() ;				// Do the job and exit
+  }
+  printf ( "\n" ) ;					// Extra newline
   text_attr ( YELLOW ) ;				// Yellow text
   printf (
       "escom-" VERSION " : "				// Show startup info
@@ -1168,8 +6466,21 @@ int main ( int argc, char* argv[] )
   printf ( "-b (BAUDRATE) - %d\n", baudrate ) ;		// Baudrate configured
   printf ( "-t (TARGET  ) - %s\n", target ) ;		// Target system configured
   printf ( "-p (PATH    ) - %s\n", path ) ;		// Search path configured
+  printf ( "-f (FLOW    ) - %s\n", flowctl ) ;		// Flow control configured
+  if ( trace_fp )					// Trace file configured?
+  {
+    printf ( "-T (TRACE   ) - %s\n", tracefile ) ;	// Yes, show it
+  }
+  if ( *logfile )					// Log file configured?
+  {
+    printf ( "-l (LOGFILE ) - %s\n", logfile ) ;	// Yes, show it
+    if ( ! log_start() )				// Start logging
+    {
+      user_error ( "Unable to log to %s", logfile ) ;
+    }
+  }
   print_sep() ;						// Print separator
-  if ( !open_port ( device ) )				// Open port for serial I/O to target
+  if ( !esc_open ( &ses, device ) )			// Open port for serial I/O to target
   {
     return -1 ;						// No success, leave main program
   }
@@ -1179,7 +6490,14 @@ int main ( int argc, char* argv[] )
     n = 1 ;						// Force start of loop
     while ( n )
     {
-      n = readcom ( combuf, sizeof(combuf) - 1, 1 ) ;	// Try to read from serial
+      if ( wf_active )					// Watching files?
+      {
+        n = esc_poll ( &ses, combuf, sizeof(combuf) - 1 ) ;	// Yes, do not block on serial
+      }
+      else
+      {
+        n = esc_read ( &ses, combuf, sizeof(combuf) - 1, 1 ) ;	// Try to read from serial
+      }
       if ( n < 0 )					// Input error?
       {
         fputs ( "read() from serial failed!\n",		// No, error
@@ -1189,9 +6507,13 @@ int main ( int argc, char* argv[] )
       {
         combuf[n] = '\0' ;				// Force delimiter
         char* p = echoFilter ( combuf, inbuf ) ;	// Remove echoed characters
-        printf ( p ) ;					// Show to user
+        fwrite ( p, 1, n - ( p - combuf ), stdout ) ;	// Show to user, may contain NUL or %
       }
     }
+    if ( wf_active )					// Watching files?
+    {
+      wf_poll ( 10 ) ;					// Yes, check for changes
+    }
     if ( readcons ( inbuf, sizeof(inbuf) ) > 0 )	// Is there console input?
     {
       if ( inbuf[0] == '#' )				// Special input?
@@ -1206,4 +6528,8 @@ int main ( int argc, char* argv[] )
       writecom ( inbuf ) ; 				// Forward to serial output
     }
   }
+  esc_close ( &ses ) ;					// Release the port
+  log_stop() ;						// Flush and close the log
+  return 0 ;
 }
+#endif
@@ -0,0 +1,974 @@
+//***************************************************************************************************
+//                              	E S C O M L I B . C					    *
+//***************************************************************************************************
+// Reentrant core of escom.  See escomlib.h for the interface.					    *
+// There are no global variables and no static buffers: everything is in the session or on the    *
+// stack.  Errors and traffic are reported through the output callback of the session.		    *
+// The functions that only parse strings (esc_token, esc_search_file, esc_strip_comment) do not    *
+// need a session.										    *
+//***************************************************************************************************
+//                                                                                                  *
+// Revision    Auth.  Remarks									    *
+// ----------  -----  ----------------------------------------------------------------------------- *
+// 18-10-2026  ES     First set-up, core taken from escom.c 0.1.19.				    *
+// 18-10-2026  ES     Simulated target instead of the port, see escomsim.c.			    *
+//***************************************************************************************************
+#include <stdio.h>	// Console I/O
+#include <stdlib.h>	// Standard library definitions
+#include <string.h>	// String function definitions
+#include <ctype.h>	// Character classes
+#include <stdarg.h>	// Variable number of arguments
+#include <windows.h>	// Windows specifics
+#include "escomlib.h"	// Interface of this library
+
+
+//***************************************************************************************************
+//					E S C _ M E S S A G E					    *
+//***************************************************************************************************
+// Format a message and pass it to the output callback.						    *
+//***************************************************************************************************
+static void esc_message ( struct esc_session* s, int kind, const char* format, ... )
+{
+  char    buf[256] ;					// Formatted message
+  va_list varArgs ;					// For variable number of params
+  int     n ;						// Length of message
+
+  if ( s->output == NULL )				// Anyone listening?
+  {
+    return ;						// No, forget it
+  }
+  va_start ( varArgs, format ) ;
+  n = vsnprintf ( buf, sizeof(buf), format, varArgs ) ;
+  va_end ( varArgs ) ;
+  if ( n >= sizeof(buf) )				// Truncated?
+  {
+    n = sizeof(buf) - 1 ;
+  }
+  s->output ( s->ctx, kind, buf, n ) ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ E M I T						    *
+//***************************************************************************************************
+// Pass data to the output callback, if any.							    *
+//***************************************************************************************************
+static void esc_emit ( struct esc_session* s, int kind, const char* p, int len )
+{
+  if ( s->output )
+  {
+    s->output ( s->ctx, kind, p, len ) ;
+  }
+}
+
+
+//***************************************************************************************************
+//					E S C _ I N I T						    *
+//***************************************************************************************************
+// Initialize a session with the defaults of escom.  The port is not opened yet.		    *
+//***************************************************************************************************
+void esc_init ( struct esc_session* s, const char* target, esc_output_t output, void* ctx )
+{
+  memset ( s, 0, sizeof(*s) ) ;				// Empty dictionary, no statistics
+  s->hcom = INVALID_HANDLE_VALUE ;			// Not open yet
+  s->baudrate = 9600 ;					// Default baudrate
+  strcpy ( s->path, ".;./mcu;./lib" ) ;			// Default search path
+  strcpy ( s->flowctl, "none" ) ;			// No flow control
+  s->timeout = 2000 ;					// Enough for a line compiled to flash
+  s->output = output ;
+  s->ctx = ctx ;
+  s->exchange = esc_exchange ;				// Fixed time-out
+  s->send = esc_send ;
+  esc_set_target ( s, target ) ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ S E T _ T A R G E T				    *
+//***************************************************************************************************
+// Set the target system and the things that depend on it.					    *
+//***************************************************************************************************
+void esc_set_target ( struct esc_session* s, const char* target )
+{
+  snprintf ( s->target, sizeof(s->target), "%s", target ) ;
+  s->ok_chk = esc_ok_stm8ef ;				// Assume target is "stm8ef"
+  s->cellbits = 16 ;					// with 16 bits cells
+  if ( strcasecmp ( target, "mecrisp" ) == 0 )		// Target is "mecrisp" ?
+  {
+    s->ok_chk = esc_ok_mecrisp ;			// Yes, use mecrisp version
+    s->cellbits = 32 ;
+  }
+  else if ( strcasecmp ( target, "zepto" ) == 0 )	// Target is "zepto" ?
+  {
+    s->ok_chk = esc_ok_zepto ;				// Yes, use zeptoforth version
+    s->cellbits = 32 ;
+  }
+}
+
+
+//***************************************************************************************************
+//					E S C _ O P E N _ C O M M				    *
+//***************************************************************************************************
+// Open a serial port with the given baudrate and flow control.					    *
+// Returns INVALID_HANDLE_VALUE on error.							    *
+//***************************************************************************************************
+HANDLE esc_open_comm ( const char* port, int baudrate, const char* flowctl )
+{
+  char   wport[32] ;					// Port name in windows form
+  HANDLE h ;						// Handle of port
+  DCB dcbParams = { 0 } ;				// Initializing DCB structure
+
+  snprintf ( wport, sizeof(wport), "\\\\.\\%s", port ) ;	// Format for Windows
+  h = CreateFile ( wport,		                // port name
+                   GENERIC_READ | GENERIC_WRITE,	// Read/Write
+                   0,					// No Sharing
+                   NULL,				// No Security
+                   OPEN_EXISTING,			// Open existing port only
+                   0,					// Non Overlapped I/O
+                   NULL ) ;				// Null for Comm Devices
+
+  if ( h == INVALID_HANDLE_VALUE )			// Check result
+  {
+    return h ;						// No success
+  }
+  dcbParams.DCBlength = sizeof(dcbParams) ;		// Set size
+  GetCommState ( h, &dcbParams ) ;			// Get current state
+  dcbParams.BaudRate = baudrate ;			// Setting BaudRate
+  dcbParams.ByteSize = 8 ;				// Setting ByteSize = 8
+  dcbParams.StopBits = ONESTOPBIT ;			// Setting StopBits = 1
+  dcbParams.Parity   = NOPARITY ;			// Setting Parity = None
+  dcbParams.fOutX = FALSE ;				// Assume no flow control
+  dcbParams.fInX = FALSE ;
+  dcbParams.fOutxCtsFlow = FALSE ;
+  dcbParams.fOutxDsrFlow = FALSE ;
+  dcbParams.fRtsControl = RTS_CONTROL_ENABLE ;
+  if ( strcasecmp ( flowctl, "xon" ) == 0 )		// XON/XOFF flow control?
+  {
+    dcbParams.fOutX = TRUE ;				// Yes, target may stop our output
+    dcbParams.fTXContinueOnXoff = TRUE ;
+    dcbParams.XonChar = 0x11 ;				// DC1
+    dcbParams.XoffChar = 0x13 ;				// DC3
+  }
+  else if ( strcasecmp ( flowctl, "rts" ) == 0 )	// RTS/CTS flow control?
+  {
+    dcbParams.fOutxCtsFlow = TRUE ;			// Yes, send only if CTS is active
+    dcbParams.fRtsControl = RTS_CONTROL_HANDSHAKE ;	// and drive RTS by input buffer
+  }
+  SetCommState ( h, &dcbParams ) ;			// Set new status
+  return h ;						// Return handle
+}
+
+
+//***************************************************************************************************
+//					E S C _ T I M E O U T					    *
+//***************************************************************************************************
+// Set the read time-out for the serial port of the session.					    *
+//***************************************************************************************************
+void esc_timeout ( struct esc_session* s, int t )
+{
+  COMMTIMEOUTS timeouts = { 0 } ;			// Struct for setting constants
+
+  GetCommTimeouts ( s->hcom, &timeouts ) ;		// Read current time-out settings
+  // For input:
+  timeouts.ReadIntervalTimeout         = 0 ;		// in milliseconds
+  timeouts.ReadTotalTimeoutConstant    = t ;		// in milliseconds
+  timeouts.ReadTotalTimeoutMultiplier  = 0 ;		// in milliseconds
+  // For output:
+  timeouts.WriteTotalTimeoutConstant   = 0 ;		// in milliseconds
+  timeouts.WriteTotalTimeoutMultiplier = 0 ;		// in milliseconds
+  SetCommTimeouts ( s->hcom, &timeouts ) ;		// Set time-outs
+}
+
+
+//***************************************************************************************************
+//					E S C _ O P E N						    *
+//***************************************************************************************************
+// Open the serial port of the session with the baudrate and flow control of the session.	    *
+//***************************************************************************************************
+BOOL esc_open ( struct esc_session* s, const char* port )
+{
+  s->hcom = esc_open_comm ( port, s->baudrate, s->flowctl ) ;
+  if ( s->hcom == INVALID_HANDLE_VALUE )		// Check result
+  {
+    esc_message ( s, ESC_ERROR, "Error in opening %s", port ) ;
+    return FALSE ;
+  }
+  esc_timeout ( s, 50 ) ;				// Set default time-out
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ C L O S E					    *
+//***************************************************************************************************
+// Close the serial port of the session.  The dictionary is kept.				    *
+//***************************************************************************************************
+void esc_close ( struct esc_session* s )
+{
+  if ( s->hcom != INVALID_HANDLE_VALUE )
+  {
+    CloseHandle ( s->hcom ) ;
+    s->hcom = INVALID_HANDLE_VALUE ;
+  }
+}
+
+
+//***************************************************************************************************
+//					E S C _ W R I T E					    *
+//***************************************************************************************************
+// Write a buffer to the serial port, or to the simulated target if the session has one.	    *
+//***************************************************************************************************
+BOOL esc_write ( struct esc_session* s, const char* buf, int len )
+{
+  BOOL  stat ;						// Result of write action
+  DWORD nbWritten = 0 ;					// Bytes written
+
+  if ( s->sim )						// Simulated target?
+  {
+    esc_sim_input ( s->sim, buf, len ) ;		// Yes, it takes everything
+    nbWritten = len ;
+    stat = TRUE ;
+  }
+  else
+  {
+    stat = WriteFile ( s->hcom, buf, len, &nbWritten, NULL ) ;
+  }
+  if ( nbWritten )
+  {
+    esc_emit ( s, ESC_SENT, buf, nbWritten ) ;
+  }
+  return ( stat && ( nbWritten == len ) ) ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ S E N D						    *
+//***************************************************************************************************
+// Send a line without waiting for the reply.  The compile state is followed for the reply.	    *
+//***************************************************************************************************
+BOOL esc_send ( struct esc_session* s, const char* line )
+{
+  esc_track ( s, line ) ;				// Reply may end with the line
+  return esc_write ( s, line, strlen ( line ) ) ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ R E A D						    *
+//***************************************************************************************************
+// Read from the serial port until end of line or after maxtry time-outs of the port.		    *
+// Returns the number of bytes read, or -1 on error.  The buffer is NUL-terminated, so maxlen	    *
+// must be one less than the size of the buffer.						    *
+//***************************************************************************************************
+int esc_read ( struct esc_session* s, char* buf, DWORD maxlen, int maxtry )
+{
+  DWORD nbRead ;					// Number of bytes read
+  int   totread = 0 ;					// Total bytes read
+
+  *buf = '\0' ;						// Empty result if read fails
+  while ( maxlen )
+  {
+    if ( s->sim )					// Simulated target?
+    {
+      if ( ( nbRead = esc_sim_output ( s->sim, buf + totread, maxlen ) ) == 0 )
+      {
+        Sleep ( 10 ) ;					// Nothing, like a time-out of the port
+      }
+    }
+    else if ( ! ReadFile ( s->hcom, buf + totread, maxlen, &nbRead, NULL ) )
+    {
+      return -1 ;
+    }
+    totread += nbRead ;
+    maxlen -= nbRead ;
+    buf[totread] = '\0' ;				// Force end of buffer
+    if ( totread &&					// End of input?
+         ( buf[totread - 1] == '\n' || buf[totread - 1] == '\r' ) )
+    {
+      break ;
+    }
+    if ( --maxtry == 0 )
+    {
+      break ;
+    }
+  }
+  if ( totread )					// Anything received?
+  {
+    esc_emit ( s, ESC_RECEIVED, buf, totread ) ;
+  }
+  return totread ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ P O L L						    *
+//***************************************************************************************************
+// Read the bytes that are already received from the serial port, without waiting.		    *
+// Returns the number of bytes read.  The buffer is NUL-terminated.				    *
+//***************************************************************************************************
+int esc_poll ( struct esc_session* s, char* buf, DWORD maxlen )
+{
+  COMSTAT cs ;						// Status of com port
+  DWORD   errors ;					// Error flags
+  DWORD   nbRead = 0 ;					// Number of bytes read
+
+  if ( s->sim )						// Simulated target?
+  {
+    nbRead = esc_sim_output ( s->sim, buf, maxlen ) ;	// Yes, output is there at once
+  }
+  else if ( ClearCommError ( s->hcom, &errors, &cs ) &&	// Get number of bytes in input queue
+            cs.cbInQue )
+  {
+    if ( cs.cbInQue < maxlen )				// Limit to available bytes
+    {
+      maxlen = cs.cbInQue ;
+    }
+    if ( ! ReadFile ( s->hcom, buf, maxlen, &nbRead,	// Read them, will not block
+                      NULL ) )
+    {
+      nbRead = 0 ;
+    }
+  }
+  buf[nbRead] = '\0' ;					// Force end of buffer
+  if ( nbRead )
+  {
+    esc_emit ( s, ESC_RECEIVED, buf, nbRead ) ;
+  }
+  return nbRead ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ R E A D _ R E P L Y				    *
+//***************************************************************************************************
+// Read the reply to a line sent to the target.  Reading stops at the "ok" phrase, at a BELL or	    *
+// after a time-out in milliseconds.  A target that is compiling gives no "ok", so then the reply   *
+// ends with the line.  Returns the number of bytes in buf.					    *
+//***************************************************************************************************
+int esc_read_reply ( struct esc_session* s, char* buf, DWORD maxlen, int timeout )
+{
+  DWORD t0 ;						// Start time
+  int   totread = 0 ;					// Total bytes read
+  int   n ;						// Bytes read in one poll
+
+  t0 = GetTickCount() ;
+  buf[0] = '\0' ;
+  while ( totread < maxlen - 1 )			// Room in buffer?
+  {
+    n = esc_poll ( s, buf + totread,			// Yes, get what is there
+                   maxlen - 1 - totread ) ;
+    totread += n ;
+    if ( n )						// Anything new?
+    {
+      if ( s->ok_chk ( buf ) || strchr ( buf, 0x07 ) ||	// Yes, end of reply?
+           ( s->compiling && strchr ( buf, '\n' ) ) )
+      {
+        break ;
+      }
+    }
+    else if ( GetTickCount() - t0 > timeout )		// Time-out?
+    {
+      break ;
+    }
+    else
+    {
+      Sleep ( 1 ) ;					// Wait for more input
+    }
+  }
+  return totread ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ E X C H A N G E					    *
+//***************************************************************************************************
+// Default exchange: send a line and read the reply with the fixed time-out of the session.	    *
+// The reply buffer may be the same as the line.						    *
+//***************************************************************************************************
+int esc_exchange ( struct esc_session* s, const char* line, char* reply, DWORD maxlen )
+{
+  char sent[ESC_LINELEN] ;				// Copy of line, reply may overwrite it
+
+  snprintf ( sent, sizeof(sent), "%s", line ) ;
+  esc_send ( s, sent ) ;
+  return esc_read_reply ( s, reply, maxlen, s->timeout ) ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ C H E C K					    *
+//***************************************************************************************************
+// Send a line to the target and check the reply.  A BELL in the reply means error.		    *
+//***************************************************************************************************
+BOOL esc_check ( struct esc_session* s, const char* line )
+{
+  char reply[128] ;					// Reply of target
+
+  s->exchange ( s, line, reply, sizeof(reply) ) ;
+  return ( strchr ( reply, 0x07 ) == NULL ) ;
+}
+
+
+//***************************************************************************************************
+//				E S C _ O K _ S T M 8 E F					    *
+//***************************************************************************************************
+// Check for "ok\n" at the end of the line.  Version for stm8ef.				    *
+// Returns a pointer to the "ok" phrase or NULL.						    *
+//***************************************************************************************************
+char* esc_ok_stm8ef ( char* buf )
+{
+  int len = strlen ( buf ) ;				// Length of reply
+
+  if ( len < 3 )					// Room for "ok\n"?
+  {
+    return NULL ;
+  }
+  buf += len - 3 ;					// Points to end of string - 3
+  if ( tolower ( buf[0] ) != 'o' ||			// Ends with "ok" or "OK"?
+       tolower ( buf[1] ) != 'k' ||
+       buf[2] != '\n' )
+  {
+    return NULL ;					// Not expected end
+  }
+  return buf ;
+}
+
+
+//***************************************************************************************************
+//				E S C _ O K _ M E C R I S P					    *
+//***************************************************************************************************
+// Check for "ok.\n" at the end of the line.  Version for mecrisp.				    *
+//***************************************************************************************************
+char* esc_ok_mecrisp ( char* buf )
+{
+  int len = strlen ( buf ) ;				// Length of reply
+
+  if ( len < 4 )					// Room for "ok.\n"?
+  {
+    return NULL ;
+  }
+  buf += len - 4 ;					// Points to end of string - 4
+  if ( tolower ( buf[0] ) != 'o' ||			// Ends with "ok." or "OK."?
+       tolower ( buf[1] ) != 'k' ||
+       buf[2] != '.' ||
+       buf[3] != '\n' )
+  {
+    return NULL ;					// Not expected end
+  }
+  return buf ;
+}
+
+
+//***************************************************************************************************
+//				E S C _ O K _ Z E P T O						    *
+//***************************************************************************************************
+// Check for "ok\r\n" at the end of the line.  Version for zepto.				    *
+//***************************************************************************************************
+char* esc_ok_zepto ( char* buf )
+{
+  int len = strlen ( buf ) ;				// Length of reply
+
+  if ( len < 4 )					// Room for "ok\r\n"?
+  {
+    return NULL ;
+  }
+  buf += len - 4 ;					// Points to end of string - 4
+  if ( buf[0] != 'o' ||					// Ends with "ok\r\n"?
+       buf[1] != 'k' ||
+       buf[2] != '\r' ||
+       buf[3] != '\n' )
+  {
+    return NULL ;					// Not expected end
+  }
+  return buf ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ T O K E N					    *
+//***************************************************************************************************
+// Find token i (0...n) in a string.  Tokens are separated by spaces, tabs, CR and LF.		    *
+// The token is returned as a span into the string, nothing is copied.				    *
+// Returns FALSE if there are not enough tokens.						    *
+//***************************************************************************************************
+BOOL esc_token ( const char* str, int i, struct esc_span* tok )
+{
+  const char* delim = " \t\r\n" ;			// List of delimiters
+  int         n ;					// Length of token
+
+  while ( TRUE )
+  {
+    str += strspn ( str, delim ) ;			// Skip delimiters
+    if ( *str == '\0' )					// End of string?
+    {
+      return FALSE ;					// Yes, token not found
+    }
+    n = strcspn ( str, delim ) ;			// Length of this token
+    if ( i-- == 0 )					// Requested token?
+    {
+      tok->p = str ;					// Yes, return it
+      tok->len = n ;
+      return TRUE ;
+    }
+    str += n ;						// Next token
+  }
+}
+
+
+//***************************************************************************************************
+//					F I L E _ E X I S T S					    *
+//***************************************************************************************************
+// Check if a file exists and is not a directory.						    *
+//***************************************************************************************************
+static BOOL file_exists ( const char* fspec )
+{
+  DWORD dwAttrib ;
+
+  dwAttrib = GetFileAttributes ( fspec ) ;
+  return ( dwAttrib != INVALID_FILE_ATTRIBUTES &&
+         !( dwAttrib & FILE_ATTRIBUTE_DIRECTORY ) ) ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ S E A R C H _ F I L E				    *
+//***************************************************************************************************
+// Search for a file in a search path like ".;./mcu;./lib".  If the filename contains a "/" or a   *
+// "\", the path is not used.  Returns fnam if the file exists as given, out with the full spec    *
+// if it was found in the path, or NULL if it was not found.					    *
+//***************************************************************************************************
+const char* esc_search_file ( const char* path, const char* fnam, char* out, int outlen )
+{
+  int n ;						// Length of entry in path
+
+  if ( file_exists ( fnam ) )				// Try the simple one
+  {
+    return fnam ;
+  }
+  if ( strchr ( fnam, '/' ) || strchr ( fnam, '\\' ) )	// (Back)slash in filename?
+  {
+    return NULL ;					// Yes, do not search
+  }
+  while ( *path )					// Try all entries in the search path
+  {
+    n = strcspn ( path, ";" ) ;				// Length of this entry
+    if ( n )						// Skip empty entries
+    {
+      snprintf ( out, outlen, "%.*s/%s", n, path, fnam ) ;
+      if ( file_exists ( out ) )			// See if it exists
+      {
+        return out ;					// Yes, return full spec
+      }
+    }
+    path += n ;						// Next entry
+    if ( *path )
+    {
+      path++ ;						// Skip semicolon
+    }
+  }
+  return NULL ;						// File not found
+}
+
+
+//***************************************************************************************************
+//					E S C _ F I L E _ W O R D				    *
+//***************************************************************************************************
+// Return the name of a file without directory.  For #require this is the word to test for.	    *
+//***************************************************************************************************
+const char* esc_file_word ( const char* filename )
+{
+  const char* word ;					// Points to filename as word
+
+  word = strrchr ( filename, '\\' ) ;		  	// Isolate filename
+  if ( word == NULL )					// Backslash in filename?
+  {
+    word = strrchr ( filename, '/' ) ;			// No, try forward slash
+  }
+  if ( word == NULL )					// Was there a (back)slash?
+  {
+    word = filename ;					// No, use plain filename
+  }
+  else
+  {
+    word++ ;						// Skip over (back)slash
+  }
+  return word ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ S T R I P _ C O M M E N T			    *
+//***************************************************************************************************
+// Strip comment at end of line.								    *
+//***************************************************************************************************
+void esc_strip_comment ( char* line )
+{
+  char* p ;						// Result of strrchr()
+
+  while ( ( p = strrchr ( line, '\\' ) ) > line )	// Comment at the end of the line?
+  {
+    *p++ = '\r' ;					// Yes, force end of line
+    *p = '\0' ;
+  }
+}
+
+
+//***************************************************************************************************
+//					E S C _ T R A C K					    *
+//***************************************************************************************************
+// Follow the compile state and the flash mode of the target for a line that is about to be sent.   *
+// A compiled line is answered with the line end only, esc_read_reply() stops on that while	    *
+// compiling is set.  Compiling to flash takes much longer, a program may time replies per mode.    *
+//***************************************************************************************************
+void esc_track ( struct esc_session* s, const char* line )
+{
+  struct esc_span t ;					// Token in line
+  const char*     end ;					// End of comment
+
+  while ( esc_token ( line, 0, &t ) )
+  {
+    line = t.p + t.len ;				// Continue after this token
+    if ( t.len == 1 && *t.p == '\\' )			// Rest of line is comment
+    {
+      break ;
+    }
+    if ( t.len == 1 && *t.p == '(' && ( end = strchr ( line, ')' ) ) )
+    {
+      line = end + 1 ;					// Skip comment
+    }
+    else if ( ( t.len == 1 && *t.p == ':' ) ||
+              ( t.len == 7 && strncasecmp ( t.p, ":NONAME", 7 ) == 0 ) )
+    {
+      s->compiling = TRUE ;
+    }
+    else if ( t.len == 1 && *t.p == ';' )
+    {
+      s->compiling = FALSE ;
+    }
+    else if ( ( t.len == 3 && strncasecmp ( t.p, "NVM", 3 ) == 0 ) ||	// stm8ef
+              ( t.len == 14 && strncasecmp ( t.p, "compiletoflash", 14 ) == 0 ) ||	// mecrisp
+              ( t.len == 16 && strncasecmp ( t.p, "compile-to-flash", 16 ) == 0 ) )	// zepto
+    {
+      s->nvm = TRUE ;
+    }
+    else if ( ( t.len == 3 && strncasecmp ( t.p, "RAM", 3 ) == 0 ) ||
+              ( t.len == 12 && strncasecmp ( t.p, "compiletoram", 12 ) == 0 ) ||
+              ( t.len == 14 && strncasecmp ( t.p, "compile-to-ram", 14 ) == 0 ) )
+    {
+      s->nvm = FALSE ;
+    }
+  }
+}
+
+
+//***************************************************************************************************
+//					E S C _ S E A R C H _ D I C T				    *
+//***************************************************************************************************
+// Search for a symbol in the dictionary of the session.					    *
+// Index will be returned, or -1 if not found.							    *
+//***************************************************************************************************
+int esc_search_dict ( struct esc_session* s, const char* symbol )
+{
+  int i ;						// Index in dictionary
+
+  for ( i = 0 ; i < s->dinx ; i++ )			// Search in dictionary
+  {
+    if ( strcmp ( s->dict[i].symbol, symbol ) == 0 )	// Match?
+    {
+      return i ;					// Yes, return index
+    }
+  }
+  return -1 ;						// Symbol not found
+}
+
+
+//***************************************************************************************************
+//					E S C _ D E F I N E					    *
+//***************************************************************************************************
+// Add a symbol to the dictionary, or change its value if it is already there.			    *
+//***************************************************************************************************
+BOOL esc_define ( struct esc_session* s, const char* symbol, WORD value )
+{
+  int i ;						// Index in dictionary
+
+  if ( ( i = esc_search_dict ( s, symbol ) ) < 0 )	// Already in dictionary?
+  {
+    if ( s->dinx == ESC_MAXDICT )			// No, room for a new one?
+    {
+      esc_message ( s, ESC_ERROR, "Dictionary full at %s", symbol ) ;
+      return FALSE ;
+    }
+    i = s->dinx++ ;					// Yes, new entry
+    snprintf ( s->dict[i].symbol, sizeof(s->dict[i].symbol), "%s", symbol ) ;
+  }
+  s->dict[i].value = value ;				// Store value
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ L O A D _ R E S					    *
+//***************************************************************************************************
+// Load the CPU symbols of a resource (.efr) file in the dictionary.  Lines look like this:	    *
+//	7F60 equ CFG_GCR    \ Global configuration register					    *
+//***************************************************************************************************
+BOOL esc_load_res ( struct esc_session* s, const char* filespec )
+{
+  FILE*           fp ;					// File handle
+  char            line[128] ;				// Input buffer for 1 line
+  char            symbol[sizeof(s->dict[0].symbol)] ;	// Symbol name
+  struct esc_span t[3] ;				// Value, "equ" and symbol
+
+  if ( ( fp = fopen ( filespec, "r" ) ) == NULL )	// Open the file
+  {
+    esc_message ( s, ESC_ERROR, "Unable to open %s", filespec ) ;
+    return FALSE ;
+  }
+  while ( fgets ( line, sizeof(line), fp ) != NULL )	// Read next line from file
+  {
+    if ( line[0] == '\\' ||				// Skip comment lines
+         ! esc_token ( line, 0, &t[0] ) ||		// and lines with less than 3 tokens
+         ! esc_token ( t[0].p + t[0].len, 0, &t[1] ) ||
+         ! esc_token ( t[1].p + t[1].len, 0, &t[2] ) )
+    {
+      continue ;
+    }
+    if ( t[1].len == 3 && strncmp ( t[1].p, "equ", 3 ) == 0 )	// Is this an "equ" line?
+    {
+      snprintf ( symbol, sizeof(symbol), "%.*s", t[2].len, t[2].p ) ;
+      esc_define ( s, symbol, strtol ( t[0].p, NULL, 16 ) ) ;	// Value is hexadecimal
+    }
+  }
+  fclose ( fp ) ;					// Close input file
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ H A N D L E _ R E S				    *
+//***************************************************************************************************
+// Handle a "\res" line.  Examples:								    *
+//   \res MCU: STM8S103				-- Loads STM8S103.efr from the search path into the *
+//						   dictionary.					    *
+//   \res 5000 equ PA_ODR			-- Defines a symbol, the value is hexadecimal.	    *
+//   \res export PD_ODR PD_DDR PD_CR1 PD_CR2	-- Exports symbols in the dictionary to the target   *
+//						   as constants, if not already defined there.	    *
+//***************************************************************************************************
+BOOL esc_handle_res ( struct esc_session* s, const char* line )
+{
+  char            arg[32] ;				// Copy of a token
+  char            cmd[64] ;				// Line to the target
+  char            spec[128] ;				// Full spec of .efr file
+  const char*     p ;					// Result of search
+  struct esc_span t ;					// Token in line
+  int             tinx ;				// Token index in line
+  int             inx ;					// Index in dictionary
+  WORD            v ;					// Value of symbol
+
+  if ( ! esc_token ( line, 1, &t ) )			// Need at least one argument
+  {
+    return TRUE ;
+  }
+  if ( t.len == 4 && strncasecmp ( t.p, "MCU:", 4 ) == 0 )	// MCU spec?
+  {
+    if ( ! esc_token ( line, 2, &t ) )			// Yes, get CPU name like "STM8S103"
+    {
+      return FALSE ;
+    }
+    snprintf ( arg, sizeof(arg), "%.*s.efr", t.len, t.p ) ;	// Fixed extension
+    if ( ( p = esc_search_file ( s->path, arg, spec, sizeof(spec) ) ) == NULL )
+    {
+      esc_message ( s, ESC_ERROR, "%s not found", arg ) ;
+      return FALSE ;
+    }
+    return esc_load_res ( s, p ) ;			// Store symbols in dictionary
+  }
+  if ( t.len == 6 && strncasecmp ( t.p, "export", 6 ) == 0 )	// Export symbol(s)?
+  {
+    for ( tinx = 2 ; esc_token ( line, tinx, &t ) ; tinx++ )
+    {
+      snprintf ( arg, sizeof(arg), "%.*s", t.len, t.p ) ;
+      if ( ( inx = esc_search_dict ( s, arg ) ) < 0 )	// Symbol known?
+      {
+        esc_message ( s, ESC_ERROR, "%s not in dictionary", arg ) ;
+        return FALSE ;
+      }
+      snprintf ( cmd, sizeof(cmd), "' %s DROP\r", arg ) ;	// Already a word on the target?
+      if ( ! esc_check ( s, cmd ) )
+      {
+        snprintf ( cmd, sizeof(cmd), "$%X CONSTANT %s\r",	// No, add the constant
+                   s->dict[inx].value, arg ) ;
+        if ( ! esc_check ( s, cmd ) )
+        {
+          return FALSE ;
+        }
+      }
+    }
+    return TRUE ;
+  }
+  v = strtol ( t.p, NULL, 16 ) ;			// Maybe a value
+  if ( esc_token ( line, 2, &t ) &&			// Single symbol?
+       t.len == 3 && strncasecmp ( t.p, "equ", 3 ) == 0 &&
+       esc_token ( line, 3, &t ) )
+  {
+    snprintf ( arg, sizeof(arg), "%.*s", t.len, t.p ) ;
+    return esc_define ( s, arg, v ) ;
+  }
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ I N C L U D E					    *
+//***************************************************************************************************
+// Upload a source file to the target.  With conditional TRUE (#require) the file is only sent if  *
+// the target does not know a word with the name of the file.  Nested #include and #require are    *
+// handled recursively, "\res" lines by esc_handle_res().  Lines are sent one by one and the reply  *
+// is checked; a BELL in the reply stops the upload and sets errfile and errline of the session.    *
+// A program adds its own handling with the hooks of the session: the filter sees every line	    *
+// first and may take it over or stop, the file hook is told about every file and may answer a	    *
+// #require itself, upload and send may replace the exchange of a line and the sending of a nested  *
+// directive.  An upload hook that returns less than 0 has reported an error, the upload stops.	    *
+//***************************************************************************************************
+BOOL esc_include ( struct esc_session* s, const char* filename, BOOL conditional )
+{
+  char            line[ESC_LINELEN] ;			// Input buffer for 1 line
+  char            reply[ESC_LINELEN] ;			// Reply of the target
+  char            myfile[128] ;				// Full filespec
+  char            sub[128] ;				// Nested file
+  const char*     p ;					// Result of search
+  FILE*           fp = NULL ;				// File handle
+  struct esc_span t ;					// Filename in #include line
+  int             lineno = 0 ;				// Line number in file
+  int             len_1 ;				// Length of line minus 1
+  int             n ;					// Length of reply
+  int             act = ESC_SEND ;			// Decision of a hook
+  BOOL            rcond ;				// Nested #require
+  BOOL            result = TRUE ;			// Function result
+
+  if ( ( p = esc_search_file ( s->path, filename, myfile, sizeof(myfile) ) ) )
+  {
+    snprintf ( sub, sizeof(sub), "%s", p ) ;		// p may be filename or myfile
+    strcpy ( myfile, sub ) ;
+    fp = fopen ( myfile, "r" ) ;
+  }
+  if ( fp == NULL )
+  {
+    esc_message ( s, ESC_ERROR, "Unable to open %s", filename ) ;
+    return FALSE ;
+  }
+  if ( conditional )					// #require?
+  {
+    if ( s->file )					// Program may know the answer
+    {
+      act = s->file ( s, ESC_REQUIRE, myfile, TRUE, TRUE ) ;
+    }
+    if ( act == ESC_SEND )				// No, ask the target
+    {
+      snprintf ( line, sizeof(line), "' %s DROP\r", esc_file_word ( filename ) ) ;
+      act = esc_check ( s, line ) ? ESC_SKIP : ESC_SEND ;
+      if ( act == ESC_SKIP && s->file )			// Word exists, file is already there
+      {
+        s->file ( s, ESC_KNOWN, myfile, TRUE, TRUE ) ;
+      }
+    }
+    if ( act != ESC_SEND )
+    {
+      fclose ( fp ) ;
+      return ( act == ESC_SKIP ) ;
+    }
+  }
+  if ( s->file )
+  {
+    s->file ( s, ESC_OPEN, myfile, conditional, TRUE ) ;
+  }
+  esc_message ( s, ESC_INFO, "Uploading %s", myfile ) ;
+  while ( fgets ( line, sizeof(line) - 1, fp ) != NULL )	// Read next line, room for CR
+  {
+    lineno++ ;
+    len_1 = strlen ( line ) - 1 ;
+    if ( len_1 <= 0 )					// Empty line?
+    {
+      *line = '\0' ;
+    }
+    else if ( line[len_1] == '\n' )			// Line ends with newline?
+    {
+      line[len_1] = '\r' ;				// Yes, change to CR
+    }
+    else
+    {
+      strcat ( line, "\r" ) ;				// No, append CR
+    }
+    act = s->filter ? s->filter ( s, line, myfile, lineno ) : ESC_SEND ;
+    if ( act == ESC_STOP )				// Filter reported an error?
+    {
+      result = FALSE ;
+      break ;
+    }
+    if ( act == ESC_SKIP || *line == '\0' )		// Taken over, or empty line
+    {
+      continue ;
+    }
+    if ( strncmp ( line, "\\\\", 2 ) == 0 )		// Double backslash: skip rest of file
+    {
+      break ;
+    }
+    if ( line[0] == '\\' )				// "\res" or comment line
+    {
+      esc_emit ( s, ESC_SOURCE, line, len_1 ) ;
+      if ( strncmp ( line, "\\res", 4 ) == 0 &&
+           ! ( result = esc_handle_res ( s, line ) ) )
+      {
+        break ;
+      }
+      continue ;
+    }
+    rcond = ( strncmp ( line, "#require", 8 ) == 0 ) ;
+    if ( rcond || strncmp ( line, "#include", 8 ) == 0 )
+    {
+      if ( ! ( result = s->send ( s, line ) ) )		// Target sees the directive too
+      {
+        break ;
+      }
+      if ( esc_token ( line, 1, &t ) )			// Filename supplied?
+      {
+        snprintf ( sub, sizeof(sub), "%.*s", t.len, t.p ) ;
+        if ( ! ( result = esc_include ( s, sub, rcond ) ) )
+        {
+          break ;
+        }
+      }
+      continue ;
+    }
+    esc_strip_comment ( line ) ;			// Strip off comments at end of line
+    s->lines++ ;					// Count for statistics
+    s->bytes += strlen ( line ) ;
+    n = ( s->upload ? s->upload : s->exchange ) ( s, line, reply, sizeof(reply) ) ;
+    if ( n < 0 )					// Error, reported by the hook
+    {
+      result = FALSE ;
+      break ;
+    }
+    esc_emit ( s, ESC_REPLY, reply, n ) ;
+    if ( strchr ( reply, 0x07 ) )			// BELL in the reply means error
+    {
+      snprintf ( s->errfile, sizeof(s->errfile), "%s", myfile ) ;
+      s->errline = lineno ;
+      s->compiling = FALSE ;				// Target is interpreting again
+      esc_message ( s, ESC_ERROR, "Error in %s line %d, abort upload", myfile, lineno ) ;
+      result = FALSE ;
+      break ;
+    }
+  }
+  if ( result && conditional && s->file )		// Word of required file exists now
+  {
+    s->file ( s, ESC_KNOWN, myfile, TRUE, TRUE ) ;
+  }
+  esc_message ( s, ESC_INFO, "Closing %s", myfile ) ;
+  if ( s->file )
+  {
+    s->file ( s, ESC_CLOSE, myfile, conditional, result ) ;
+  }
+  fclose ( fp ) ;
+  return result ;
+}
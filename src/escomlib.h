@@ -0,0 +1,208 @@
+//***************************************************************************************************
+//                              	E S C O M L I B . H					    *
+//***************************************************************************************************
+// Reentrant core of escom: serial transport, reply detection, the resource dictionary and the	    *
+// #include/#require engine.  All state is in a session.  Output goes to a callback, the core has  *
+// no console dependency.  Several sessions can be used in one process, one thread per session.    *
+// Build together with the program that uses it, for example:					    *
+//    gcc myrig.c escomlib.c escomsim.c -o myrig.exe						    *
+// escomsim.c is a host-side Forth interpreter that can take the place of the port of a session.    *
+// Minimal use:											    *
+//    struct esc_session* s = malloc ( sizeof(struct esc_session) ) ;				    *
+//    esc_init ( s, "stm8ef", my_output, my_context ) ;						    *
+//    if ( esc_open ( s, "COM5" ) && esc_include ( s, "main.fs", FALSE ) ) ...			    *
+//    esc_close ( s ) ;										    *
+//***************************************************************************************************
+#ifndef ESCOMLIB_H
+#define ESCOMLIB_H
+
+#include <windows.h>	// Windows specifics
+
+// Constants:
+#define ESC_MAXDICT  1000				// Max number of symbols in dictionary
+#define ESC_LINELEN  256				// Max length of a source line or reply
+// Simulator
+#define ESC_SIMRAM     65536				// Bytes of RAM, holds the data space
+#define ESC_SIMPAGES   64				// Pages of 256 bytes for other addresses
+#define ESC_SIMSTACK   256				// Depth of data and return stack
+#define ESC_SIMWORDS   2048				// Max number of words
+#define ESC_SIMCODE    65536				// Max number of cells of compiled code
+#define ESC_SIMSTEPS   10000000				// Max number of words executed for one line
+#define ESC_SIMQUEUE   8192				// Size of output queue
+#define ESC_SIMEFFECTS 16				// Number of stack effects kept
+
+enum esc_kind						// Kinds of output to the callback
+{
+  ESC_SENT,						// Data sent to the target
+  ESC_RECEIVED,						// Data received from the target
+  ESC_SOURCE,						// Source line that is not sent (comment, directive)
+  ESC_REPLY,						// Reply of the target to an uploaded line
+  ESC_INFO,						// Information, like the start of a file
+  ESC_ERROR						// Error message
+} ;
+
+enum esc_event						// Events of a file for the file hook
+{
+  ESC_REQUIRE,						// #require, before the target is probed
+  ESC_KNOWN,						// Word of a #require file exists on the target
+  ESC_OPEN,						// Upload of a file starts
+  ESC_CLOSE						// Upload of a file has ended
+} ;
+
+enum esc_action						// What esc_include() does next, by a hook
+{
+  ESC_SEND,						// Handle the line or file as usual
+  ESC_SKIP,						// Done by the hook, go on with the next one
+  ESC_STOP						// Error, abort the upload
+} ;
+
+struct esc_span						// Part of a string, not NUL-terminated
+{
+  const char* p ;					// Start
+  int         len ;					// Number of characters
+} ;
+
+struct esc_dict						// Dictionary entry
+{
+  char symbol[20] ;					// Symbolic name
+  WORD value ;						// Value
+} ;
+
+struct esc_simword					// Word in the dictionary of the simulator
+{
+  char  name[32] ;					// Name, empty for :NONAME
+  BYTE  kind ;						// Primitive, colon definition, constant, ...
+  BYTE  flags ;						// Immediate, hidden, native code
+  DWORD param ;						// Operation, start in code, value or address
+  int   does ;						// Start of DOES> part in code, -1 if none
+} ;
+
+struct esc_simeffect					// Line that changed the stack depth
+{
+  char line[48] ;					// Start of the line
+  int  before ;						// Depth before the line
+  int  after ;						// Depth after the line
+} ;
+
+struct esc_sim						// Simulated target, see escomsim.c
+{
+  int                  cellbits ;			// Cell size in bits, 16 or 32
+  DWORD                mask ;				// Mask for a cell
+  BOOL                 bigendian ;			// Byte order of cells in memory
+  BOOL                 floored ;			// Division rounds towards minus infinity
+  const char*          ok ;				// "ok" phrase of the dialect
+  DWORD                rambase ;			// Address of ram[0]
+  BYTE                 ram[ESC_SIMRAM] ;		// RAM with BASE and the data space
+  DWORD                pageaddr[ESC_SIMPAGES] ;		// Address of other pages
+  BYTE                 page[ESC_SIMPAGES][256] ;	// Memory of other pages
+  int                  pagec ;				// Number of pages in use
+  BYTE                 spare ;				// Target of a bad address
+  DWORD                ds[ESC_SIMSTACK] ;		// Data stack
+  int                  sp ;				// Number of cells on data stack
+  DWORD                rs[ESC_SIMSTACK] ;		// Return stack
+  int                  rp ;				// Number of cells on return stack
+  struct esc_simword   words[ESC_SIMWORDS] ;		// Dictionary, primitives first
+  int                  wordc ;				// Number of words
+  int                  code[ESC_SIMCODE] ;		// Code of colon definitions
+  int                  codec ;				// Cells of code in use
+  DWORD                here ;				// Data space pointer
+  DWORD                baseaddr ;			// Address of BASE
+  BOOL                 compiling ;			// STATE
+  int                  cur ;				// Colon definition being compiled, -1 if none
+  DWORD                curhere ;			// HERE at the start of that definition
+  int                  cs[32] ;				// Control flow stack while compiling
+  int                  csp ;				// Number of entries on control flow stack
+  int                  skip ;				// Nesting of [IF] that is left out, 0 if none
+  char                 line[ESC_LINELEN] ;		// Line received
+  int                  linec ;				// Number of characters in line
+  int                  pos ;				// Position of the interpreter in line
+  char                 out[ESC_SIMQUEUE] ;		// Output for the host
+  int                  outc ;				// Number of bytes in out
+  long                 steps ;				// Words executed for this line
+  char                 error[64] ;			// Error in this line, empty if none
+  int                  lines ;				// Number of lines interpreted
+  int                  errors ;				// Number of lines with an error
+  LONGLONG             totsteps ;			// Words executed for all lines
+  struct esc_simeffect effects[ESC_SIMEFFECTS] ;	// First lines that changed the stack depth
+  int                  effectc ;			// Number of lines that changed the stack depth
+} ;
+
+// Output callback.  The data is only valid during the call and is not NUL-terminated.
+typedef void ( *esc_output_t ) ( void* ctx, int kind, const char* p, int len ) ;
+struct esc_session ;
+// Send a line and read the reply into a NUL-terminated buffer.  Returns the length of the reply.
+typedef int ( *esc_exchange_t ) ( struct esc_session* s, const char* line, char* reply, DWORD maxlen ) ;
+// Send a line without waiting for the reply.
+typedef BOOL ( *esc_send_t ) ( struct esc_session* s, const char* line ) ;
+// Hooks of esc_include().  The filter sees every source line first, returns an esc_action.
+typedef int ( *esc_filter_t ) ( struct esc_session* s, char* line, const char* file, int lineno ) ;
+// File events, the result is only used for ESC_REQUIRE.
+typedef int ( *esc_file_t ) ( struct esc_session* s, int event, const char* file, BOOL conditional,
+                              BOOL result ) ;
+
+struct esc_session					// Session with one target
+{
+  HANDLE          hcom ;				// Handle for serial I/O
+  char            target[32] ;				// Target system: "stm8ef", "mecrisp" or "zepto"
+  int             baudrate ;				// Baudrate for communication
+  char            flowctl[8] ;				// Flow control: "none", "xon" or "rts"
+  char            path[128] ;				// Search path for #include, #require and \res
+  char*           ( *ok_chk ) ( char* buf ) ;		// Check reply string from target
+  int             cellbits ;				// Cell size of the target in bits
+  int             timeout ;				// Time-out for a reply in msec
+  struct esc_dict dict[ESC_MAXDICT] ;			// Escom dictionary
+  int             dinx ;				// Number of entries in dictionary
+  esc_output_t    output ;				// Output callback, may be NULL
+  void*           ctx ;					// Context for output callback
+  esc_exchange_t  exchange ;				// Send line and read reply, default esc_exchange
+  esc_send_t      send ;				// Send line without reply, default esc_send
+  esc_exchange_t  upload ;				// Upload a source line, NULL: exchange
+  esc_filter_t    filter ;				// Filter for source lines, may be NULL
+  esc_file_t      file ;				// Hook for file events, may be NULL
+  int             lines ;				// Number of lines sent by esc_include
+  int             bytes ;				// Number of bytes sent by esc_include
+  char            errfile[128] ;			// File with error in last upload
+  int             errline ;				// Line with error in last upload
+  struct esc_sim* sim ;					// Simulated target instead of the port, or NULL
+  BOOL            compiling ;				// Target compiling, reply ends with the line
+  BOOL            nvm ;					// Target compiles to flash
+} ;
+
+// Session
+void        esc_init ( struct esc_session* s, const char* target, esc_output_t output, void* ctx ) ;
+void        esc_set_target ( struct esc_session* s, const char* target ) ;
+BOOL        esc_open ( struct esc_session* s, const char* port ) ;
+void        esc_close ( struct esc_session* s ) ;
+// Transport
+HANDLE      esc_open_comm ( const char* port, int baudrate, const char* flowctl ) ;
+void        esc_timeout ( struct esc_session* s, int t ) ;
+BOOL        esc_write ( struct esc_session* s, const char* buf, int len ) ;
+BOOL        esc_send ( struct esc_session* s, const char* line ) ;
+int         esc_read ( struct esc_session* s, char* buf, DWORD maxlen, int maxtry ) ;
+int         esc_poll ( struct esc_session* s, char* buf, DWORD maxlen ) ;
+int         esc_read_reply ( struct esc_session* s, char* buf, DWORD maxlen, int timeout ) ;
+int         esc_exchange ( struct esc_session* s, const char* line, char* reply, DWORD maxlen ) ;
+BOOL        esc_check ( struct esc_session* s, const char* line ) ;
+// Reply detection
+char*       esc_ok_stm8ef ( char* buf ) ;
+char*       esc_ok_mecrisp ( char* buf ) ;
+char*       esc_ok_zepto ( char* buf ) ;
+// Source handling
+BOOL        esc_token ( const char* str, int i, struct esc_span* tok ) ;
+const char* esc_search_file ( const char* path, const char* fnam, char* out, int outlen ) ;
+const char* esc_file_word ( const char* filename ) ;
+void        esc_strip_comment ( char* line ) ;
+void        esc_track ( struct esc_session* s, const char* line ) ;
+// Resource dictionary
+int         esc_search_dict ( struct esc_session* s, const char* symbol ) ;
+BOOL        esc_define ( struct esc_session* s, const char* symbol, WORD value ) ;
+BOOL        esc_load_res ( struct esc_session* s, const char* filespec ) ;
+BOOL        esc_handle_res ( struct esc_session* s, const char* line ) ;
+// Upload
+BOOL        esc_include ( struct esc_session* s, const char* filename, BOOL conditional ) ;
+// Simulator (escomsim.c)
+void        esc_sim_init ( struct esc_sim* m, const char* target ) ;
+void        esc_sim_input ( struct esc_sim* m, const char* buf, int len ) ;
+int         esc_sim_output ( struct esc_sim* m, char* buf, int maxlen ) ;
+
+#endif
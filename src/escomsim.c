@@ -0,0 +1,1664 @@
+//***************************************************************************************************
+//                              	E S C O M S I M . C					    *
+//***************************************************************************************************
+// Host-side Forth interpreter that takes the place of the serial port of a session.  See	    *
+// escomlib.h for the interface.								    *
+// The simulator receives the bytes that would go to the target.  It echoes them, interprets a	    *
+// line at its CR and answers with the output and the "ok" phrase of the dialect, or with an error  *
+// and a BELL.  All functions that talk to the target through esc_write, esc_read and esc_poll run  *
+// unchanged against it: uploads, the echo check, regression tests and the footprint.		    *
+// Only the core word set that stm8ef, mecrisp and zepto share is simulated.  Cells are 16 bits	    *
+// (big endian) for stm8ef and 32 bits for the others.  Division is floored for stm8ef, like	    *
+// eForth, and symmetric for the others.  Addresses outside the RAM of the simulator,		    *
+// like the registers from an .efr file, act as plain RAM.  Words with native code (CODE, or , and  *
+// C, inside [ ] in a colon definition) can be defined, but executing them is an error.		    *
+// There are no global variables and no static buffers: everything is in struct esc_sim.	    *
+//***************************************************************************************************
+//												    *
+// Revision    Auth.  Remarks									    *
+// ----------  -----  ----------------------------------------------------------------------------- *
+// 18-10-2026  ES     First set-up for escom 0.1.27.						    *
+//***************************************************************************************************
+#include <stdio.h>	// Console I/O
+#include <stdlib.h>	// Standard library definitions
+#include <string.h>	// String function definitions
+#include <ctype.h>	// Character classes
+#include <stdarg.h>	// Variable number of arguments
+#include <windows.h>	// Windows specifics
+#include "escomlib.h"	// Interface of this library
+
+// Kinds of words
+#define SIM_PRIM      0					// Primitive, param is the operation
+#define SIM_COLON     1					// Colon definition, param is the start in code
+#define SIM_CONST     2					// Constant, param is the value
+#define SIM_VAR       3					// Variable, param is the address
+#define SIM_CREATE    4					// CREATE, param is the address, does is the DOES> part
+#define SIM_VALUE     5					// VALUE, param is the address of the value
+#define SIM_DEFER     6					// DEFER, param is the address of the execution token
+// Flags of words
+#define SIM_IMMEDIATE 1					// Executed while compiling
+#define SIM_HIDDEN    2					// Definition not finished yet
+#define SIM_NATIVE    4					// Contains native code, cannot be executed
+
+enum sim_op						// Operations of the primitives
+{
+  // Compiled by the control words, these use the code pointer
+  OP_LIT, OP_BRANCH, OP_0BRANCH, OP_DO, OP_QDO, OP_LOOP, OP_PLOOP, OP_NEXT, OP_EXIT, OP_DOES,
+  OP_ABORTQ, OP_EXECUTE, OP_LEAVE,
+  // The others
+  OP_DUP, OP_DROP, OP_SWAP, OP_OVER, OP_ROT, OP_MROT, OP_NIP, OP_TUCK, OP_2DUP, OP_2DROP,
+  OP_2SWAP, OP_2OVER, OP_QDUP, OP_PICK, OP_DEPTH, OP_TOR, OP_RFROM, OP_RFETCH, OP_I, OP_J,
+  OP_UNLOOP, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_DIVMOD, OP_MULDIV, OP_MULDIVMOD,
+  OP_NEGATE, OP_ABS, OP_MIN, OP_MAX, OP_INC, OP_DEC, OP_2MUL, OP_2DIV, OP_AND, OP_OR, OP_XOR,
+  OP_INVERT, OP_LSHIFT, OP_RSHIFT, OP_EQ, OP_NE, OP_LT, OP_GT, OP_ULT, OP_UGT, OP_0EQ, OP_0NE,
+  OP_0LT, OP_0GT, OP_WITHIN, OP_TRUE, OP_FALSE, OP_FETCH, OP_STORE, OP_CFETCH, OP_CSTORE,
+  OP_PSTORE, OP_CELL, OP_CELLS, OP_CELLP, OP_HERE, OP_ALLOT, OP_COMMA, OP_CCOMMA, OP_ALIGN,
+  OP_ALIGNED, OP_FILL, OP_MOVE, OP_COUNT, OP_BASE, OP_DOT, OP_UDOT, OP_DOTR, OP_UDOTR, OP_DOTS,
+  OP_QUEST, OP_EMIT, OP_CR, OP_SPACE, OP_SPACES, OP_BL, OP_TYPE, OP_HEX, OP_DECIMAL, OP_COLON,
+  OP_NONAME, OP_SEMI, OP_CONSTANT, OP_VARIABLE, OP_CREATE, OP_BUFFER, OP_DOESC, OP_VALUE, OP_TO,
+  OP_DEFER, OP_IS, OP_IMMEDIATE, OP_TICK, OP_BTICK, OP_LBRACKET, OP_RBRACKET, OP_LITERAL,
+  OP_RECURSE, OP_CHAR, OP_BCHAR, OP_PAREN, OP_BACKSLASH, OP_DOTQ, OP_SQ, OP_DOTP, OP_ABORTQC,
+  OP_ABORT, OP_IF, OP_ELSE, OP_THEN, OP_BEGIN, OP_UNTIL, OP_AGAIN, OP_WHILE, OP_REPEAT, OP_DOC,
+  OP_QDOC, OP_LOOPC, OP_PLOOPC, OP_FOR, OP_NEXTC, OP_BIF, OP_BELSE, OP_BTHEN, OP_WORDS, OP_MS,
+  OP_KEYQ, OP_CODE, OP_NOP,
+  SIM_OPS						// Number of operations
+} ;
+
+struct sim_prim						// Primitive in the table below
+{
+  const char* name ;					// Name, the index in the table is the operation
+  BYTE        flags ;					// SIM_IMMEDIATE or 0
+} ;
+
+struct sim_alias					// Other name of a primitive
+{
+  const char* name ;					// Name
+  BYTE        op ;					// Operation
+} ;
+
+// The primitives.  They are the first words of the dictionary, so the execution token of a
+// primitive is its operation.
+static const struct sim_prim sim_prims[SIM_OPS] =
+{
+  [OP_LIT] = { "(LIT)", 0 },         [OP_BRANCH] = { "(BRANCH)", 0 },
+  [OP_0BRANCH] = { "(0BRANCH)", 0 }, [OP_DO] = { "(DO)", 0 },
+  [OP_QDO] = { "(?DO)", 0 },         [OP_LOOP] = { "(LOOP)", 0 },
+  [OP_PLOOP] = { "(+LOOP)", 0 },     [OP_NEXT] = { "(NEXT)", 0 },
+  [OP_EXIT] = { "EXIT", 0 },         [OP_DOES] = { "(DOES>)", 0 },
+  [OP_ABORTQ] = { "(ABORT\")", 0 },  [OP_EXECUTE] = { "EXECUTE", 0 },
+  [OP_LEAVE] = { "LEAVE", 0 },       [OP_DUP] = { "DUP", 0 },
+  [OP_DROP] = { "DROP", 0 },         [OP_SWAP] = { "SWAP", 0 },
+  [OP_OVER] = { "OVER", 0 },         [OP_ROT] = { "ROT", 0 },
+  [OP_MROT] = { "-ROT", 0 },         [OP_NIP] = { "NIP", 0 },
+  [OP_TUCK] = { "TUCK", 0 },         [OP_2DUP] = { "2DUP", 0 },
+  [OP_2DROP] = { "2DROP", 0 },       [OP_2SWAP] = { "2SWAP", 0 },
+  [OP_2OVER] = { "2OVER", 0 },       [OP_QDUP] = { "?DUP", 0 },
+  [OP_PICK] = { "PICK", 0 },         [OP_DEPTH] = { "DEPTH", 0 },
+  [OP_TOR] = { ">R", 0 },            [OP_RFROM] = { "R>", 0 },
+  [OP_RFETCH] = { "R@", 0 },         [OP_I] = { "I", 0 },
+  [OP_J] = { "J", 0 },               [OP_UNLOOP] = { "UNLOOP", 0 },
+  [OP_ADD] = { "+", 0 },             [OP_SUB] = { "-", 0 },
+  [OP_MUL] = { "*", 0 },             [OP_DIV] = { "/", 0 },
+  [OP_MOD] = { "MOD", 0 },           [OP_DIVMOD] = { "/MOD", 0 },
+  [OP_MULDIV] = { "*/", 0 },         [OP_MULDIVMOD] = { "*/MOD", 0 },
+  [OP_NEGATE] = { "NEGATE", 0 },     [OP_ABS] = { "ABS", 0 },
+  [OP_MIN] = { "MIN", 0 },           [OP_MAX] = { "MAX", 0 },
+  [OP_INC] = { "1+", 0 },            [OP_DEC] = { "1-", 0 },
+  [OP_2MUL] = { "2*", 0 },           [OP_2DIV] = { "2/", 0 },
+  [OP_AND] = { "AND", 0 },           [OP_OR] = { "OR", 0 },
+  [OP_XOR] = { "XOR", 0 },           [OP_INVERT] = { "INVERT", 0 },
+  [OP_LSHIFT] = { "LSHIFT", 0 },     [OP_RSHIFT] = { "RSHIFT", 0 },
+  [OP_EQ] = { "=", 0 },              [OP_NE] = { "<>", 0 },
+  [OP_LT] = { "<", 0 },              [OP_GT] = { ">", 0 },
+  [OP_ULT] = { "U<", 0 },            [OP_UGT] = { "U>", 0 },
+  [OP_0EQ] = { "0=", 0 },            [OP_0NE] = { "0<>", 0 },
+  [OP_0LT] = { "0<", 0 },            [OP_0GT] = { "0>", 0 },
+  [OP_WITHIN] = { "WITHIN", 0 },     [OP_TRUE] = { "TRUE", 0 },
+  [OP_FALSE] = { "FALSE", 0 },       [OP_FETCH] = { "@", 0 },
+  [OP_STORE] = { "!", 0 },           [OP_CFETCH] = { "C@", 0 },
+  [OP_CSTORE] = { "C!", 0 },         [OP_PSTORE] = { "+!", 0 },
+  [OP_CELL] = { "CELL", 0 },         [OP_CELLS] = { "CELLS", 0 },
+  [OP_CELLP] = { "CELL+", 0 },       [OP_HERE] = { "HERE", 0 },
+  [OP_ALLOT] = { "ALLOT", 0 },       [OP_COMMA] = { ",", 0 },
+  [OP_CCOMMA] = { "C,", 0 },         [OP_ALIGN] = { "ALIGN", 0 },
+  [OP_ALIGNED] = { "ALIGNED", 0 },   [OP_FILL] = { "FILL", 0 },
+  [OP_MOVE] = { "MOVE", 0 },         [OP_COUNT] = { "COUNT", 0 },
+  [OP_BASE] = { "BASE", 0 },         [OP_DOT] = { ".", 0 },
+  [OP_UDOT] = { "U.", 0 },           [OP_DOTR] = { ".R", 0 },
+  [OP_UDOTR] = { "U.R", 0 },         [OP_DOTS] = { ".S", 0 },
+  [OP_QUEST] = { "?", 0 },           [OP_EMIT] = { "EMIT", 0 },
+  [OP_CR] = { "CR", 0 },             [OP_SPACE] = { "SPACE", 0 },
+  [OP_SPACES] = { "SPACES", 0 },     [OP_BL] = { "BL", 0 },
+  [OP_TYPE] = { "TYPE", 0 },         [OP_HEX] = { "HEX", 0 },
+  [OP_DECIMAL] = { "DECIMAL", 0 },   [OP_COLON] = { ":", 0 },
+  [OP_NONAME] = { ":NONAME", 0 },    [OP_SEMI] = { ";", SIM_IMMEDIATE },
+  [OP_CONSTANT] = { "CONSTANT", 0 }, [OP_VARIABLE] = { "VARIABLE", 0 },
+  [OP_CREATE] = { "CREATE", 0 },     [OP_BUFFER] = { "BUFFER:", 0 },
+  [OP_DOESC] = { "DOES>", SIM_IMMEDIATE },
+  [OP_VALUE] = { "VALUE", 0 },       [OP_TO] = { "TO", SIM_IMMEDIATE },
+  [OP_DEFER] = { "DEFER", 0 },       [OP_IS] = { "IS", SIM_IMMEDIATE },
+  [OP_IMMEDIATE] = { "IMMEDIATE", 0 },
+  [OP_TICK] = { "'", 0 },            [OP_BTICK] = { "[']", SIM_IMMEDIATE },
+  [OP_LBRACKET] = { "[", SIM_IMMEDIATE },
+  [OP_RBRACKET] = { "]", 0 },        [OP_LITERAL] = { "LITERAL", SIM_IMMEDIATE },
+  [OP_RECURSE] = { "RECURSE", SIM_IMMEDIATE },
+  [OP_CHAR] = { "CHAR", 0 },         [OP_BCHAR] = { "[CHAR]", SIM_IMMEDIATE },
+  [OP_PAREN] = { "(", SIM_IMMEDIATE },
+  [OP_BACKSLASH] = { "\\", SIM_IMMEDIATE },
+  [OP_DOTQ] = { ".\"", SIM_IMMEDIATE },
+  [OP_SQ] = { "S\"", SIM_IMMEDIATE },
+  [OP_DOTP] = { ".(", SIM_IMMEDIATE },
+  [OP_ABORTQC] = { "ABORT\"", SIM_IMMEDIATE },
+  [OP_ABORT] = { "ABORT", 0 },       [OP_IF] = { "IF", SIM_IMMEDIATE },
+  [OP_ELSE] = { "ELSE", SIM_IMMEDIATE },
+  [OP_THEN] = { "THEN", SIM_IMMEDIATE },
+  [OP_BEGIN] = { "BEGIN", SIM_IMMEDIATE },
+  [OP_UNTIL] = { "UNTIL", SIM_IMMEDIATE },
+  [OP_AGAIN] = { "AGAIN", SIM_IMMEDIATE },
+  [OP_WHILE] = { "WHILE", SIM_IMMEDIATE },
+  [OP_REPEAT] = { "REPEAT", SIM_IMMEDIATE },
+  [OP_DOC] = { "DO", SIM_IMMEDIATE },
+  [OP_QDOC] = { "?DO", SIM_IMMEDIATE },
+  [OP_LOOPC] = { "LOOP", SIM_IMMEDIATE },
+  [OP_PLOOPC] = { "+LOOP", SIM_IMMEDIATE },
+  [OP_FOR] = { "FOR", SIM_IMMEDIATE },
+  [OP_NEXTC] = { "NEXT", SIM_IMMEDIATE },
+  [OP_BIF] = { "[IF]", SIM_IMMEDIATE },
+  [OP_BELSE] = { "[ELSE]", SIM_IMMEDIATE },
+  [OP_BTHEN] = { "[THEN]", SIM_IMMEDIATE },
+  [OP_WORDS] = { "WORDS", 0 },       [OP_MS] = { "MS", 0 },
+  [OP_KEYQ] = { "?KEY", 0 },         [OP_CODE] = { "CODE", 0 },
+  [OP_NOP] = { "NOOP", 0 }
+} ;
+
+// Other names, and the words that only matter on a real target (flash, optimization hints).
+static const struct sim_alias sim_aliases[] =
+{
+  { "NOT", OP_INVERT },      { "CMOVE", OP_MOVE },          { "KEY?", OP_KEYQ },
+  { "NVM", OP_NOP },         { "RAM", OP_NOP },             { "COMPILETOFLASH", OP_NOP },
+  { "COMPILETORAM", OP_NOP }, { "COMPILE-ONLY", OP_NOP },   { "INLINE", OP_NOP },
+  { "0-FOLDABLE", OP_NOP },  { "1-FOLDABLE", OP_NOP },      { "2-FOLDABLE", OP_NOP },
+  { "3-FOLDABLE", OP_NOP },  { "4-FOLDABLE", OP_NOP },      { "5-FOLDABLE", OP_NOP },
+  { "6-FOLDABLE", OP_NOP },  { "7-FOLDABLE", OP_NOP },      { NULL, 0 }
+} ;
+
+
+//***************************************************************************************************
+//					S I M _ E R R O R					    *
+//***************************************************************************************************
+// Set the error of the current line.  Only the first error of a line is kept.			    *
+//***************************************************************************************************
+static void sim_error ( struct esc_sim* m, const char* format, ... )
+{
+  va_list varArgs ;					// For variable number of params
+
+  if ( *m->error )					// Already an error?
+  {
+    return ;						// Yes, keep the first
+  }
+  va_start ( varArgs, format ) ;
+  vsnprintf ( m->error, sizeof(m->error), format, varArgs ) ;
+  va_end ( varArgs ) ;
+}
+
+
+//***************************************************************************************************
+//					S I M _ O U T						    *
+//***************************************************************************************************
+// Queue output for the host.  Output that does not fit is lost, like on a real port.		    *
+//***************************************************************************************************
+static void sim_out ( struct esc_sim* m, const char* p, int len )
+{
+  if ( len > ESC_SIMQUEUE - m->outc )			// Room in queue?
+  {
+    len = ESC_SIMQUEUE - m->outc ;			// No, keep what fits
+  }
+  memcpy ( m->out + m->outc, p, len ) ;
+  m->outc += len ;
+}
+
+
+//***************************************************************************************************
+//				S I M _ S T A C K   F U N C T I O N S				    *
+//***************************************************************************************************
+// Push and pop on the data and return stack.  Values are kept as cells of the target.		    *
+//***************************************************************************************************
+static void sim_push ( struct esc_sim* m, DWORD v )
+{
+  if ( m->sp == ESC_SIMSTACK )
+  {
+    sim_error ( m, "stack overflow" ) ;
+    return ;
+  }
+  m->ds[m->sp++] = v & m->mask ;
+}
+
+static DWORD sim_pop ( struct esc_sim* m )
+{
+  if ( m->sp == 0 )
+  {
+    sim_error ( m, "stack underflow" ) ;
+    return 0 ;
+  }
+  return m->ds[--m->sp] ;
+}
+
+static void sim_rpush ( struct esc_sim* m, DWORD v )
+{
+  if ( m->rp == ESC_SIMSTACK )
+  {
+    sim_error ( m, "return stack overflow" ) ;
+    return ;
+  }
+  m->rs[m->rp++] = v & m->mask ;
+}
+
+static DWORD sim_rpop ( struct esc_sim* m )
+{
+  if ( m->rp == 0 )
+  {
+    sim_error ( m, "return stack underflow" ) ;
+    return 0 ;
+  }
+  return m->rs[--m->rp] ;
+}
+
+
+//***************************************************************************************************
+//					S I M _ S I G N E D					    *
+//***************************************************************************************************
+// Value of a cell as a signed number.								    *
+//***************************************************************************************************
+static LONGLONG sim_signed ( struct esc_sim* m, DWORD v )
+{
+  if ( m->cellbits == 16 )
+  {
+    return (SHORT)( v & 0xFFFF ) ;
+  }
+  return (int)( v & 0xFFFFFFFF ) ;
+}
+
+
+//***************************************************************************************************
+//					S I M _ M E M						    *
+//***************************************************************************************************
+// Pointer to the byte at an address of the target.  Addresses outside the RAM get a page of 256    *
+// bytes when they are first used.								    *
+//***************************************************************************************************
+static BYTE* sim_mem ( struct esc_sim* m, DWORD a )
+{
+  DWORD pa ;						// Address of page
+  int   i ;						// Index in pages
+
+  a &= m->mask ;
+  if ( a - m->rambase < ESC_SIMRAM )			// In RAM?
+  {
+    return &m->ram[a - m->rambase] ;			// Yes, simple
+  }
+  pa = a & ~0xFF ;
+  for ( i = 0 ; i < m->pagec ; i++ )			// Page already in use?
+  {
+    if ( m->pageaddr[i] == pa )
+    {
+      return &m->page[i][a & 0xFF] ;
+    }
+  }
+  if ( m->pagec < ESC_SIMPAGES )			// Room for another page?
+  {
+    m->pageaddr[m->pagec] = pa ;			// Yes, it starts empty
+    memset ( m->page[m->pagec], 0, sizeof(m->page[0]) ) ;
+    return &m->page[m->pagec++][a & 0xFF] ;
+  }
+  sim_error ( m, "no memory at $%lX", (unsigned long)a ) ;
+  return &m->spare ;					// Harmless, the line fails
+}
+
+
+//***************************************************************************************************
+//				S I M _ F E T C H   A N D   S I M _ S T O R E			    *
+//***************************************************************************************************
+// Read and write a cell in the byte order of the target.					    *
+//***************************************************************************************************
+static DWORD sim_fetch ( struct esc_sim* m, DWORD a )
+{
+  int   n = m->cellbits / 8 ;				// Bytes per cell
+  DWORD v = 0 ;						// Result
+  int   i ;
+
+  for ( i = 0 ; i < n ; i++ )
+  {
+    if ( m->bigendian )
+    {
+      v = ( v << 8 ) | *sim_mem ( m, a + i ) ;
+    }
+    else
+    {
+      v |= (DWORD)*sim_mem ( m, a + i ) << ( 8 * i ) ;
+    }
+  }
+  return v ;
+}
+
+static void sim_store ( struct esc_sim* m, DWORD a, DWORD v )
+{
+  int n = m->cellbits / 8 ;				// Bytes per cell
+  int i ;
+
+  for ( i = 0 ; i < n ; i++ )
+  {
+    *sim_mem ( m, a + i ) = v >> ( 8 * ( m->bigendian ? n - 1 - i : i ) ) ;
+  }
+}
+
+
+//***************************************************************************************************
+//					S I M _ A L L O T					    *
+//***************************************************************************************************
+// Reserve n bytes of data space.  Returns the address of the first byte.			    *
+//***************************************************************************************************
+static DWORD sim_allot ( struct esc_sim* m, LONGLONG n )
+{
+  DWORD    a = m->here ;				// Start of space
+  LONGLONG used = (LONGLONG)( m->here - m->rambase ) + n ;	// Data space after allot
+
+  if ( used > ESC_SIMRAM - 256 || used < 16 )		// Keep room for transient strings
+  {
+    sim_error ( m, "dictionary full" ) ;
+    return a ;
+  }
+  m->here = ( m->here + n ) & m->mask ;
+  return a ;
+}
+
+
+//***************************************************************************************************
+//					S I M _ C O M P I L E					    *
+//***************************************************************************************************
+// Add a cell to the code of the definition that is compiled.  Code is kept apart from the data	    *
+// space, but HERE grows by a cell as well, so the footprint of a word is realistic.		    *
+//***************************************************************************************************
+static void sim_compile ( struct esc_sim* m, int v )
+{
+  if ( m->codec == ESC_SIMCODE )
+  {
+    sim_error ( m, "code space full" ) ;
+    return ;
+  }
+  m->code[m->codec++] = v ;
+  sim_allot ( m, m->cellbits / 8 ) ;
+}
+
+
+//***************************************************************************************************
+//				S I M _ C O N T R O L   F U N C T I O N S			    *
+//***************************************************************************************************
+// Push and pop on the control flow stack while compiling.					    *
+//***************************************************************************************************
+static void sim_cpush ( struct esc_sim* m, int v )
+{
+  if ( m->csp == sizeof(m->cs) / sizeof(m->cs[0]) )
+  {
+    sim_error ( m, "control structure too deep" ) ;
+    return ;
+  }
+  m->cs[m->csp++] = v ;
+}
+
+static int sim_cpop ( struct esc_sim* m )
+{
+  if ( m->csp == 0 )
+  {
+    sim_error ( m, "unbalanced control structure" ) ;
+    return m->codec ;					// Harmless, the line fails
+  }
+  return m->cs[--m->csp] ;
+}
+
+
+//***************************************************************************************************
+//					S I M _ P A R S E					    *
+//***************************************************************************************************
+// Get the next word of the line.  Returns FALSE at the end of the line.			    *
+//***************************************************************************************************
+static BOOL sim_parse ( struct esc_sim* m, char* tok, int maxlen )
+{
+  int n = 0 ;						// Length of token
+
+  while ( m->line[m->pos] && isspace ( (BYTE)m->line[m->pos] ) )
+  {
+    m->pos++ ;						// Skip spaces
+  }
+  while ( m->line[m->pos] && ! isspace ( (BYTE)m->line[m->pos] ) )
+  {
+    if ( n < maxlen - 1 )
+    {
+      tok[n++] = m->line[m->pos] ;
+    }
+    m->pos++ ;
+  }
+  tok[n] = '\0' ;
+  return ( n > 0 ) ;
+}
+
+
+//***************************************************************************************************
+//					S I M _ P A R S E _ T O					    *
+//***************************************************************************************************
+// Get the text up to a delimiter, like the string of ." or the comment of (.  The space after	    *
+// the word is skipped.  Returns the length of the text, the start is in *start.		    *
+//***************************************************************************************************
+static int sim_parse_to ( struct esc_sim* m, char delim, const char** start )
+{
+  const char* p ;					// End of text
+
+  if ( m->line[m->pos] )				// Skip the space after the word
+  {
+    m->pos++ ;
+  }
+  *start = m->line + m->pos ;
+  if ( ( p = strchr ( *start, delim ) ) == NULL )	// Text ends at the end of the line?
+  {
+    p = *start + strlen ( *start ) ;
+  }
+  m->pos = p - m->line + ( *p ? 1 : 0 ) ;		// Continue after the delimiter
+  return p - *start ;
+}
+
+
+//***************************************************************************************************
+//					S I M _ F I N D						    *
+//***************************************************************************************************
+// Find a word in the dictionary, newest first.  The case of the name does not matter.		    *
+// Returns the execution token or -1.								    *
+//***************************************************************************************************
+static int sim_find ( struct esc_sim* m, const char* name )
+{
+  int i ;
+
+  for ( i = m->wordc - 1 ; i >= 0 ; i-- )
+  {
+    if ( ! ( m->words[i].flags & SIM_HIDDEN ) &&
+         strcasecmp ( m->words[i].name, name ) == 0 )
+    {
+      return i ;
+    }
+  }
+  return -1 ;
+}
+
+
+//***************************************************************************************************
+//					S I M _ A D D						    *
+//***************************************************************************************************
+// Add a word to the dictionary.  Returns the execution token or -1 if the dictionary is full.	    *
+//***************************************************************************************************
+static int sim_add ( struct esc_sim* m, const char* name, int kind, DWORD param )
+{
+  struct esc_simword* w ;				// New word
+
+  if ( m->wordc == ESC_SIMWORDS )
+  {
+    sim_error ( m, "too many words" ) ;
+    return -1 ;
+  }
+  w = &m->words[m->wordc] ;
+  snprintf ( w->name, sizeof(w->name), "%s", name ) ;
+  w->kind = kind ;
+  w->flags = 0 ;
+  w->param = param ;
+  w->does = -1 ;
+  return m->wordc++ ;
+}
+
+
+//***************************************************************************************************
+//					S I M _ D E F I N E					    *
+//***************************************************************************************************
+// Parse a name and add a word with that name.  Returns the execution token or -1.		    *
+//***************************************************************************************************
+static int sim_define ( struct esc_sim* m, int kind, DWORD param )
+{
+  char name[32] ;					// Name of new word
+
+  if ( ! sim_parse ( m, name, sizeof(name) ) )
+  {
+    sim_error ( m, "name missing" ) ;
+    return -1 ;
+  }
+  return sim_add ( m, name, kind, param ) ;
+}
+
+
+//***************************************************************************************************
+//					S I M _ N U M B E R					    *
+//***************************************************************************************************
+// Convert a word to a number in the current base.  The prefixes $, % and # select hex, binary and  *
+// decimal, 'c' is a character.  Returns FALSE if the word is not a number.			    *
+//***************************************************************************************************
+static BOOL sim_number ( struct esc_sim* m, const char* tok, DWORD* v )
+{
+  DWORD    base = sim_fetch ( m, m->baseaddr ) ;	// Current base
+  ULONGLONG n = 0 ;					// Result
+  BOOL     neg = FALSE ;				// Negative number
+  int      d ;						// Value of digit
+
+  if ( tok[0] == '\'' && tok[1] && tok[2] == '\'' && tok[3] == '\0' )
+  {
+    *v = (BYTE)tok[1] ;					// Character
+    return TRUE ;
+  }
+  if ( *tok == '-' )
+  {
+    neg = TRUE ;
+    tok++ ;
+  }
+  switch ( *tok )
+  {
+    case '$' : base = 16 ; tok++ ; break ;
+    case '%' : base = 2 ;  tok++ ; break ;
+    case '#' : base = 10 ; tok++ ; break ;
+  }
+  if ( *tok == '-' && ! neg )				// Sign after prefix
+  {
+    neg = TRUE ;
+    tok++ ;
+  }
+  if ( *tok == '\0' || base < 2 || base > 36 )
+  {
+    return FALSE ;
+  }
+  for ( ; *tok ; tok++ )
+  {
+    if ( isdigit ( (BYTE)*tok ) )
+    {
+      d = *tok - '0' ;
+    }
+    else if ( isalpha ( (BYTE)*tok ) )
+    {
+      d = toupper ( (BYTE)*tok ) - 'A' + 10 ;
+    }
+    else
+    {
+      return FALSE ;
+    }
+    if ( d >= base )
+    {
+      return FALSE ;
+    }
+    n = n * base + d ;
+  }
+  *v = ( neg ? -n : n ) & m->mask ;
+  return TRUE ;
+}
+
+
+//***************************************************************************************************
+//					S I M _ D O T						    *
+//***************************************************************************************************
+// Print a number in the current base, right aligned in width characters.			    *
+//***************************************************************************************************
+static void sim_dot ( struct esc_sim* m, DWORD v, BOOL sign, int width, BOOL space )
+{
+  char      buf[48] ;					// Digits, filled from the end
+  int       i = sizeof(buf) ;				// First used position
+  DWORD     base = sim_fetch ( m, m->baseaddr ) ;	// Current base
+  ULONGLONG u = v & m->mask ;				// Value to print
+  BOOL      neg = FALSE ;				// Negative number
+  int       d ;						// Value of digit
+
+  if ( base < 2 || base > 36 )
+  {
+    base = 10 ;
+  }
+  if ( sign && sim_signed ( m, v ) < 0 )
+  {
+    neg = TRUE ;
+    u = -sim_signed ( m, v ) ;
+  }
+  do
+  {
+    d = u % base ;
+    buf[--i] = ( d < 10 ) ? '0' + d : 'A' + d - 10 ;
+    u /= base ;
+  } while ( u ) ;
+  if ( neg )
+  {
+    buf[--i] = '-' ;
+  }
+  while ( i > 1 && (int)sizeof(buf) - i < width )	// Align
+  {
+    buf[--i] = ' ' ;
+  }
+  sim_out ( m, buf + i, sizeof(buf) - i ) ;
+  if ( space )
+  {
+    sim_out ( m, " ", 1 ) ;
+  }
+}
+
+
+//***************************************************************************************************
+//					S I M _ S T R I N G					    *
+//***************************************************************************************************
+// Handle a string word (." S" .( ABORT").  While compiling, the string is put in data space and    *
+// its address and length are compiled.  Otherwise the string is printed or left on the stack.	    *
+//***************************************************************************************************
+static void sim_string ( struct esc_sim* m, int op )
+{
+  const char* p ;					// Start of string
+  int         len ;					// Length of string
+  DWORD       a ;					// Address of string
+  int         i ;
+
+  len = sim_parse_to ( m, ( op == OP_DOTP ) ? ')' : '"', &p ) ;
+  if ( op == OP_DOTP || ( op == OP_DOTQ && ! m->compiling ) )
+  {
+    sim_out ( m, p, len ) ;				// Print now
+    return ;
+  }
+  if ( m->compiling )
+  {
+    a = sim_allot ( m, len ) ;				// Keep in data space
+  }
+  else
+  {
+    a = m->rambase + ESC_SIMRAM - 256 ;			// Transient, like PAD
+    len = ( len > 255 ) ? 255 : len ;
+  }
+  for ( i = 0 ; i < len ; i++ )
+  {
+    *sim_mem ( m, a + i ) = p[i] ;
+  }
+  if ( ! m->compiling )					// S" while interpreting
+  {
+    sim_push ( m, a ) ;
+    sim_push ( m, len ) ;
+    return ;
+  }
+  sim_compile ( m, OP_LIT ) ;
+  sim_compile ( m, a ) ;
+  sim_compile ( m, OP_LIT ) ;
+  sim_compile ( m, len ) ;
+  if ( op == OP_DOTQ )
+  {
+    sim_compile ( m, OP_TYPE ) ;
+  }
+  else if ( op == OP_ABORTQC )
+  {
+    sim_compile ( m, OP_ABORTQ ) ;
+  }
+}
+
+
+//***************************************************************************************************
+//					S I M _ C O N T R O L					    *
+//***************************************************************************************************
+// Compile a control structure word.  The control flow stack holds positions in code.		    *
+//***************************************************************************************************
+static void sim_control ( struct esc_sim* m, int op )
+{
+  int a, b ;						// Positions in code
+
+  if ( ! m->compiling )
+  {
+    sim_error ( m, "%s is compile only", sim_prims[op].name ) ;
+    return ;
+  }
+  switch ( op )
+  {
+    case OP_IF :					// Forward branch, resolved by ELSE or THEN
+      sim_compile ( m, OP_0BRANCH ) ;
+      sim_cpush ( m, m->codec ) ;
+      sim_compile ( m, 0 ) ;
+      break ;
+    case OP_ELSE :
+      sim_compile ( m, OP_BRANCH ) ;
+      a = m->codec ;
+      sim_compile ( m, 0 ) ;
+      b = sim_cpop ( m ) ;
+      m->code[b] = m->codec ;
+      sim_cpush ( m, a ) ;
+      break ;
+    case OP_THEN :
+      a = sim_cpop ( m ) ;
+      m->code[a] = m->codec ;
+      break ;
+    case OP_BEGIN :					// Backward branch target
+    case OP_FOR :
+      if ( op == OP_FOR )
+      {
+        sim_compile ( m, OP_TOR ) ;			// Count on the return stack
+      }
+      sim_cpush ( m, m->codec ) ;
+      break ;
+    case OP_UNTIL :
+    case OP_AGAIN :
+      sim_compile ( m, ( op == OP_UNTIL ) ? OP_0BRANCH : OP_BRANCH ) ;
+      sim_compile ( m, sim_cpop ( m ) ) ;
+      break ;
+    case OP_WHILE :					// Forward branch under the BEGIN
+      a = sim_cpop ( m ) ;
+      sim_compile ( m, OP_0BRANCH ) ;
+      sim_cpush ( m, m->codec ) ;
+      sim_compile ( m, 0 ) ;
+      sim_cpush ( m, a ) ;
+      break ;
+    case OP_REPEAT :
+      sim_compile ( m, OP_BRANCH ) ;
+      sim_compile ( m, sim_cpop ( m ) ) ;
+      a = sim_cpop ( m ) ;
+      m->code[a] = m->codec ;
+      break ;
+    case OP_DOC :					// Operand is the exit of the loop, for LEAVE
+    case OP_QDOC :
+      sim_compile ( m, ( op == OP_DOC ) ? OP_DO : OP_QDO ) ;
+      sim_cpush ( m, m->codec ) ;
+      sim_compile ( m, 0 ) ;
+      break ;
+    case OP_LOOPC :
+    case OP_PLOOPC :
+      a = sim_cpop ( m ) ;
+      sim_compile ( m, ( op == OP_LOOPC ) ? OP_LOOP : OP_PLOOP ) ;
+      sim_compile ( m, a + 1 ) ;			// Back to the start of the body
+      m->code[a] = m->codec ;
+      break ;
+    case OP_NEXTC :
+      sim_compile ( m, OP_NEXT ) ;
+      sim_compile ( m, sim_cpop ( m ) ) ;
+      break ;
+  }
+}
+
+
+//***************************************************************************************************
+//					S I M _ W O R D S					    *
+//***************************************************************************************************
+// Print the names of the words, newest first, like WORDS on the target.			    *
+//***************************************************************************************************
+static void sim_words ( struct esc_sim* m )
+{
+  int col = 0 ;						// Position on output line
+  int len ;						// Length of name
+  int i ;
+
+  for ( i = m->wordc - 1 ; i >= 0 ; i-- )
+  {
+    len = strlen ( m->words[i].name ) ;
+    if ( len == 0 || ( m->words[i].flags & SIM_HIDDEN ) )
+    {
+      continue ;
+    }
+    if ( col + len >= 80 )
+    {
+      sim_out ( m, "\r\n", 2 ) ;
+      col = 0 ;
+    }
+    sim_out ( m, m->words[i].name, len ) ;
+    sim_out ( m, " ", 1 ) ;
+    col += len + 1 ;
+  }
+}
+
+
+//***************************************************************************************************
+//					S I M _ P R I M						    *
+//***************************************************************************************************
+// Execute a primitive that does not use the code pointer.					    *
+//***************************************************************************************************
+static void sim_prim ( struct esc_sim* m, int op )
+{
+  char        name[32] ;				// Parsed name
+  const char* p ;					// Parsed text
+  DWORD       a, b, c ;					// Operands
+  LONGLONG    sa, sb, sc ;				// Signed operands
+  DWORD       t = m->mask ;				// Flag for true
+  int         cell = m->cellbits / 8 ;			// Bytes per cell
+  int         w ;					// Execution token
+  LONGLONG    i ;
+
+  if ( ! m->compiling &&				// Only valid in a definition?
+       ( op == OP_DOESC || op == OP_BTICK || op == OP_LITERAL || op == OP_RECURSE ||
+         op == OP_BCHAR || op == OP_ABORTQC ) )
+  {
+    sim_error ( m, "%s is compile only", sim_prims[op].name ) ;
+    return ;
+  }
+  switch ( op )
+  {
+    case OP_DUP :    a = sim_pop ( m ) ; sim_push ( m, a ) ; sim_push ( m, a ) ; break ;
+    case OP_DROP :   sim_pop ( m ) ; break ;
+    case OP_SWAP :   b = sim_pop ( m ) ; a = sim_pop ( m ) ; sim_push ( m, b ) ; sim_push ( m, a ) ;
+                     break ;
+    case OP_OVER :   b = sim_pop ( m ) ; a = sim_pop ( m ) ; sim_push ( m, a ) ; sim_push ( m, b ) ;
+                     sim_push ( m, a ) ; break ;
+    case OP_ROT :    c = sim_pop ( m ) ; b = sim_pop ( m ) ; a = sim_pop ( m ) ;
+                     sim_push ( m, b ) ; sim_push ( m, c ) ; sim_push ( m, a ) ; break ;
+    case OP_MROT :   c = sim_pop ( m ) ; b = sim_pop ( m ) ; a = sim_pop ( m ) ;
+                     sim_push ( m, c ) ; sim_push ( m, a ) ; sim_push ( m, b ) ; break ;
+    case OP_NIP :    b = sim_pop ( m ) ; sim_pop ( m ) ; sim_push ( m, b ) ; break ;
+    case OP_TUCK :   b = sim_pop ( m ) ; a = sim_pop ( m ) ; sim_push ( m, b ) ; sim_push ( m, a ) ;
+                     sim_push ( m, b ) ; break ;
+    case OP_2DUP :   b = sim_pop ( m ) ; a = sim_pop ( m ) ; sim_push ( m, a ) ; sim_push ( m, b ) ;
+                     sim_push ( m, a ) ; sim_push ( m, b ) ; break ;
+    case OP_2DROP :  sim_pop ( m ) ; sim_pop ( m ) ; break ;
+    case OP_2SWAP :
+    case OP_2OVER :
+      if ( m->sp < 4 )
+      {
+        sim_error ( m, "stack underflow" ) ;
+        break ;
+      }
+      if ( op == OP_2OVER )
+      {
+        sim_push ( m, m->ds[m->sp - 4] ) ;
+        sim_push ( m, m->ds[m->sp - 4] ) ;
+        break ;
+      }
+      a = m->ds[m->sp - 4] ;
+      b = m->ds[m->sp - 3] ;
+      m->ds[m->sp - 4] = m->ds[m->sp - 2] ;
+      m->ds[m->sp - 3] = m->ds[m->sp - 1] ;
+      m->ds[m->sp - 2] = a ;
+      m->ds[m->sp - 1] = b ;
+      break ;
+    case OP_QDUP :   a = sim_pop ( m ) ; sim_push ( m, a ) ;
+                     if ( a )
+                     {
+                       sim_push ( m, a ) ;
+                     }
+                     break ;
+    case OP_PICK :
+      a = sim_pop ( m ) ;
+      if ( a >= m->sp )
+      {
+        sim_error ( m, "stack underflow" ) ;
+        break ;
+      }
+      sim_push ( m, m->ds[m->sp - 1 - a] ) ;
+      break ;
+    case OP_DEPTH :  sim_push ( m, m->sp ) ; break ;
+    case OP_TOR :    sim_rpush ( m, sim_pop ( m ) ) ; break ;
+    case OP_RFROM :  sim_push ( m, sim_rpop ( m ) ) ; break ;
+    case OP_RFETCH :
+    case OP_I :
+    case OP_J :
+      a = ( op == OP_J ) ? 4 : 1 ;			// J is under limit and exit of inner loop
+      if ( m->rp < a )
+      {
+        sim_error ( m, "return stack underflow" ) ;
+        break ;
+      }
+      sim_push ( m, m->rs[m->rp - a] ) ;
+      break ;
+    case OP_UNLOOP :
+      if ( m->rp < 3 )
+      {
+        sim_error ( m, "return stack underflow" ) ;
+        break ;
+      }
+      m->rp -= 3 ;
+      break ;
+    case OP_ADD :    b = sim_pop ( m ) ; sim_push ( m, sim_pop ( m ) + b ) ; break ;
+    case OP_SUB :    b = sim_pop ( m ) ; sim_push ( m, sim_pop ( m ) - b ) ; break ;
+    case OP_MUL :    b = sim_pop ( m ) ; sim_push ( m, sim_pop ( m ) * b ) ; break ;
+    case OP_DIV :
+    case OP_MOD :
+    case OP_DIVMOD :
+    case OP_MULDIV :
+    case OP_MULDIVMOD :
+      sc = sim_signed ( m, sim_pop ( m ) ) ;		// Divisor
+      sb = sim_signed ( m, sim_pop ( m ) ) ;
+      sa = 1 ;
+      if ( op == OP_MULDIV || op == OP_MULDIVMOD )	// Double length intermediate product
+      {
+        sa = sim_signed ( m, sim_pop ( m ) ) ;
+      }
+      if ( sc == 0 )
+      {
+        sim_error ( m, "division by zero" ) ;
+        break ;
+      }
+      sa *= sb ;
+      sb = sa % sc ;					// Remainder, symmetric
+      sa /= sc ;					// Quotient
+      if ( m->floored && sb != 0 && ( sb < 0 ) != ( sc < 0 ) )
+      {
+        sb += sc ;					// Floored, sign of the divisor
+        sa-- ;
+      }
+      if ( op != OP_DIV && op != OP_MULDIV )		// Remainder wanted?
+      {
+        sim_push ( m, sb ) ;
+      }
+      if ( op != OP_MOD )				// Quotient wanted?
+      {
+        sim_push ( m, sa ) ;
+      }
+      break ;
+    case OP_NEGATE : sim_push ( m, -sim_pop ( m ) ) ; break ;
+    case OP_ABS :    sa = sim_signed ( m, sim_pop ( m ) ) ; sim_push ( m, sa < 0 ? -sa : sa ) ;
+                     break ;
+    case OP_MIN :
+    case OP_MAX :
+      sb = sim_signed ( m, sim_pop ( m ) ) ;
+      sa = sim_signed ( m, sim_pop ( m ) ) ;
+      sim_push ( m, ( ( sa < sb ) == ( op == OP_MIN ) ) ? sa : sb ) ;
+      break ;
+    case OP_INC :    sim_push ( m, sim_pop ( m ) + 1 ) ; break ;
+    case OP_DEC :    sim_push ( m, sim_pop ( m ) - 1 ) ; break ;
+    case OP_2MUL :   sim_push ( m, sim_pop ( m ) << 1 ) ; break ;
+    case OP_2DIV :   sim_push ( m, sim_signed ( m, sim_pop ( m ) ) >> 1 ) ; break ;
+    case OP_AND :    b = sim_pop ( m ) ; sim_push ( m, sim_pop ( m ) & b ) ; break ;
+    case OP_OR :     b = sim_pop ( m ) ; sim_push ( m, sim_pop ( m ) | b ) ; break ;
+    case OP_XOR :    b = sim_pop ( m ) ; sim_push ( m, sim_pop ( m ) ^ b ) ; break ;
+    case OP_INVERT : sim_push ( m, ~sim_pop ( m ) ) ; break ;
+    case OP_LSHIFT :
+    case OP_RSHIFT :
+      b = sim_pop ( m ) ;
+      a = sim_pop ( m ) ;
+      if ( b >= m->cellbits )
+      {
+        sim_push ( m, 0 ) ;
+      }
+      else
+      {
+        sim_push ( m, ( op == OP_LSHIFT ) ? a << b : a >> b ) ;
+      }
+      break ;
+    case OP_EQ :     b = sim_pop ( m ) ; sim_push ( m, ( sim_pop ( m ) == b ) ? t : 0 ) ; break ;
+    case OP_NE :     b = sim_pop ( m ) ; sim_push ( m, ( sim_pop ( m ) != b ) ? t : 0 ) ; break ;
+    case OP_LT :
+    case OP_GT :
+      sb = sim_signed ( m, sim_pop ( m ) ) ;
+      sa = sim_signed ( m, sim_pop ( m ) ) ;
+      sim_push ( m, ( op == OP_LT ? sa < sb : sa > sb ) ? t : 0 ) ;
+      break ;
+    case OP_ULT :
+    case OP_UGT :
+      b = sim_pop ( m ) ;
+      a = sim_pop ( m ) ;
+      sim_push ( m, ( op == OP_ULT ? a < b : a > b ) ? t : 0 ) ;
+      break ;
+    case OP_0EQ :    sim_push ( m, ( sim_pop ( m ) == 0 ) ? t : 0 ) ; break ;
+    case OP_0NE :    sim_push ( m, ( sim_pop ( m ) != 0 ) ? t : 0 ) ; break ;
+    case OP_0LT :    sim_push ( m, ( sim_signed ( m, sim_pop ( m ) ) < 0 ) ? t : 0 ) ; break ;
+    case OP_0GT :    sim_push ( m, ( sim_signed ( m, sim_pop ( m ) ) > 0 ) ? t : 0 ) ; break ;
+    case OP_WITHIN :					// ( n lo hi -- flag ) lo <= n < hi
+      c = sim_pop ( m ) ;
+      b = sim_pop ( m ) ;
+      a = sim_pop ( m ) ;
+      sim_push ( m, ( ( ( a - b ) & m->mask ) < ( ( c - b ) & m->mask ) ) ? t : 0 ) ;
+      break ;
+    case OP_TRUE :   sim_push ( m, t ) ; break ;
+    case OP_FALSE :  sim_push ( m, 0 ) ; break ;
+    case OP_FETCH :  sim_push ( m, sim_fetch ( m, sim_pop ( m ) ) ) ; break ;
+    case OP_STORE :  a = sim_pop ( m ) ; b = sim_pop ( m ) ; sim_store ( m, a, b ) ; break ;
+    case OP_CFETCH : sim_push ( m, *sim_mem ( m, sim_pop ( m ) ) ) ; break ;
+    case OP_CSTORE : a = sim_pop ( m ) ; b = sim_pop ( m ) ; *sim_mem ( m, a ) = b ; break ;
+    case OP_PSTORE : a = sim_pop ( m ) ; b = sim_pop ( m ) ;
+                     sim_store ( m, a, sim_fetch ( m, a ) + b ) ; break ;
+    case OP_CELL :   sim_push ( m, cell ) ; break ;
+    case OP_CELLS :  sim_push ( m, sim_pop ( m ) * cell ) ; break ;
+    case OP_CELLP :  sim_push ( m, sim_pop ( m ) + cell ) ; break ;
+    case OP_HERE :   sim_push ( m, m->here ) ; break ;
+    case OP_ALLOT :  sim_allot ( m, sim_signed ( m, sim_pop ( m ) ) ) ; break ;
+    case OP_COMMA :
+    case OP_CCOMMA :
+      if ( m->cur >= 0 && ! m->compiling )		// Inside [ ] of a colon definition?
+      {
+        m->words[m->cur].flags |= SIM_NATIVE ;		// Yes, that is machine code
+      }
+      b = sim_pop ( m ) ;
+      a = sim_allot ( m, ( op == OP_COMMA ) ? cell : 1 ) ;
+      if ( *m->error )
+      {
+        break ;
+      }
+      if ( op == OP_COMMA )
+      {
+        sim_store ( m, a, b ) ;
+      }
+      else
+      {
+        *sim_mem ( m, a ) = b ;
+      }
+      break ;
+    case OP_ALIGN :  sim_allot ( m, ( cell - ( m->here % cell ) ) % cell ) ; break ;
+    case OP_ALIGNED : a = sim_pop ( m ) ; sim_push ( m, a + ( cell - ( a % cell ) ) % cell ) ;
+                      break ;
+    case OP_FILL :					// ( addr n char -- )
+      c = sim_pop ( m ) ;
+      b = sim_pop ( m ) ;
+      a = sim_pop ( m ) ;
+      for ( i = 0 ; i < sim_signed ( m, b ) && ! *m->error ; i++ )
+      {
+        *sim_mem ( m, a + i ) = c ;
+      }
+      break ;
+    case OP_MOVE :					// ( from to n -- ), may overlap
+      c = sim_pop ( m ) ;
+      b = sim_pop ( m ) ;
+      a = sim_pop ( m ) ;
+      for ( i = 0 ; i < sim_signed ( m, c ) && ! *m->error ; i++ )
+      {
+        if ( b <= a )					// Copy upwards
+        {
+          *sim_mem ( m, b + i ) = *sim_mem ( m, a + i ) ;
+        }
+        else						// Copy downwards
+        {
+          *sim_mem ( m, b + c - 1 - i ) = *sim_mem ( m, a + c - 1 - i ) ;
+        }
+      }
+      break ;
+    case OP_COUNT :  a = sim_pop ( m ) ; sim_push ( m, a + 1 ) ; sim_push ( m, *sim_mem ( m, a ) ) ;
+                     break ;
+    case OP_BASE :   sim_push ( m, m->baseaddr ) ; break ;
+    case OP_DOT :    sim_dot ( m, sim_pop ( m ), TRUE, 0, TRUE ) ; break ;
+    case OP_UDOT :   sim_dot ( m, sim_pop ( m ), FALSE, 0, TRUE ) ; break ;
+    case OP_DOTR :
+    case OP_UDOTR :
+      b = sim_pop ( m ) ;
+      a = sim_pop ( m ) ;
+      sim_dot ( m, a, op == OP_DOTR, sim_signed ( m, b ), FALSE ) ;
+      break ;
+    case OP_DOTS :
+      sim_out ( m, name, snprintf ( name, sizeof(name), "<%d> ", m->sp ) ) ;
+      for ( w = 0 ; w < m->sp ; w++ )
+      {
+        sim_dot ( m, m->ds[w], TRUE, 0, TRUE ) ;
+      }
+      break ;
+    case OP_QUEST :  sim_dot ( m, sim_fetch ( m, sim_pop ( m ) ), TRUE, 0, TRUE ) ; break ;
+    case OP_EMIT :   name[0] = sim_pop ( m ) ; sim_out ( m, name, 1 ) ; break ;
+    case OP_CR :     sim_out ( m, "\r\n", 2 ) ; break ;
+    case OP_SPACE :  sim_out ( m, " ", 1 ) ; break ;
+    case OP_SPACES :
+      for ( sa = sim_signed ( m, sim_pop ( m ) ) ; sa > 0 ; sa-- )
+      {
+        sim_out ( m, " ", 1 ) ;
+      }
+      break ;
+    case OP_BL :     sim_push ( m, ' ' ) ; break ;
+    case OP_TYPE :
+      b = sim_pop ( m ) ;
+      a = sim_pop ( m ) ;
+      for ( i = 0 ; i < sim_signed ( m, b ) && ! *m->error ; i++ )
+      {
+        sim_out ( m, (char*)sim_mem ( m, a + i ), 1 ) ;
+      }
+      break ;
+    case OP_HEX :     sim_store ( m, m->baseaddr, 16 ) ; break ;
+    case OP_DECIMAL : sim_store ( m, m->baseaddr, 10 ) ; break ;
+    case OP_COLON :
+    case OP_NONAME :
+      if ( m->compiling )
+      {
+        sim_error ( m, "nested definition" ) ;
+        break ;
+      }
+      if ( op == OP_COLON )
+      {
+        m->cur = sim_define ( m, SIM_COLON, m->codec ) ;
+      }
+      else
+      {
+        m->cur = sim_add ( m, "", SIM_COLON, m->codec ) ;
+      }
+      if ( m->cur >= 0 )
+      {
+        m->curhere = m->here ;
+        m->words[m->cur].flags |= SIM_HIDDEN ;		// Not found until ;
+        m->compiling = TRUE ;
+        m->csp = 0 ;
+      }
+      break ;
+    case OP_SEMI :
+      if ( m->cur < 0 || ! m->compiling )
+      {
+        sim_error ( m, "; without :" ) ;
+        break ;
+      }
+      if ( m->csp )
+      {
+        sim_error ( m, "unbalanced control structure" ) ;
+        break ;
+      }
+      sim_compile ( m, OP_EXIT ) ;
+      m->words[m->cur].flags &= ~SIM_HIDDEN ;
+      if ( m->words[m->cur].name[0] == '\0' )		// :NONAME leaves its execution token
+      {
+        sim_push ( m, m->cur ) ;
+      }
+      m->cur = -1 ;
+      m->compiling = FALSE ;
+      break ;
+    case OP_CONSTANT :  sim_define ( m, SIM_CONST, sim_pop ( m ) ) ; break ;
+    case OP_VARIABLE :
+    case OP_CREATE :
+    case OP_BUFFER :
+    case OP_VALUE :
+    case OP_DEFER :
+      a = ( op == OP_BUFFER || op == OP_VALUE ) ? sim_pop ( m ) : 0 ;
+      if ( op != OP_CREATE && op != OP_BUFFER )		// Cells are aligned
+      {
+        sim_prim ( m, OP_ALIGN ) ;
+      }
+      switch ( op )
+      {
+        case OP_VARIABLE : w = sim_define ( m, SIM_VAR, m->here ) ;    break ;
+        case OP_BUFFER :   w = sim_define ( m, SIM_VAR, m->here ) ;    break ;
+        case OP_CREATE :   w = sim_define ( m, SIM_CREATE, m->here ) ; break ;
+        case OP_VALUE :    w = sim_define ( m, SIM_VALUE, m->here ) ;  break ;
+        default :          w = sim_define ( m, SIM_DEFER, m->here ) ;
+                           a = -1 ;			// Not set yet
+      }
+      if ( w < 0 || op == OP_CREATE )
+      {
+        break ;
+      }
+      b = sim_allot ( m, ( op == OP_BUFFER ) ? sim_signed ( m, a ) : cell ) ;
+      if ( op != OP_BUFFER && ! *m->error )
+      {
+        sim_store ( m, b, a ) ;
+      }
+      break ;
+    case OP_DOESC :     sim_compile ( m, OP_DOES ) ; break ;
+    case OP_TO :
+    case OP_IS :
+      if ( ! sim_parse ( m, name, sizeof(name) ) ||
+           ( w = sim_find ( m, name ) ) < 0 ||
+           m->words[w].kind != ( op == OP_TO ? SIM_VALUE : SIM_DEFER ) )
+      {
+        sim_error ( m, "%s?", name ) ;
+        break ;
+      }
+      if ( m->compiling )				// Compile the store
+      {
+        sim_compile ( m, OP_LIT ) ;
+        sim_compile ( m, m->words[w].param ) ;
+        sim_compile ( m, OP_STORE ) ;
+      }
+      else
+      {
+        sim_store ( m, m->words[w].param, sim_pop ( m ) ) ;
+      }
+      break ;
+    case OP_IMMEDIATE :
+      if ( m->wordc )
+      {
+        m->words[m->wordc - 1].flags |= SIM_IMMEDIATE ;
+      }
+      break ;
+    case OP_TICK :
+    case OP_BTICK :
+      if ( ! sim_parse ( m, name, sizeof(name) ) || ( w = sim_find ( m, name ) ) < 0 )
+      {
+        sim_error ( m, "%s?", name ) ;
+        break ;
+      }
+      if ( op == OP_BTICK )
+      {
+        sim_compile ( m, OP_LIT ) ;
+        sim_compile ( m, w ) ;
+      }
+      else
+      {
+        sim_push ( m, w ) ;
+      }
+      break ;
+    case OP_LBRACKET :  m->compiling = FALSE ; break ;
+    case OP_RBRACKET :  m->compiling = TRUE ; break ;
+    case OP_LITERAL :
+      sim_compile ( m, OP_LIT ) ;
+      sim_compile ( m, sim_pop ( m ) ) ;
+      break ;
+    case OP_RECURSE :
+      if ( m->cur >= 0 )
+      {
+        sim_compile ( m, m->cur ) ;
+      }
+      break ;
+    case OP_CHAR :
+    case OP_BCHAR :
+      if ( ! sim_parse ( m, name, sizeof(name) ) )
+      {
+        sim_error ( m, "name missing" ) ;
+        break ;
+      }
+      if ( op == OP_BCHAR )
+      {
+        sim_compile ( m, OP_LIT ) ;
+        sim_compile ( m, (BYTE)name[0] ) ;
+      }
+      else
+      {
+        sim_push ( m, (BYTE)name[0] ) ;
+      }
+      break ;
+    case OP_PAREN :     sim_parse_to ( m, ')', &p ) ; break ;
+    case OP_BACKSLASH : m->pos = strlen ( m->line ) ; break ;
+    case OP_DOTQ :
+    case OP_SQ :
+    case OP_DOTP :
+    case OP_ABORTQC :
+      sim_string ( m, op ) ;
+      break ;
+    case OP_ABORT :     sim_error ( m, "ABORT" ) ; break ;
+    case OP_BIF :
+      if ( sim_pop ( m ) == 0 )				// False, skip to [ELSE] or [THEN]
+      {
+        m->skip = 1 ;
+      }
+      break ;
+    case OP_BELSE :     m->skip = 1 ; break ;		// True part done, skip to [THEN]
+    case OP_BTHEN :     break ;
+    case OP_WORDS :     sim_words ( m ) ; break ;
+    case OP_MS :        sim_pop ( m ) ; break ;		// Time is not simulated
+    case OP_KEYQ :      sim_push ( m, 0 ) ; break ;	// No key pressed
+    case OP_CODE :      sim_error ( m, "CODE is not simulated" ) ; break ;
+    case OP_NOP :       break ;
+    default :
+      sim_control ( m, op ) ;				// Compile a control structure
+  }
+}
+
+
+//***************************************************************************************************
+//					S I M _ E X E C U T E					    *
+//***************************************************************************************************
+// Execute a word.  Colon definitions run until their EXIT, with their return addresses on the	    *
+// return stack of the simulator.  Execution stops at the first error.				    *
+//***************************************************************************************************
+static void sim_execute ( struct esc_sim* m, int xt )
+{
+  struct esc_simword* d ;				// Word to execute
+  int                 w = xt ;				// Execution token of word
+  int                 ip = -1 ;				// Next cell of code, -1 if none
+  int                 nest = 0 ;			// Return addresses on the return stack
+  DWORD               a, b ;				// Operands
+  LONGLONG            sa, sb ;				// Signed operands
+
+  while ( ! *m->error )
+  {
+    if ( ++m->steps > ESC_SIMSTEPS )			// Runaway loop?
+    {
+      sim_error ( m, "more than %d steps", ESC_SIMSTEPS ) ;
+      break ;
+    }
+    if ( w < 0 || w >= m->wordc )
+    {
+      sim_error ( m, "bad execution token %d", w ) ;
+      break ;
+    }
+    d = &m->words[w] ;
+    if ( ip < 0 && d->kind == SIM_PRIM &&		// Needs code of a colon definition?
+         ( d->param <= OP_NEXT || d->param == OP_LEAVE ) )
+    {
+      sim_error ( m, "%s is compile only", d->name ) ;
+      break ;
+    }
+    switch ( d->kind )
+    {
+      case SIM_COLON :
+        if ( d->flags & SIM_NATIVE )
+        {
+          sim_error ( m, "%s has native code", d->name ) ;
+          break ;
+        }
+        if ( ip >= 0 )					// Nested call?
+        {
+          sim_rpush ( m, ip ) ;
+          nest++ ;
+        }
+        ip = d->param ;
+        break ;
+      case SIM_CONST :
+      case SIM_VAR :
+        sim_push ( m, d->param ) ;
+        break ;
+      case SIM_VALUE :
+        sim_push ( m, sim_fetch ( m, d->param ) ) ;
+        break ;
+      case SIM_DEFER :
+        w = sim_signed ( m, sim_fetch ( m, d->param ) ) ;
+        if ( w < 0 )
+        {
+          sim_error ( m, "%s is not set", d->name ) ;
+        }
+        continue ;					// Execute the word it refers to
+      case SIM_CREATE :
+        sim_push ( m, d->param ) ;
+        if ( d->does >= 0 )				// Run DOES> part
+        {
+          if ( ip >= 0 )
+          {
+            sim_rpush ( m, ip ) ;
+            nest++ ;
+          }
+          ip = d->does ;
+        }
+        break ;
+      default :
+        switch ( d->param )
+        {
+          case OP_LIT :
+            sim_push ( m, m->code[ip++] ) ;
+            break ;
+          case OP_BRANCH :
+            ip = m->code[ip] ;
+            break ;
+          case OP_0BRANCH :
+            ip = sim_pop ( m ) ? ip + 1 : m->code[ip] ;
+            break ;
+          case OP_DO :
+          case OP_QDO :
+            a = sim_pop ( m ) ;				// Start index
+            b = sim_pop ( m ) ;				// Limit
+            if ( d->param == OP_QDO && a == b )		// Nothing to do?
+            {
+              ip = m->code[ip] ;
+              break ;
+            }
+            sim_rpush ( m, m->code[ip++] ) ;		// Exit for LEAVE
+            sim_rpush ( m, b ) ;
+            sim_rpush ( m, a ) ;
+            break ;
+          case OP_LOOP :
+          case OP_PLOOP :
+            if ( m->rp < 3 )
+            {
+              sim_error ( m, "return stack underflow" ) ;
+              break ;
+            }
+            sa = sim_signed ( m, m->rs[m->rp - 1] - m->rs[m->rp - 2] ) ;	// Index - limit
+            sb = ( d->param == OP_LOOP ) ? 1 : sim_signed ( m, sim_pop ( m ) ) ;
+            m->rs[m->rp - 1] = ( m->rs[m->rp - 1] + sb ) & m->mask ;
+            if ( ( sa < 0 ) != ( sa + sb < 0 ) )	// Crossed the limit?
+            {
+              m->rp -= 3 ;				// Yes, done
+              ip++ ;
+            }
+            else
+            {
+              ip = m->code[ip] ;
+            }
+            break ;
+          case OP_NEXT :
+            if ( m->rp < 1 )
+            {
+              sim_error ( m, "return stack underflow" ) ;
+            }
+            else if ( m->rs[m->rp - 1] == 0 )		// Count done?
+            {
+              m->rp-- ;
+              ip++ ;
+            }
+            else
+            {
+              m->rs[m->rp - 1]-- ;
+              ip = m->code[ip] ;
+            }
+            break ;
+          case OP_LEAVE :
+            if ( m->rp < 3 )
+            {
+              sim_error ( m, "return stack underflow" ) ;
+              break ;
+            }
+            ip = m->rs[m->rp - 3] ;
+            m->rp -= 3 ;
+            break ;
+          case OP_ABORTQ :				// ( flag addr len -- )
+            b = sim_pop ( m ) ;
+            a = sim_pop ( m ) ;
+            if ( sim_pop ( m ) )
+            {
+              sim_error ( m, "%.*s", (int)b, (char*)sim_mem ( m, a ) ) ;
+            }
+            break ;
+          case OP_EXECUTE :
+            w = sim_signed ( m, sim_pop ( m ) ) ;
+            continue ;					// Execute it
+          case OP_DOES :				// Latest word gets the rest as DOES> part
+            if ( m->wordc )
+            {
+              m->words[m->wordc - 1].does = ip ;
+            }
+            // Fall through, the defining word ends here
+          case OP_EXIT :
+            if ( nest == 0 )				// Back in the interpreter?
+            {
+              return ;
+            }
+            ip = sim_rpop ( m ) ;
+            nest-- ;
+            break ;
+          default :
+            sim_prim ( m, d->param ) ;
+        }
+    }
+    if ( ip < 0 )					// Not in a colon definition?
+    {
+      break ;						// Then done
+    }
+    w = m->code[ip++] ;
+  }
+}
+
+
+//***************************************************************************************************
+//					S I M _ S K I P						    *
+//***************************************************************************************************
+// Handle a word in a part that is left out by [IF] or [ELSE].  Only nested [IF]s count.	    *
+//***************************************************************************************************
+static void sim_skip ( struct esc_sim* m, const char* tok )
+{
+  if ( strcasecmp ( tok, "[IF]" ) == 0 )
+  {
+    m->skip++ ;
+  }
+  else if ( strcasecmp ( tok, "[ELSE]" ) == 0 && m->skip == 1 )
+  {
+    m->skip = 0 ;					// False part starts
+  }
+  else if ( strcasecmp ( tok, "[THEN]" ) == 0 )
+  {
+    m->skip-- ;
+  }
+  else if ( strcmp ( tok, "\\" ) == 0 )
+  {
+    m->pos = strlen ( m->line ) ;			// Rest of line is comment
+  }
+}
+
+
+//***************************************************************************************************
+//					S I M _ L I N E						    *
+//***************************************************************************************************
+// Interpret the received line and queue the reply.  After an error the stacks are emptied and a    *
+// half finished definition is removed, like on the target.  A line that leaves the simulator	    *
+// compiling gets no "ok", only the line end.							    *
+//***************************************************************************************************
+static void sim_line ( struct esc_sim* m )
+{
+  char                  tok[64] ;			// Word from the line
+  DWORD                 v ;				// Value of number
+  int                   w ;				// Execution token
+  int                   depth = m->sp ;			// Stack depth before the line
+  BOOL                  compiling = m->compiling ;	// State before the line
+  struct esc_simeffect* e ;				// Logged stack effect
+  const char*           p ;				// Line end of the "ok" phrase
+
+  m->pos = 0 ;
+  m->steps = 0 ;
+  m->error[0] = '\0' ;
+  while ( ! *m->error && sim_parse ( m, tok, sizeof(tok) ) )
+  {
+    if ( m->skip )					// In a part left out by [IF]?
+    {
+      sim_skip ( m, tok ) ;
+    }
+    else if ( ( w = sim_find ( m, tok ) ) >= 0 )	// Known word?
+    {
+      if ( m->compiling && ! ( m->words[w].flags & SIM_IMMEDIATE ) )
+      {
+        sim_compile ( m, w ) ;
+      }
+      else
+      {
+        sim_execute ( m, w ) ;
+      }
+    }
+    else if ( sim_number ( m, tok, &v ) )		// Number?
+    {
+      if ( m->compiling )
+      {
+        sim_compile ( m, OP_LIT ) ;
+        sim_compile ( m, v ) ;
+      }
+      else
+      {
+        sim_push ( m, v ) ;
+      }
+    }
+    else
+    {
+      sim_error ( m, "%s?", tok ) ;			// Unknown
+    }
+  }
+  m->lines++ ;
+  m->totsteps += m->steps ;
+  if ( *m->error )
+  {
+    m->errors++ ;
+    sim_out ( m, " ", 1 ) ;
+    sim_out ( m, m->error, strlen ( m->error ) ) ;
+    sim_out ( m, "\x07\n", 2 ) ;			// BELL ends the reply
+    m->sp = m->rp = m->csp = m->skip = 0 ;
+    if ( m->cur >= 0 )					// Remove half finished definition
+    {
+      m->codec = m->words[m->cur].param ;
+      m->wordc = m->cur ;
+      m->here = m->curhere ;
+      m->cur = -1 ;
+    }
+    m->compiling = FALSE ;
+    return ;
+  }
+  if ( ! compiling && ! m->compiling && m->sp != depth )	// Stack effect outside definitions?
+  {
+    if ( m->effectc < ESC_SIMEFFECTS )
+    {
+      e = &m->effects[m->effectc] ;
+      snprintf ( e->line, sizeof(e->line), "%.*s", (int)sizeof(e->line) - 1, m->line ) ;
+      e->before = depth ;
+      e->after = m->sp ;
+    }
+    m->effectc++ ;
+  }
+  if ( m->compiling )					// Like the targets, no "ok" while compiling
+  {
+    p = m->ok + strcspn ( m->ok, "\r\n" ) ;		// Only the line end
+    sim_out ( m, p, strlen ( p ) ) ;
+    return ;
+  }
+  sim_out ( m, m->ok, strlen ( m->ok ) ) ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ S I M _ I N I T					    *
+//***************************************************************************************************
+// Initialize the simulator with the cell size, byte order and "ok" phrase of a target.		    *
+// The dictionary has the primitives only.  The simulator is large, allocate it on the heap.	    *
+//***************************************************************************************************
+void esc_sim_init ( struct esc_sim* m, const char* target )
+{
+  int i ;
+
+  memset ( m, 0, sizeof(*m) ) ;
+  m->cellbits = 32 ;					// Assume mecrisp or zepto
+  m->rambase = 0x20000000 ;				// RAM of a Cortex-M
+  m->ok = ( strcasecmp ( target, "zepto" ) == 0 ) ? " ok\r\n" : " ok.\n" ;
+  if ( strcasecmp ( target, "mecrisp" ) != 0 &&		// Target is "stm8ef"?
+       strcasecmp ( target, "zepto" ) != 0 )
+  {
+    m->cellbits = 16 ;					// Yes, 16 bits cells, big endian
+    m->bigendian = TRUE ;
+    m->rambase = 0 ;					// The whole address space is RAM
+    m->floored = TRUE ;					// eForth divides floored
+    m->ok = " ok\n" ;
+  }
+  m->mask = ( m->cellbits == 16 ) ? 0xFFFF : 0xFFFFFFFF ;
+  m->cur = -1 ;
+  for ( i = 0 ; i < SIM_OPS ; i++ )			// Execution token of primitive is its op
+  {
+    sim_add ( m, sim_prims[i].name, SIM_PRIM, i ) ;
+    m->words[i].flags = sim_prims[i].flags ;
+  }
+  for ( i = 0 ; sim_aliases[i].name ; i++ )
+  {
+    sim_add ( m, sim_aliases[i].name, SIM_PRIM, sim_aliases[i].op ) ;
+  }
+  m->baseaddr = m->rambase ;				// BASE is the first cell of RAM
+  m->here = m->rambase + 16 ;
+  sim_store ( m, m->baseaddr, 10 ) ;
+}
+
+
+//***************************************************************************************************
+//					E S C _ S I M _ I N P U T				    *
+//***************************************************************************************************
+// Bytes for the simulated target.  Every byte is echoed, a line is interpreted at its CR.	    *
+// Backspace and DEL erase the last character, like on the target.				    *
+//***************************************************************************************************
+void esc_sim_input ( struct esc_sim* m, const char* buf, int len )
+{
+  int i ;
+
+  for ( i = 0 ; i < len ; i++ )
+  {
+    switch ( buf[i] )
+    {
+      case '\r' :					// End of line
+        m->line[m->linec] = '\0' ;
+        sim_out ( m, " ", 1 ) ;				// CR echoes as a space
+        sim_line ( m ) ;
+        m->linec = 0 ;
+        break ;
+      case '\n' :					// Ignored
+        break ;
+      case '\b' :
+      case 0x7F :
+        if ( m->linec )
+        {
+          m->linec-- ;
+          sim_out ( m, "\b \b", 3 ) ;
+        }
+        break ;
+      default :
+        if ( m->linec < sizeof(m->line) - 1 )		// Room in input buffer?
+        {
+          m->line[m->linec++] = buf[i] ;
+          sim_out ( m, buf + i, 1 ) ;
+        }
+    }
+  }
+}
+
+
+//***************************************************************************************************
+//					E S C _ S I M _ O U T P U T				    *
+//***************************************************************************************************
+// Take at most maxlen bytes of the output of the simulated target.  Returns the number of bytes.   *
+//***************************************************************************************************
+int esc_sim_output ( struct esc_sim* m, char* buf, int maxlen )
+{
+  int n = ( m->outc < maxlen ) ? m->outc : maxlen ;	// Bytes to take
+
+  memcpy ( buf, m->out, n ) ;
+  memmove ( m->out, m->out + n, m->outc - n ) ;
+  m->outc -= n ;
+  return n ;
+}